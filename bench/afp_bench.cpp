@@ -0,0 +1,435 @@
+/*
+ * afp_bench: throughput, latency and syscall counts for finder_info and
+ * resource_fork, as JSON.
+ *
+ * afp_bench [-d dir] [-n iterations] [-t threads] [-s fork sizes] [-c chunk sizes] [-o file]
+ *
+ * lists are comma separated and sizes may use a K or M suffix.  Chunk size 0
+ * is the single attribute layout.  Each thread works on its own file in a
+ * scratch directory created under dir (tmpfs by default, so results reflect
+ * the library rather than the disk); point dir at a loopback ext4 mount
+ * to measure that instead.  A fork size of 0 means no resource fork.
+ */
+
+#include "finder_info.h"
+#include "resource_fork.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sysexits.h>
+#include <sys/stat.h>
+
+extern "C" {
+	extern __thread unsigned long afp_bench_syscalls;
+	int afp_bench_count_syscalls(void);
+}
+
+namespace {
+
+	bool no_data(const std::error_code &ec) {
+		return ec == std::errc::no_message_available;
+	}
+
+	struct options {
+		std::string dir;
+		unsigned iterations = 1000;
+		std::vector<size_t> threads = { 1, 2, 4 };
+		std::vector<size_t> sizes = { 0, 32, 1024, 4096, 16384, 65536, 262144 };
+		std::vector<size_t> chunks = { 0, 8192 };
+		std::string output;
+	};
+
+	/* per thread state */
+	struct context {
+		std::string path;
+		size_t fork_size = 0;
+		size_t chunk_size = 0;
+		std::vector<uint8_t> data;
+		std::vector<uint8_t> buffer;
+		afp::finder_info finder_info;
+	};
+
+	struct bench_case {
+		const char *name;
+		bool sized; // run for each fork size
+		bool chunked; // run for each chunk size
+		std::function<bool(context &, std::error_code &)> setup; // once per thread
+		std::function<bool(context &, std::error_code &)> reset; // before each iteration, untimed
+		std::function<size_t(context &, std::error_code &)> run; // returns bytes transferred
+	};
+
+	struct result {
+		std::string name;
+		size_t fork_size = 0;
+		size_t chunk_size = 0;
+		size_t threads = 0;
+		uint64_t ops = 0;
+		double seconds = 0;
+		uint64_t bytes = 0;
+		uint64_t p50 = 0;
+		uint64_t p99 = 0;
+		uint64_t syscalls = 0;
+		std::string error;
+	};
+
+
+	bool create_file(const std::string &path, std::error_code &ec) {
+		int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+		if (fd < 0) {
+			ec = std::error_code(errno, std::system_category());
+			return false;
+		}
+		::close(fd);
+		return true;
+	}
+
+	/* replace the file's fork with ctx.data in the requested layout */
+	bool write_fork(context &ctx, std::error_code &ec) {
+		afp::resource_fork::remove(ctx.path, ec);
+		if (ec && !no_data(ec)) return false;
+		ec.clear();
+		if (!ctx.fork_size) return true;
+
+		afp::resource_fork rf;
+		if (!rf.open(ctx.path, afp::resource_fork::write_only, ec)) return false;
+		if (ctx.chunk_size) rf.set_chunked(true, ctx.chunk_size);
+		rf.write(ctx.data.data(), ctx.data.size(), ec);
+		rf.close();
+		return !ec;
+	}
+
+	bool write_finder_info(context &ctx, std::error_code &ec) {
+		ctx.finder_info.set_file_type(0x54455854); // 'TEXT'
+		ctx.finder_info.set_creator_type(0x74747874); // 'ttxt'
+		return ctx.finder_info.write(ctx.path, ec);
+	}
+
+	/* a missing fork is the expected result for fork size 0 */
+	size_t expect_fork(const context &ctx, size_t n, std::error_code &ec) {
+		if (!ctx.fork_size && no_data(ec)) ec.clear();
+		return n;
+	}
+
+
+	std::vector<bench_case> cases() {
+		typedef afp::resource_fork rf_t;
+		std::vector<bench_case> v;
+
+		v.push_back({ "finder_info.read", false, false, write_finder_info, nullptr,
+			[](context &ctx, std::error_code &ec) -> size_t {
+				afp::finder_info fi;
+				return fi.read(ctx.path, ec) ? 32 : 0;
+			}
+		});
+
+		v.push_back({ "finder_info.read_fast", false, false, write_finder_info, nullptr,
+			[](context &ctx, std::error_code &ec) -> size_t {
+				afp::finder_info fi;
+				return fi.read_fast(ctx.path, ec) ? 32 : 0;
+			}
+		});
+
+		v.push_back({ "finder_info.write", false, false, write_finder_info, nullptr,
+			[](context &ctx, std::error_code &ec) -> size_t {
+				return ctx.finder_info.write(ctx.path, ec) ? 32 : 0;
+			}
+		});
+
+		v.push_back({ "resource_fork.open", false, false, write_fork, nullptr,
+			[](context &ctx, std::error_code &ec) -> size_t {
+				rf_t rf;
+				rf.open(ctx.path, rf_t::read_only, ec);
+				return 0;
+			}
+		});
+
+		v.push_back({ "resource_fork.size", true, true, write_fork, nullptr,
+			[](context &ctx, std::error_code &ec) -> size_t {
+				rf_t rf;
+				if (!rf.open(ctx.path, rf_t::read_only, ec)) return 0;
+				rf.size(ec);
+				return expect_fork(ctx, 0, ec);
+			}
+		});
+
+		v.push_back({ "resource_fork.read", true, true, write_fork, nullptr,
+			[](context &ctx, std::error_code &ec) -> size_t {
+				rf_t rf;
+				if (!rf.open(ctx.path, rf_t::read_only, ec)) return 0;
+				ctx.buffer.resize(ctx.fork_size);
+				size_t n = rf.read(ctx.buffer.data(), ctx.buffer.size(), ec);
+				return expect_fork(ctx, n, ec);
+			}
+		});
+
+		v.push_back({ "resource_fork.write", true, true, write_fork, nullptr,
+			[](context &ctx, std::error_code &ec) -> size_t {
+				rf_t rf;
+				if (!rf.open(ctx.path, rf_t::read_write, ec)) return 0;
+				if (ctx.chunk_size) rf.set_chunked(true, ctx.chunk_size);
+				size_t n = rf.write(ctx.data.data(), ctx.data.size(), ec);
+				rf.close();
+				return n;
+			}
+		});
+
+		v.push_back({ "resource_fork.truncate", true, true, nullptr, write_fork,
+			[](context &ctx, std::error_code &ec) -> size_t {
+				rf_t rf;
+				if (!rf.open(ctx.path, rf_t::read_write, ec)) return 0;
+				rf.truncate(ctx.fork_size / 2, ec);
+				expect_fork(ctx, 0, ec);
+				return 0;
+			}
+		});
+
+		v.push_back({ "resource_fork.size_path", true, true, write_fork, nullptr,
+			[](context &ctx, std::error_code &ec) -> size_t {
+				rf_t::size(ctx.path, ec);
+				return expect_fork(ctx, 0, ec);
+			}
+		});
+
+		v.push_back({ "resource_fork.size_fast", true, true, write_fork, nullptr,
+			[](context &ctx, std::error_code &ec) -> size_t {
+				rf_t::size_fast(ctx.path, ec);
+				return expect_fork(ctx, 0, ec);
+			}
+		});
+
+		v.push_back({ "resource_fork.read_fast", true, true, write_fork, nullptr,
+			[](context &ctx, std::error_code &ec) -> size_t {
+				size_t n = rf_t::read_fast(ctx.path, ctx.buffer, ec);
+				return expect_fork(ctx, n, ec);
+			}
+		});
+
+		// the static write has no layout option.
+		v.push_back({ "resource_fork.write_path", true, false, write_fork, nullptr,
+			[](context &ctx, std::error_code &ec) -> size_t {
+				return rf_t::write(ctx.path, ctx.data.data(), ctx.data.size(), ec);
+			}
+		});
+
+		return v;
+	}
+
+
+	uint64_t now_ns() {
+		using namespace std::chrono;
+		return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+	}
+
+	result run_case(const options &opts, const bench_case &bc, size_t fork_size, size_t chunk_size, size_t threads) {
+		result r;
+		r.name = bc.name;
+		r.fork_size = fork_size;
+		r.chunk_size = chunk_size;
+		r.threads = threads;
+
+		std::vector<std::vector<uint64_t>> latency(threads);
+		std::vector<uint64_t> bytes(threads);
+		std::vector<uint64_t> syscalls(threads);
+		std::vector<uint64_t> busy(threads);
+		std::vector<std::error_code> errors(threads);
+
+		std::atomic<size_t> ready(0);
+		std::atomic<bool> go(false);
+
+		auto worker = [&](size_t id) {
+			context ctx;
+			ctx.path = opts.dir + "/t" + std::to_string(id);
+			ctx.fork_size = fork_size;
+			ctx.chunk_size = chunk_size;
+			ctx.data.resize(fork_size);
+			for (size_t i = 0; i < fork_size; ++i) ctx.data[i] = i * 7 + id;
+
+			std::error_code ec;
+			if (create_file(ctx.path, ec) && bc.setup) bc.setup(ctx, ec);
+
+			++ready;
+			while (!go.load()) std::this_thread::yield();
+
+			auto &lat = latency[id];
+			lat.reserve(opts.iterations);
+			for (unsigned i = 0; i < opts.iterations && !ec; ++i) {
+				if (bc.reset && !bc.reset(ctx, ec)) break;
+
+				unsigned long sc = afp_bench_syscalls;
+				uint64_t t = now_ns();
+				size_t n = bc.run(ctx, ec);
+				t = now_ns() - t;
+				lat.push_back(t);
+				busy[id] += t;
+				syscalls[id] += afp_bench_syscalls - sc;
+				bytes[id] += n;
+			}
+			errors[id] = ec;
+			::unlink(ctx.path.c_str());
+		};
+
+		std::vector<std::thread> tv;
+		for (size_t i = 0; i < threads; ++i) tv.emplace_back(worker, i);
+		while (ready.load() != threads) std::this_thread::yield();
+		go = true;
+		for (auto &t : tv) t.join();
+
+		std::vector<uint64_t> all;
+		for (size_t i = 0; i < threads; ++i) {
+			all.insert(all.end(), latency[i].begin(), latency[i].end());
+			r.bytes += bytes[i];
+			r.syscalls += syscalls[i];
+			// the untimed resets are excluded, so throughput is ops over the busiest thread's time.
+			r.seconds = std::max(r.seconds, busy[i] / 1e9);
+			if (errors[i] && r.error.empty()) r.error = errors[i].message();
+		}
+		r.ops = all.size();
+		if (!all.empty()) {
+			std::sort(all.begin(), all.end());
+			r.p50 = all[(all.size() - 1) * 50 / 100];
+			r.p99 = all[(all.size() - 1) * 99 / 100];
+		}
+		return r;
+	}
+
+
+	std::string json_string(const std::string &s) {
+		std::string rv = "\"";
+		for (char c : s) {
+			if (c == '"' || c == '\\') rv.push_back('\\');
+			if ((unsigned char)c < 0x20) c = ' ';
+			rv.push_back(c);
+		}
+		rv.push_back('"');
+		return rv;
+	}
+
+	void print_result(FILE *fp, const result &r, bool last) {
+		double ops = r.seconds > 0 ? r.ops / r.seconds : 0;
+		double bps = r.seconds > 0 ? r.bytes / r.seconds : 0;
+
+		fprintf(fp, "    {\"name\": %s, \"fork_size\": %zu, \"chunk_size\": %zu, \"threads\": %zu, ",
+			json_string(r.name).c_str(), r.fork_size, r.chunk_size, r.threads);
+		fprintf(fp, "\"ops\": %llu, \"ops_per_sec\": %.1f, \"bytes_per_sec\": %.1f, ",
+			(unsigned long long)r.ops, ops, bps);
+		fprintf(fp, "\"p50_ns\": %llu, \"p99_ns\": %llu, ",
+			(unsigned long long)r.p50, (unsigned long long)r.p99);
+		if (afp_bench_count_syscalls() && r.ops)
+			fprintf(fp, "\"syscalls_per_op\": %.2f", (double)r.syscalls / r.ops);
+		else
+			fprintf(fp, "\"syscalls_per_op\": null");
+		if (!r.error.empty())
+			fprintf(fp, ", \"error\": %s", json_string(r.error).c_str());
+		fprintf(fp, "}%s\n", last ? "" : ",");
+	}
+
+
+	bool parse_list(const char *arg, std::vector<size_t> &v) {
+		v.clear();
+		const char *cp = arg;
+		while (*cp) {
+			char *end;
+			errno = 0;
+			unsigned long long x = std::strtoull(cp, &end, 10);
+			if (end == cp || errno) return false;
+			switch (*end) {
+				case 'k': case 'K': x <<= 10; ++end; break;
+				case 'm': case 'M': x <<= 20; ++end; break;
+			}
+			v.push_back(x);
+			if (*end == ',') ++end;
+			else if (*end) return false;
+			cp = end;
+		}
+		return !v.empty();
+	}
+
+	void usage(int rv) {
+		fputs("afp_bench [-d dir] [-n iterations] [-t threads] [-s fork sizes] [-c chunk sizes] [-o file]\n", stderr);
+		exit(rv);
+	}
+
+	std::string default_dir() {
+		struct stat st;
+		if (::stat("/dev/shm", &st) == 0 && S_ISDIR(st.st_mode)) return "/dev/shm";
+		const char *cp = getenv("TMPDIR");
+		return cp && *cp ? cp : "/tmp";
+	}
+
+}
+
+
+int main(int argc, char **argv) {
+	options opts;
+	int c;
+
+	while ((c = getopt(argc, argv, "d:n:t:s:c:o:h")) != -1) {
+		switch (c) {
+			case 'd': opts.dir = optarg; break;
+			case 'n': opts.iterations = std::strtoul(optarg, nullptr, 10); break;
+			case 't': if (!parse_list(optarg, opts.threads)) usage(EX_USAGE); break;
+			case 's': if (!parse_list(optarg, opts.sizes)) usage(EX_USAGE); break;
+			case 'c': if (!parse_list(optarg, opts.chunks)) usage(EX_USAGE); break;
+			case 'o': opts.output = optarg; break;
+			case 'h': usage(0); break;
+			default: usage(EX_USAGE);
+		}
+	}
+	if (optind != argc || !opts.iterations) usage(EX_USAGE);
+	for (size_t t : opts.threads) if (!t) usage(EX_USAGE);
+
+	std::string base = opts.dir.empty() ? default_dir() : opts.dir;
+	std::string tmpl = base + "/afp_bench.XXXXXX";
+	std::vector<char> tmp(tmpl.begin(), tmpl.end());
+	tmp.push_back(0);
+	if (!mkdtemp(tmp.data())) {
+		fprintf(stderr, "afp_bench: %s: %s\n", base.c_str(), strerror(errno));
+		return 1;
+	}
+	opts.dir = tmp.data();
+
+	FILE *fp = stdout;
+	if (!opts.output.empty()) {
+		fp = fopen(opts.output.c_str(), "w");
+		if (!fp) {
+			fprintf(stderr, "afp_bench: %s: %s\n", opts.output.c_str(), strerror(errno));
+			rmdir(opts.dir.c_str());
+			return 1;
+		}
+	}
+
+	std::vector<result> results;
+	for (const auto &bc : cases()) {
+		std::vector<size_t> sizes = bc.sized ? opts.sizes : std::vector<size_t>{ 32 };
+		std::vector<size_t> chunks = bc.chunked ? opts.chunks : std::vector<size_t>{ 0 };
+		for (size_t t : opts.threads) {
+			for (size_t s : sizes) {
+				for (size_t ch : chunks) {
+					results.push_back(run_case(opts, bc, s, ch, t));
+				}
+			}
+		}
+	}
+	rmdir(opts.dir.c_str());
+
+	fprintf(fp, "{\n  \"directory\": %s,\n  \"iterations\": %u,\n  \"results\": [\n",
+		json_string(base).c_str(), opts.iterations);
+	for (size_t i = 0; i < results.size(); ++i)
+		print_result(fp, results[i], i + 1 == results.size());
+	fprintf(fp, "  ]\n}\n");
+
+	if (fp != stdout) fclose(fp);
+	return 0;
+}
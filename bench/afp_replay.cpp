@@ -0,0 +1,532 @@
+/*
+ * afp_replay: replay an afp::trace recording against a scratch directory
+ * and compare the latencies with the recorded ones, as JSON.
+ *
+ * afp_replay [-d dir] [-j threads] [-m] [-x speed] [-o file] trace
+ *
+ * paths aren't recorded, so each path hash becomes a file in a scratch
+ * directory created under dir (tmpfs by default).  Before replaying, each
+ * file gets a resource fork as large as the trace shows it was before its
+ * first write, and Finder info if the trace read some; contents are
+ * synthetic.  Recorded threads are spread over -j workers (default: as many
+ * as were recorded, up to the number of CPUs), which keep the recorded
+ * timing scaled by -x, or run flat out with -m.  Calls on an attached
+ * handle, or on a handle opened before recording started, are skipped.
+ *
+ * creating and deleting the files themselves isn't recorded, so a trace
+ * that does either replays against different state; error_mismatches
+ * counts the calls whose errno differs from the recorded one.
+ */
+
+#include "finder_info.h"
+#include "resource_fork.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sysexits.h>
+#include <sys/stat.h>
+
+namespace {
+
+	typedef afp::trace trace;
+
+	struct options {
+		std::string dir;
+		unsigned threads = 0;
+		bool max_speed = false;
+		double speed = 1.0;
+		std::string output;
+	};
+
+	/* a record plus the file it refers to, resolved through its handle */
+	struct event {
+		trace::record r;
+		uint64_t file = 0;
+	};
+
+	struct file_state {
+		size_t fork_size = 0;
+		bool mutated = false;
+		bool finder_info = false;
+		bool finder_info_written = false;
+	};
+
+	struct op_result {
+		std::vector<uint64_t> replayed;
+		std::vector<uint64_t> recorded;
+		uint64_t errors = 0;
+		uint64_t mismatches = 0;
+	};
+
+	struct worker_result {
+		op_result ops[trace::operation_count];
+		uint64_t skipped = 0;
+	};
+
+	bool is_resource_fork_member(unsigned op) {
+		switch (op) {
+			case trace::resource_fork_open:
+			case trace::resource_fork_attach:
+			case trace::resource_fork_close:
+			case trace::resource_fork_read:
+			case trace::resource_fork_write:
+			case trace::resource_fork_truncate:
+			case trace::resource_fork_seek:
+			case trace::resource_fork_size:
+			case trace::resource_fork_view:
+			case trace::resource_fork_flush:
+			case trace::resource_fork_invalidate:
+			case trace::resource_fork_set_write_back:
+			case trace::resource_fork_set_chunked:
+				return true;
+			default:
+				return false;
+		}
+	}
+
+	bool is_finder_info_member(unsigned op) {
+		return op >= trace::finder_info_open && op <= trace::finder_info_read_fast;
+	}
+
+	std::string file_name(const options &opts, uint64_t hash) {
+		char buffer[20];
+		snprintf(buffer, sizeof(buffer), "/%016llx", (unsigned long long)hash);
+		return opts.dir + buffer;
+	}
+
+	bool load(const std::string &path, std::vector<event> &events, std::error_code &ec) {
+		trace::reader reader;
+		if (!reader.open(path, ec)) return false;
+
+		event e;
+		while (reader.next(e.r, ec)) {
+			if (e.r.op == trace::none || e.r.op >= trace::operation_count) continue;
+			events.push_back(e);
+		}
+		if (ec) return false;
+
+		// records are written as calls finish; replay them in the order they started.
+		std::stable_sort(events.begin(), events.end(), [](const event &a, const event &b){
+			return a.r.start_ns < b.r.start_ns;
+		});
+
+		// member calls only carry the handle; follow it back to the open.
+		std::unordered_map<uint64_t, uint64_t> handles;
+		for (auto &e : events) {
+			const trace::record &r = e.r;
+			bool member = is_resource_fork_member(r.op) || is_finder_info_member(r.op);
+			if (!member || r.path_hash) {
+				e.file = r.path_hash;
+				if (r.op == trace::resource_fork_open || r.op == trace::finder_info_open)
+					handles[r.handle] = r.path_hash;
+				continue;
+			}
+			if (r.op == trace::resource_fork_attach || r.op == trace::finder_info_attach) {
+				handles[r.handle] = 0;
+				continue;
+			}
+			auto iter = handles.find(r.handle);
+			if (iter != handles.end()) e.file = iter->second;
+			if (r.op == trace::resource_fork_close || r.op == trace::finder_info_close)
+				handles.erase(r.handle);
+		}
+		return true;
+	}
+
+	/*
+	 * the initial state of each file, from what successful calls returned
+	 * before the first one that changed it.
+	 */
+	std::map<uint64_t, file_state> initial_state(const std::vector<event> &events) {
+		std::map<uint64_t, file_state> files;
+		for (const auto &e : events) {
+			const trace::record &r = e.r;
+			if (!e.file) continue;
+			file_state &fs = files[e.file];
+			switch (r.op) {
+				case trace::resource_fork_read:
+					if (!fs.mutated && !r.error && r.result)
+						fs.fork_size = std::max<size_t>(fs.fork_size, r.offset + r.result);
+					break;
+				case trace::resource_fork_size:
+				case trace::resource_fork_view:
+				case trace::resource_fork_size_path:
+				case trace::resource_fork_size_fast:
+				case trace::resource_fork_read_fast:
+					if (!fs.mutated && !r.error)
+						fs.fork_size = std::max<size_t>(fs.fork_size, r.result);
+					break;
+				case trace::resource_fork_write:
+				case trace::resource_fork_truncate:
+				case trace::resource_fork_remove:
+				case trace::resource_fork_write_path:
+					fs.mutated = true;
+					break;
+				case trace::finder_info_open:
+				case trace::finder_info_read_fast:
+					if (!fs.finder_info_written && !r.error) fs.finder_info = true;
+					break;
+				case trace::finder_info_write:
+				case trace::finder_info_write_path:
+					fs.finder_info_written = true;
+					break;
+			}
+		}
+		return files;
+	}
+
+	bool prepare(const options &opts, const std::map<uint64_t, file_state> &files, std::error_code &ec) {
+		typedef afp::resource_fork rf_t;
+
+		std::vector<uint8_t> data;
+		for (const auto &kv : files) {
+			std::string path = file_name(opts, kv.first);
+			int fd = ::open(path.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0666);
+			if (fd < 0) {
+				ec = std::error_code(errno, std::system_category());
+				return false;
+			}
+			::close(fd);
+
+			const file_state &fs = kv.second;
+			if (fs.fork_size) {
+				data.resize(fs.fork_size);
+				for (size_t i = 0; i < data.size(); ++i) data[i] = i * 7;
+				rf_t rf;
+				if (!rf.open(path, rf_t::read_write, ec)) return false;
+				// past a single attribute value (64K on Linux).
+				if (fs.fork_size > 60 * 1024) rf.set_chunked(true);
+				rf.write(data.data(), data.size(), ec);
+				if (ec) return false;
+				rf.close();
+			}
+			if (fs.finder_info) {
+				afp::finder_info fi;
+				fi.set_file_type(0x54455854); // 'TEXT'
+				fi.set_creator_type(0x74747874); // 'ttxt'
+				if (!fi.write(path, ec)) return false;
+			}
+		}
+		return true;
+	}
+
+	uint64_t now_ns() {
+		using namespace std::chrono;
+		return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+	}
+
+	class worker {
+	public:
+		worker(const options &opts, worker_result &result) : _opts(opts), _result(result) {}
+
+		void run(const std::vector<const event *> &events, uint64_t base) {
+			for (const event *e : events) {
+				if (!_opts.max_speed) {
+					uint64_t when = base + (uint64_t)(e->r.start_ns / _opts.speed);
+					uint64_t now = now_ns();
+					if (when > now) std::this_thread::sleep_for(std::chrono::nanoseconds(when - now));
+				}
+
+				std::error_code ec;
+				uint64_t t = now_ns();
+				bool ok = execute(*e, ec);
+				t = now_ns() - t;
+				if (!ok) {
+					++_result.skipped;
+					continue;
+				}
+
+				op_result &o = _result.ops[e->r.op];
+				o.replayed.push_back(t);
+				o.recorded.push_back(e->r.duration_ns);
+				if (ec) ++o.errors;
+				if (ec.value() != e->r.error) ++o.mismatches;
+			}
+		}
+
+	private:
+		typedef afp::resource_fork rf_t;
+		typedef afp::finder_info fi_t;
+
+		const options &_opts;
+		worker_result &_result;
+
+		// keyed by the recorded handle.
+		std::unordered_map<uint64_t, std::unique_ptr<rf_t>> _forks;
+		std::unordered_map<uint64_t, std::unique_ptr<fi_t>> _finder_infos;
+		std::vector<uint8_t> _buffer;
+		std::vector<uint8_t> _data;
+
+		rf_t *fork(const event &e) {
+			auto iter = _forks.find(e.r.handle);
+			return iter == _forks.end() ? nullptr : iter->second.get();
+		}
+
+		fi_t *finder_info(const event &e) {
+			auto iter = _finder_infos.find(e.r.handle);
+			return iter == _finder_infos.end() ? nullptr : iter->second.get();
+		}
+
+		uint8_t *buffer(size_t n) {
+			if (_buffer.size() < n) _buffer.resize(n);
+			return _buffer.data();
+		}
+
+		const uint8_t *data(size_t n) {
+			while (_data.size() < n) _data.push_back(_data.size() * 13);
+			return _data.data();
+		}
+
+		/* false if the call can't be replayed */
+		bool execute(const event &e, std::error_code &ec) {
+			const trace::record &r = e.r;
+			if (!e.file) return false;
+
+			std::string path = file_name(_opts, e.file);
+
+			if (r.op == trace::resource_fork_open) {
+				auto &p = _forks[r.handle];
+				if (!p) p.reset(new rf_t);
+				return p->open(path, (rf_t::open_mode)r.mode, ec), true;
+			}
+			if (r.op == trace::finder_info_open) {
+				auto &p = _finder_infos[r.handle];
+				if (!p) p.reset(new fi_t);
+				return p->open(path, (fi_t::open_mode)r.mode, ec), true;
+			}
+
+			if (is_resource_fork_member(r.op)) {
+				rf_t *rf = fork(e);
+				if (!rf) return false;
+
+				switch (r.op) {
+					case trace::resource_fork_close:
+						rf->close();
+						_forks.erase(r.handle);
+						break;
+					case trace::resource_fork_read: rf->read(buffer(r.size), r.size, ec); break;
+					case trace::resource_fork_write: rf->write(data(r.size), r.size, ec); break;
+					case trace::resource_fork_truncate: rf->truncate(r.size, ec); break;
+					case trace::resource_fork_seek: rf->seek(r.size, ec); break;
+					case trace::resource_fork_size: rf->size(ec); break;
+					case trace::resource_fork_view: rf->view(ec); break;
+					case trace::resource_fork_flush: rf->flush(ec); break;
+					case trace::resource_fork_invalidate: rf->invalidate(); break;
+					case trace::resource_fork_set_write_back: rf->set_write_back(r.mode, r.size); break;
+					case trace::resource_fork_set_chunked: rf->set_chunked(r.mode, r.size); break;
+					default: return false;
+				}
+				return true;
+			}
+
+			switch (r.op) {
+				case trace::resource_fork_remove: rf_t::remove(path, ec); return true;
+				case trace::resource_fork_write_path: rf_t::write(path, data(r.size), r.size, ec); return true;
+				case trace::resource_fork_size_path: rf_t::size(path, ec); return true;
+				case trace::resource_fork_size_fast: rf_t::size_fast(path, ec); return true;
+				case trace::resource_fork_read_fast: {
+					std::vector<uint8_t> v;
+					rf_t::read_fast(path, v, ec);
+					return true;
+				}
+			}
+
+			if (r.op == trace::finder_info_write_path || r.op == trace::finder_info_read_fast) {
+				// a handle used only for path calls.
+				auto &p = _finder_infos[r.handle];
+				if (!p) p.reset(new fi_t);
+				if (r.op == trace::finder_info_write_path) p->write(path, ec);
+				else p->read_fast(path, ec);
+				return true;
+			}
+
+			fi_t *fi = finder_info(e);
+			if (!fi) return false;
+			switch (r.op) {
+				case trace::finder_info_close:
+					fi->close();
+					_finder_infos.erase(r.handle);
+					break;
+				case trace::finder_info_write: fi->write(ec); break;
+				default: return false;
+			}
+			return true;
+		}
+	};
+
+	std::string json_string(const std::string &s) {
+		std::string rv = "\"";
+		for (char c : s) {
+			if (c == '"' || c == '\\') rv.push_back('\\');
+			if ((unsigned char)c < 0x20) c = ' ';
+			rv.push_back(c);
+		}
+		rv.push_back('"');
+		return rv;
+	}
+
+	uint64_t percentile(std::vector<uint64_t> &v, unsigned pct) {
+		if (v.empty()) return 0;
+		std::sort(v.begin(), v.end());
+		return v[(v.size() - 1) * pct / 100];
+	}
+
+	void usage(int rv) {
+		fputs("afp_replay [-d dir] [-j threads] [-m] [-x speed] [-o file] trace\n", stderr);
+		exit(rv);
+	}
+
+	std::string default_dir() {
+		struct stat st;
+		if (::stat("/dev/shm", &st) == 0 && S_ISDIR(st.st_mode)) return "/dev/shm";
+		const char *cp = getenv("TMPDIR");
+		return cp && *cp ? cp : "/tmp";
+	}
+
+	void cleanup(const options &opts, const std::map<uint64_t, file_state> &files) {
+		for (const auto &kv : files) ::unlink(file_name(opts, kv.first).c_str());
+		::rmdir(opts.dir.c_str());
+	}
+
+}
+
+int main(int argc, char **argv) {
+	options opts;
+	int c;
+	while ((c = getopt(argc, argv, "d:j:mx:o:h")) != -1) {
+		switch (c) {
+			case 'd': opts.dir = optarg; break;
+			case 'j': opts.threads = std::strtoul(optarg, nullptr, 10); if (!opts.threads) usage(EX_USAGE); break;
+			case 'm': opts.max_speed = true; break;
+			case 'x': opts.speed = std::strtod(optarg, nullptr); if (!(opts.speed > 0)) usage(EX_USAGE); break;
+			case 'o': opts.output = optarg; break;
+			case 'h': usage(0); break;
+			default: usage(EX_USAGE);
+		}
+	}
+	if (optind + 1 != argc) usage(EX_USAGE);
+	std::string trace_path = argv[optind];
+
+	std::error_code ec;
+	std::vector<event> events;
+	if (!load(trace_path, events, ec)) {
+		fprintf(stderr, "afp_replay: %s: %s\n", trace_path.c_str(), ec.message().c_str());
+		return 1;
+	}
+
+	std::set<unsigned> recorded_threads;
+	for (const auto &e : events) recorded_threads.insert(e.r.thread);
+	if (!opts.threads) {
+		size_t cpus = std::max(1u, std::thread::hardware_concurrency());
+		opts.threads = std::max<size_t>(1, std::min(recorded_threads.size(), cpus));
+	}
+
+	std::string base = opts.dir.empty() ? default_dir() : opts.dir;
+	std::string tmpl = base + "/afp_replay.XXXXXX";
+	std::vector<char> tmp(tmpl.begin(), tmpl.end());
+	tmp.push_back(0);
+	if (!mkdtemp(tmp.data())) {
+		fprintf(stderr, "afp_replay: %s: %s\n", base.c_str(), strerror(errno));
+		return 1;
+	}
+	opts.dir = tmp.data();
+
+	auto files = initial_state(events);
+	if (!prepare(opts, files, ec)) {
+		fprintf(stderr, "afp_replay: %s: %s\n", opts.dir.c_str(), ec.message().c_str());
+		cleanup(opts, files);
+		return 1;
+	}
+
+	FILE *fp = stdout;
+	if (!opts.output.empty()) {
+		fp = fopen(opts.output.c_str(), "w");
+		if (!fp) {
+			fprintf(stderr, "afp_replay: %s: %s\n", opts.output.c_str(), strerror(errno));
+			cleanup(opts, files);
+			return 1;
+		}
+	}
+
+	// a recorded thread's calls stay in order on one worker.
+	std::vector<std::vector<const event *>> queues(opts.threads);
+	for (const auto &e : events) queues[e.r.thread % opts.threads].push_back(&e);
+
+	std::vector<worker_result> results(opts.threads);
+	std::vector<std::thread> tv;
+	uint64_t start = now_ns();
+	for (unsigned i = 0; i < opts.threads; ++i) {
+		tv.emplace_back([&, i]{
+			worker w(opts, results[i]);
+			w.run(queues[i], start);
+		});
+	}
+	for (auto &t : tv) t.join();
+	double seconds = (now_ns() - start) / 1e9;
+
+	cleanup(opts, files);
+
+	uint64_t replayed = 0, skipped = 0, errors = 0, mismatches = 0;
+	op_result totals[trace::operation_count];
+	for (auto &wr : results) {
+		skipped += wr.skipped;
+		for (unsigned op = 0; op < trace::operation_count; ++op) {
+			op_result &src = wr.ops[op];
+			op_result &dst = totals[op];
+			dst.replayed.insert(dst.replayed.end(), src.replayed.begin(), src.replayed.end());
+			dst.recorded.insert(dst.recorded.end(), src.recorded.begin(), src.recorded.end());
+			dst.errors += src.errors;
+			dst.mismatches += src.mismatches;
+		}
+	}
+
+	std::vector<unsigned> ops;
+	for (unsigned op = 0; op < trace::operation_count; ++op) {
+		op_result &o = totals[op];
+		if (o.replayed.empty()) continue;
+		ops.push_back(op);
+		replayed += o.replayed.size();
+		errors += o.errors;
+		mismatches += o.mismatches;
+	}
+
+	fprintf(fp, "{\n  \"trace\": %s,\n  \"directory\": %s,\n  \"threads\": %u,\n",
+		json_string(trace_path).c_str(), json_string(base).c_str(), opts.threads);
+	if (opts.max_speed) fprintf(fp, "  \"speed\": null,\n");
+	else fprintf(fp, "  \"speed\": %g,\n", opts.speed);
+	fprintf(fp, "  \"records\": %zu,\n  \"replayed\": %llu,\n  \"skipped\": %llu,\n",
+		events.size(), (unsigned long long)replayed, (unsigned long long)skipped);
+	fprintf(fp, "  \"errors\": %llu,\n  \"error_mismatches\": %llu,\n",
+		(unsigned long long)errors, (unsigned long long)mismatches);
+	fprintf(fp, "  \"seconds\": %.6f,\n  \"ops_per_sec\": %.1f,\n  \"operations\": [\n",
+		seconds, seconds > 0 ? replayed / seconds : 0);
+	for (size_t i = 0; i < ops.size(); ++i) {
+		op_result &o = totals[ops[i]];
+		fprintf(fp, "    {\"name\": %s, \"count\": %zu, \"errors\": %llu, \"error_mismatches\": %llu, ",
+			json_string(trace::name((trace::operation)ops[i])).c_str(), o.replayed.size(),
+			(unsigned long long)o.errors, (unsigned long long)o.mismatches);
+		fprintf(fp, "\"p50_ns\": %llu, \"p99_ns\": %llu, ",
+			(unsigned long long)percentile(o.replayed, 50), (unsigned long long)percentile(o.replayed, 99));
+		fprintf(fp, "\"recorded_p50_ns\": %llu, \"recorded_p99_ns\": %llu}%s\n",
+			(unsigned long long)percentile(o.recorded, 50), (unsigned long long)percentile(o.recorded, 99),
+			i + 1 == ops.size() ? "" : ",");
+	}
+	fprintf(fp, "  ]\n}\n");
+	if (fp != stdout) fclose(fp);
+	return 0;
+}
@@ -0,0 +1,105 @@
+/*
+ * counts the system calls made through libc, by interposing the wrappers
+ * the library uses.  afp is linked statically into afp_bench, so its calls
+ * bind to these definitions, which count and forward to the real ones.
+ *
+ * only the prototypes we forward are needed; the libc headers aren't
+ * included since their declarations would conflict.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#if defined(__linux__) && defined(__GLIBC__)
+
+#include <dlfcn.h>
+
+struct stat;
+
+_Thread_local unsigned long afp_bench_syscalls = 0;
+
+int afp_bench_count_syscalls(void) { return 1; }
+
+#define FORWARD(rtype, name, params, args) \
+	rtype name params { \
+		static rtype (*fn) params = 0; \
+		if (!fn) fn = (rtype (*) params)dlsym(RTLD_NEXT, #name); \
+		++afp_bench_syscalls; \
+		return fn args; \
+	}
+
+FORWARD(int, close, (int fd), (fd))
+FORWARD(ssize_t, read, (int fd, void *buffer, size_t n), (fd, buffer, n))
+FORWARD(ssize_t, write, (int fd, const void *buffer, size_t n), (fd, buffer, n))
+FORWARD(ssize_t, pread, (int fd, void *buffer, size_t n, off_t offset), (fd, buffer, n, offset))
+FORWARD(ssize_t, pwrite, (int fd, const void *buffer, size_t n, off_t offset), (fd, buffer, n, offset))
+FORWARD(int, ftruncate, (int fd, off_t length), (fd, length))
+
+FORWARD(int, stat, (const char *path, struct stat *st), (path, st))
+FORWARD(int, lstat, (const char *path, struct stat *st), (path, st))
+FORWARD(int, fstat, (int fd, struct stat *st), (fd, st))
+FORWARD(int, fstatat, (int dirfd, const char *path, struct stat *st, int flags), (dirfd, path, st, flags))
+
+FORWARD(void *, mmap, (void *addr, size_t n, int prot, int flags, int fd, off_t offset), (addr, n, prot, flags, fd, offset))
+FORWARD(int, munmap, (void *addr, size_t n), (addr, n))
+
+FORWARD(ssize_t, getxattr, (const char *path, const char *name, void *value, size_t n), (path, name, value, n))
+FORWARD(ssize_t, fgetxattr, (int fd, const char *name, void *value, size_t n), (fd, name, value, n))
+FORWARD(int, fsetxattr, (int fd, const char *name, const void *value, size_t n, int flags), (fd, name, value, n, flags))
+FORWARD(int, fremovexattr, (int fd, const char *name), (fd, name))
+FORWARD(ssize_t, flistxattr, (int fd, char *list, size_t n), (fd, list, n))
+
+/* mode is only passed with O_CREAT / O_TMPFILE, but reading it is harmless. */
+int open(const char *path, int flags, ...) {
+	static int (*fn)(const char *, int, ...) = 0;
+	va_list ap;
+	unsigned mode;
+
+	if (!fn) fn = (int (*)(const char *, int, ...))dlsym(RTLD_NEXT, "open");
+	va_start(ap, flags);
+	mode = va_arg(ap, unsigned);
+	va_end(ap);
+	++afp_bench_syscalls;
+	return fn(path, flags, mode);
+}
+
+int openat(int dirfd, const char *path, int flags, ...) {
+	static int (*fn)(int, const char *, int, ...) = 0;
+	va_list ap;
+	unsigned mode;
+
+	if (!fn) fn = (int (*)(int, const char *, int, ...))dlsym(RTLD_NEXT, "openat");
+	va_start(ap, flags);
+	mode = va_arg(ap, unsigned);
+	va_end(ap);
+	++afp_bench_syscalls;
+	return fn(dirfd, path, flags, mode);
+}
+
+/* io_uring setup / enter */
+long syscall(long number, ...) {
+	static long (*fn)(long, ...) = 0;
+	va_list ap;
+	long a[6];
+	int i;
+
+	if (!fn) fn = (long (*)(long, ...))dlsym(RTLD_NEXT, "syscall");
+	va_start(ap, number);
+	for (i = 0; i < 6; ++i) a[i] = va_arg(ap, long);
+	va_end(ap);
+	++afp_bench_syscalls;
+	return fn(number, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+#else
+
+_Thread_local unsigned long afp_bench_syscalls = 0;
+
+int afp_bench_count_syscalls(void) { return 0; }
+
+#endif
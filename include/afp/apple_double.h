@@ -0,0 +1,112 @@
+#ifndef __afp_apple_double_h__
+#define __afp_apple_double_h__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <system_error>
+
+#include "directory.h"
+
+namespace afp {
+
+	/*
+	 * AppleDouble sidecar (._name) storage, for volumes without extended
+	 * attributes (NFS, exFAT, tmpfs...).
+	 *
+	 * The header and entry descriptors are parsed from an mmap of the sidecar.
+	 * Resource fork reads and writes are preads / pwrites at the entry offset;
+	 * the fork is kept as the last entry so growing it never rewrites the file.
+	 */
+	class apple_double {
+
+	public:
+		enum open_mode {
+			read_only = 1,
+			write_only = 2,
+			read_write = 3,
+		};
+
+		enum entry_id {
+			data_fork_id = 1,
+			resource_fork_id = 2,
+			real_name_id = 3,
+			comment_id = 4,
+			finder_info_id = 9,
+		};
+
+		apple_double() = default;
+		apple_double(const apple_double &) = delete;
+		apple_double(apple_double &&rhs);
+
+		apple_double& operator=(const apple_double &) = delete;
+		apple_double& operator=(apple_double &&rhs);
+
+		~apple_double() { close(); }
+
+		/* dir/name -> dir/._name */
+		static std::string sidecar_path(const std::string &path);
+
+		/*
+		 * path is the file itself, not the sidecar.  A missing sidecar is
+		 * ENODATA when read_only; otherwise it's created.
+		 */
+		bool open(const std::string &path, open_mode mode, std::error_code &ec);
+		bool open(const std::string &path, std::error_code &ec) {
+			return open(path, read_only, ec);
+		}
+
+		bool open(const directory &dir, const std::string &name, open_mode mode, std::error_code &ec);
+		bool open(const directory &dir, const std::string &name, std::error_code &ec) {
+			return open(dir, name, read_only, ec);
+		}
+
+		void close();
+
+		bool is_open() const { return _fd >= 0; }
+
+		/* 32 bytes.  ENODATA if there is no finder info entry. */
+		bool read_finder_info(uint8_t *buffer, std::error_code &ec) const;
+		bool write_finder_info(const uint8_t *buffer, std::error_code &ec);
+
+		bool has_resource_fork() const { return find(resource_fork_id) != nullptr; }
+		size_t resource_fork_size() const;
+
+		size_t read_resource_fork(size_t offset, void *buffer, size_t n, std::error_code &ec) const;
+		size_t write_resource_fork(size_t offset, const void *buffer, size_t n, std::error_code &ec);
+		size_t append_resource_fork(const void *buffer, size_t n, std::error_code &ec) {
+			return write_resource_fork(resource_fork_size(), buffer, n, ec);
+		}
+		bool truncate_resource_fork(size_t size, std::error_code &ec);
+
+	private:
+		struct entry {
+			uint32_t id = 0;
+			uint32_t offset = 0;
+			uint32_t length = 0;
+		};
+
+		int _fd = -1;
+		open_mode _mode = read_only;
+		uint64_t _file_size = 0;
+
+		void *_map = nullptr;
+		size_t _map_size = 0;
+
+		std::vector<entry> _entries;
+
+		bool open_at(int dirfd, const std::string &path, open_mode mode, std::error_code &ec);
+		bool parse(std::error_code &ec);
+		bool create(std::error_code &ec);
+
+		const entry *find(uint32_t id) const;
+		entry *find(uint32_t id);
+
+		bool write_header(std::error_code &ec);
+		bool add_entry(uint32_t id, uint32_t length, std::error_code &ec);
+		bool move_to_end(entry &e, std::error_code &ec);
+	};
+
+}
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef __afp_apple_single_h__
+#define __afp_apple_single_h__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <system_error>
+
+#include "resource_fork.h"
+
+namespace afp {
+
+	/*
+	 * streaming AppleSingle / AppleDouble codec.
+	 *
+	 * the encoder produces the stream for a file (data fork, finder info and
+	 * resource fork) and the decoder writes a stream back to a file, a chunk
+	 * at a time.  Neither holds a whole fork; forks are read and written in
+	 * whatever size chunks the caller uses.
+	 *
+	 * AppleDouble streams have no data fork entry.
+	 */
+	class apple_single {
+
+	public:
+		enum format {
+			apple_single_format = 0x00051600,
+			apple_double_format = 0x00051607,
+		};
+
+		class encoder {
+		public:
+			encoder() = default;
+			encoder(const encoder &) = delete;
+			encoder& operator=(const encoder &) = delete;
+
+			~encoder() { close(); }
+
+			bool open(const std::string &path, format f, std::error_code &ec);
+			void close();
+
+			/* total length of the stream */
+			uint64_t size() const { return _size; }
+
+			/* the next part of the stream; 0 at the end. */
+			size_t read(void *buffer, size_t n, std::error_code &ec);
+
+		private:
+			std::vector<uint8_t> _header; // header, entry descriptors, name and finder info
+			resource_fork _resource_fork;
+			uint32_t _resource_fork_size = 0;
+			int _fd = -1;
+			uint32_t _data_size = 0;
+
+			uint64_t _offset = 0;
+			uint64_t _size = 0;
+		};
+
+		class decoder {
+		public:
+			decoder() = default;
+			decoder(const decoder &) = delete;
+			decoder& operator=(const decoder &) = delete;
+
+			~decoder() { close(); }
+
+			/*
+			 * an AppleSingle stream replaces the file's data fork; an
+			 * AppleDouble stream leaves it alone.  Either is accepted.
+			 */
+			bool open(const std::string &path, std::error_code &ec);
+
+			/* without finish(), a buffered resource fork is discarded rather than written. */
+			void close();
+
+			/* consume the next part of the stream.  Trailing data is ignored. */
+			size_t write(const void *buffer, size_t n, std::error_code &ec);
+
+			/* check the stream was complete and write the finder info. */
+			bool finish(std::error_code &ec);
+
+			/* the real name entry, if there was one */
+			const std::string &real_name() const { return _real_name; }
+
+		private:
+			struct entry {
+				uint32_t id = 0;
+				uint32_t offset = 0;
+				uint32_t length = 0;
+			};
+
+			std::string _path;
+			std::vector<uint8_t> _header;
+			std::vector<entry> _entries;
+			size_t _index = 0;
+			uint64_t _offset = 0;
+			bool _parsed = false;
+
+			int _fd = -1;
+			resource_fork _resource_fork;
+			bool _has_resource_fork = false;
+
+			uint8_t _finder_info[32] = {};
+			bool _has_finder_info = false;
+			std::string _real_name;
+
+			bool parse(std::error_code &ec);
+			bool consume(const entry &e, uint32_t pos, const uint8_t *cp, size_t n, std::error_code &ec);
+		};
+	};
+
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef __afp_async_reader_h__
+#define __afp_async_reader_h__
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <system_error>
+
+#include "batch.h"
+
+namespace afp {
+
+	struct async_options {
+		unsigned threads = 0; // 0 = one per hardware thread.
+		size_t max_in_flight = 256; // queued + running requests; more are refused.
+		std::chrono::milliseconds timeout{0}; // per request, from submission; 0 = none.
+	};
+
+	/*
+	 * finder info / resource fork reads on a fixed pool of threads, for
+	 * callers (event loops) that mustn't block on filesystem latency.
+	 *
+	 * submitting never blocks: past max_in_flight a request is refused with
+	 * EAGAIN.  The result goes to the callback, always on one of the
+	 * reader's threads, or to the future (invalid if the request was
+	 * refused).  A request still pending when its timeout expires completes
+	 * with ETIMEDOUT, delivered by a thread that never waits on the
+	 * filesystem, so it arrives even when every worker is stuck; one that's
+	 * already in a system call keeps its worker (and its in-flight slot)
+	 * until the call returns, and that late result is discarded.
+	 *
+	 * the destructor completes queued requests with ECANCELED (on that same
+	 * thread) and waits for running ones, so it mustn't be called from a
+	 * callback.
+	 */
+	class async_reader {
+
+	public:
+		typedef std::function<void(finder_info_result &&)> finder_info_callback;
+		typedef std::function<void(resource_fork_result &&)> resource_fork_callback;
+
+		explicit async_reader(const async_options &options = async_options());
+		async_reader(const async_reader &) = delete;
+		async_reader& operator=(const async_reader &) = delete;
+
+		~async_reader();
+
+		bool read_finder_info(const std::string &path, finder_info_callback fn, std::error_code &ec);
+		bool resource_fork_size(const std::string &path, resource_fork_callback fn, std::error_code &ec);
+		bool read_resource_fork(const std::string &path, resource_fork_callback fn, std::error_code &ec);
+
+		std::future<finder_info_result> read_finder_info(const std::string &path, std::error_code &ec);
+		std::future<resource_fork_result> resource_fork_size(const std::string &path, std::error_code &ec);
+		std::future<resource_fork_result> read_resource_fork(const std::string &path, std::error_code &ec);
+
+		size_t in_flight() const;
+
+	private:
+		class state;
+		std::unique_ptr<state> _state;
+	};
+
+}
+
+#endif
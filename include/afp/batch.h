@@ -0,0 +1,36 @@
+#ifndef __afp_batch_h__
+#define __afp_batch_h__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <system_error>
+
+#include "finder_info.h"
+
+namespace afp {
+
+	struct finder_info_result {
+		finder_info info;
+		std::error_code error;
+	};
+
+	struct resource_fork_result {
+		size_t size = 0;
+		std::vector<uint8_t> data; // only filled in by read_resource_fork_batch.
+		std::error_code error;
+	};
+
+	/*
+	 * bulk metadata lookups.  results[i] corresponds to paths[i], with the same
+	 * errors the single-file calls report.  On Linux with io_uring xattr support
+	 * (5.19+) the open, xattr and close calls for many files are submitted
+	 * together; otherwise each file is handled by finder_info / resource_fork.
+	 */
+	void read_finder_info_batch(const std::vector<std::string> &paths, std::vector<finder_info_result> &results);
+	void resource_fork_size_batch(const std::vector<std::string> &paths, std::vector<resource_fork_result> &results);
+	void read_resource_fork_batch(const std::vector<std::string> &paths, std::vector<resource_fork_result> &results);
+
+}
+
+#endif
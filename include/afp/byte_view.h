@@ -0,0 +1,40 @@
+#ifndef __afp_byte_view_h__
+#define __afp_byte_view_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace afp {
+
+	/* non-owning, read-only view of a range of bytes. */
+	class byte_view {
+
+	public:
+		byte_view() = default;
+		byte_view(const void *data, size_t size) :
+			_data(static_cast<const uint8_t *>(data)), _size(size)
+		{}
+
+		const uint8_t *data() const { return _data; }
+		size_t size() const { return _size; }
+		bool empty() const { return _size == 0; }
+
+		const uint8_t *begin() const { return _data; }
+		const uint8_t *end() const { return _data + _size; }
+
+		uint8_t operator[](size_t i) const { return _data[i]; }
+
+		byte_view substr(size_t pos, size_t n = (size_t)-1) const {
+			if (pos > _size) pos = _size;
+			if (n > _size - pos) n = _size - pos;
+			return byte_view(_data + pos, n);
+		}
+
+	private:
+		const uint8_t *_data = nullptr;
+		size_t _size = 0;
+	};
+
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef __afp_directory_h__
+#define __afp_directory_h__
+
+#include <string>
+#include <system_error>
+
+namespace afp {
+
+	/*
+	 * an open directory, for the finder_info / resource_fork overloads that take
+	 * a name relative to it (openat and friends), so the leading components of
+	 * the path are only resolved once.
+	 */
+	class directory {
+
+	public:
+		directory() = default;
+		directory(const directory &) = delete;
+		directory(directory &&rhs);
+
+		directory& operator=(const directory &) = delete;
+		directory& operator=(directory &&rhs);
+
+		~directory() { close(); }
+
+		bool open(const std::string &path, std::error_code &ec);
+		bool open(const directory &parent, const std::string &name, std::error_code &ec);
+
+		void close();
+
+		bool is_open() const { return _fd >= 0; }
+		int fd() const { return _fd; }
+
+	private:
+		int _fd = -1;
+	};
+
+}
+
+#endif
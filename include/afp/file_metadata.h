@@ -0,0 +1,89 @@
+#ifndef __afp_file_metadata_h__
+#define __afp_file_metadata_h__
+
+#include <string>
+#include <system_error>
+
+#include "directory.h"
+#include "finder_info.h"
+#include "resource_fork.h"
+
+namespace afp {
+
+	/*
+	 * the finder info and resource fork of one file, sharing a single
+	 * descriptor.  The file is opened (and checked) once; both views are
+	 * attached to it on first use.
+	 */
+	class file_metadata {
+
+	public:
+		enum open_mode {
+			read_only = 1,
+			write_only = 2,
+			read_write = 3,
+		};
+
+		file_metadata() = default;
+		file_metadata(const file_metadata &) = delete;
+		file_metadata(file_metadata &&rhs);
+
+		file_metadata& operator=(const file_metadata &) = delete;
+		file_metadata& operator=(file_metadata &&rhs);
+
+		~file_metadata() { close(); }
+
+		bool open(const std::string &path, open_mode mode, std::error_code &ec);
+		bool open(const std::string &path, std::error_code &ec) {
+			return open(path, read_only, ec);
+		}
+
+		bool open(const directory &dir, const std::string &name, open_mode mode, std::error_code &ec);
+		bool open(const directory &dir, const std::string &name, std::error_code &ec) {
+			return open(dir, name, read_only, ec);
+		}
+
+		void close();
+
+		bool is_open() const { return _fd >= 0; }
+		int fd() const { return _fd; }
+
+		/*
+		 * list the attributes once, then load the ones that exist.  Missing
+		 * attributes are not looked up again.  (Solaris has no attribute
+		 * list, so both are loaded.)
+		 */
+		bool prefetch(std::error_code &ec);
+
+		/* true unless prefetch() found the attribute missing (a chunked fork's index counts) */
+		bool has_finder_info() const { return !(_absent & absent_finder_info); }
+		bool has_resource_fork() const { return !(_absent & absent_resource_fork); }
+
+		/* ENODATA if there is no finder info (read_only mode). */
+		afp::finder_info &finder_info(std::error_code &ec);
+		afp::resource_fork &resource_fork(std::error_code &ec);
+
+	private:
+		enum {
+			absent_finder_info = 1,
+			absent_resource_fork = 2,
+		};
+
+		int _fd = -1;
+		open_mode _mode = read_only;
+		unsigned _absent = 0;
+
+		bool _finder_info_attached = false;
+		bool _resource_fork_attached = false;
+		std::error_code _resource_fork_error;
+		std::error_code _finder_info_error;
+
+		afp::finder_info _finder_info;
+		afp::resource_fork _resource_fork;
+
+		bool open_at(int dirfd, const std::string &path, open_mode mode, std::error_code &ec);
+	};
+
+}
+
+#endif
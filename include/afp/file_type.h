@@ -0,0 +1,194 @@
+#ifndef __afp_file_type_h__
+#define __afp_file_type_h__
+
+#include <stdint.h>
+
+namespace afp {
+
+	/*
+	 * ProDOS file type / aux type <-> Finder file type / creator, per tech
+	 * note PT515 (plus the old MPW "xx  " encoding).  Types are the packed
+	 * big endian words, e.g. 'TEXT' is 0x54455854.
+	 *
+	 * both directions are constexpr and locale independent.  The fixed
+	 * mappings are looked up through a perfect hash of the type word (or of
+	 * file type << 16 | aux type) that is generated at compile time.
+	 */
+
+	struct prodos_file_type {
+		uint16_t file_type;
+		uint32_t aux_type;
+		bool ok; // false if there's no ProDOS equivalent
+	};
+
+	struct finder_file_type {
+		uint32_t type;
+		uint32_t creator;
+		bool ok; // false if the file type or aux type is out of range
+	};
+
+	constexpr prodos_file_type finder_info_to_filetype(uint32_t type, uint32_t creator);
+	constexpr finder_file_type file_type_to_finder_info(uint16_t file_type, uint32_t aux_type);
+
+
+	namespace file_type_detail {
+
+		enum : uint32_t {
+			pdos = 0x70646f73, // 'pdos'
+			dCpy = 0x64437079, // 'dCpy'
+		};
+
+		struct mapping {
+			uint32_t type;
+			uint32_t creator;
+			bool any_creator; // Finder -> ProDOS ignores the creator
+			uint16_t file_type;
+			uint16_t aux_type;
+		};
+
+		enum { mapping_count = 8, slot_count = 16 };
+
+		// a template, so the tables can be defined in a header.
+		template<class T = void>
+		struct mapping_table {
+			static constexpr mapping values[mapping_count] = {
+				{ 0x42494e41, pdos, true,  0x00, 0x0000 }, // BINA
+				{ 0x54455854, pdos, true,  0x04, 0x0000 }, // TEXT
+				{ 0x50535953, pdos, false, 0xff, 0x0000 }, // PSYS
+				{ 0x50533136, pdos, false, 0xb3, 0x0000 }, // PS16
+				{ 0x4d494449, pdos, true,  0xd7, 0x0000 }, // MIDI
+				{ 0x41494646, pdos, true,  0xd8, 0x0000 }, // AIFF
+				{ 0x41494643, pdos, true,  0xd8, 0x0001 }, // AIFC
+				{ 0x64496d67, dCpy, false, 0xe0, 0x0005 }, // dImg
+			};
+		};
+
+		template<class T>
+		constexpr mapping mapping_table<T>::values[mapping_count];
+
+		constexpr const mapping &mapping_at(unsigned i) {
+			return mapping_table<>::values[i];
+		}
+
+		constexpr uint32_t key(bool prodos, unsigned i) {
+			return prodos
+				? (uint32_t)mapping_at(i).file_type << 16 | mapping_at(i).aux_type
+				: mapping_at(i).type;
+		}
+
+		constexpr unsigned hash(uint32_t key, uint32_t multiplier) {
+			return (uint32_t)(key * multiplier) >> 28;
+		}
+
+		constexpr bool perfect(bool prodos, uint32_t multiplier, unsigned i = 0, unsigned j = 1) {
+			return i + 1 >= mapping_count ? true
+				: j >= mapping_count ? perfect(prodos, multiplier, i + 1, i + 2)
+				: hash(key(prodos, i), multiplier) != hash(key(prodos, j), multiplier)
+					&& perfect(prodos, multiplier, i, j + 1);
+		}
+
+		/* the first odd multiplier from 2^32 / phi that hashes every key to its own slot, or 0 */
+		constexpr uint32_t find_multiplier(bool prodos, uint32_t multiplier = 0x9e3779b1, unsigned tries = 64) {
+			return !tries ? 0
+				: perfect(prodos, multiplier) ? multiplier
+				: find_multiplier(prodos, multiplier + 2, tries - 1);
+		}
+
+		constexpr int find_slot(bool prodos, uint32_t multiplier, unsigned slot, unsigned i = 0) {
+			return i >= mapping_count ? -1
+				: hash(key(prodos, i), multiplier) == slot ? (int)i
+				: find_slot(prodos, multiplier, slot, i + 1);
+		}
+
+		/* slot -> mapping index, -1 if empty */
+		template<class T = void>
+		struct slot_table {
+			static constexpr uint32_t finder_multiplier = find_multiplier(false);
+			static constexpr uint32_t prodos_multiplier = find_multiplier(true);
+			static_assert(finder_multiplier && prodos_multiplier, "no perfect hash for the file type table");
+
+			#define AFP_SLOTS(p, m) { \
+				find_slot(p, m, 0), find_slot(p, m, 1), find_slot(p, m, 2), find_slot(p, m, 3), \
+				find_slot(p, m, 4), find_slot(p, m, 5), find_slot(p, m, 6), find_slot(p, m, 7), \
+				find_slot(p, m, 8), find_slot(p, m, 9), find_slot(p, m, 10), find_slot(p, m, 11), \
+				find_slot(p, m, 12), find_slot(p, m, 13), find_slot(p, m, 14), find_slot(p, m, 15) }
+
+			static constexpr int8_t finder[slot_count] = AFP_SLOTS(false, finder_multiplier);
+			static constexpr int8_t prodos[slot_count] = AFP_SLOTS(true, prodos_multiplier);
+
+			#undef AFP_SLOTS
+		};
+
+		template<class T>
+		constexpr uint32_t slot_table<T>::finder_multiplier;
+		template<class T>
+		constexpr uint32_t slot_table<T>::prodos_multiplier;
+		template<class T>
+		constexpr int8_t slot_table<T>::finder[slot_count];
+		template<class T>
+		constexpr int8_t slot_table<T>::prodos[slot_count];
+
+		constexpr int finder_index(uint32_t type) {
+			return slot_table<>::finder[hash(type, slot_table<>::finder_multiplier)];
+		}
+
+		constexpr int prodos_index(uint32_t key) {
+			return slot_table<>::prodos[hash(key, slot_table<>::prodos_multiplier)];
+		}
+
+		constexpr bool finder_match(int ix, uint32_t type, uint32_t creator) {
+			return ix >= 0 && mapping_at(ix).type == type
+				&& (mapping_at(ix).any_creator || mapping_at(ix).creator == creator);
+		}
+
+		constexpr bool prodos_match(int ix, uint32_t k) {
+			return ix >= 0 && key(true, ix) == k;
+		}
+
+		constexpr bool is_hex(uint32_t c) {
+			return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+		}
+
+		constexpr uint32_t hex(uint32_t c) {
+			return c >= '0' && c <= '9' ? c - '0'
+				: c >= 'a' && c <= 'f' ? c + 10 - 'a'
+				: c >= 'A' && c <= 'F' ? c + 10 - 'A'
+				: 0;
+		}
+
+		/* old mpw method for encoding: "%02x  " (but only when the first digit isn't one) */
+		constexpr bool mpw(uint32_t type) {
+			return !is_hex(type >> 24) && is_hex((type >> 16) & 0xff) && (type & 0xffff) == 0x2020;
+		}
+
+		constexpr prodos_file_type prodos(const mapping &m) {
+			return prodos_file_type{ m.file_type, m.aux_type, true };
+		}
+	}
+
+
+	constexpr prodos_file_type finder_info_to_filetype(uint32_t type, uint32_t creator) {
+		using namespace file_type_detail;
+		return creator == pdos && (type >> 24) == 'p'
+				? prodos_file_type{ (uint16_t)((type >> 16) & 0xff), type & 0xffff, true }
+			: finder_match(finder_index(type), type, creator)
+				? prodos(mapping_at(finder_index(type)))
+			: creator == pdos && mpw(type)
+				? prodos_file_type{ (uint16_t)(hex(type >> 24) << 8 | hex((type >> 16) & 0xff)), 0, true }
+			: prodos_file_type{ 0, 0, false };
+	}
+
+	constexpr finder_file_type file_type_to_finder_info(uint16_t file_type, uint32_t aux_type) {
+		using namespace file_type_detail;
+		return file_type > 0xff || aux_type > 0xffff
+				? finder_file_type{ 0, 0, false }
+			: prodos_match(prodos_index((uint32_t)file_type << 16 | aux_type), (uint32_t)file_type << 16 | aux_type)
+				? finder_file_type{
+					mapping_at(prodos_index((uint32_t)file_type << 16 | aux_type)).type,
+					mapping_at(prodos_index((uint32_t)file_type << 16 | aux_type)).creator, true }
+			: finder_file_type{ 0x70000000 | (uint32_t)file_type << 16 | aux_type, pdos, true }; // 'p' $uv $wx $yz
+	}
+
+}
+
+#endif
@@ -10,6 +10,12 @@
 #define AFP_WIN32
 #endif
 
+#if !defined(AFP_WIN32)
+#include "directory.h"
+#endif
+
+#include "finder_info_data.h"
+
 #if defined(AFP_WIN32)
 #pragma pack(push, 2)
 struct AFP_Info {
@@ -53,12 +59,40 @@ namespace afp {
 
 		bool write(const std::string &path, std::error_code &ec);
 
+		/*
+		 * read-only lookup with a single path based getxattr (no open / fstat / close).
+		 * stat is only called on failure, to report directories and special files.
+		 */
+		bool read_fast(const std::string &path, std::error_code &ec);
+
 		bool open(const std::string &path, open_mode perm, std::error_code &ec);
 		bool open(const std::string &path, std::error_code &ec) {
 			return open(path, read_only, ec);
 		}
 
 
+	#if !defined(AFP_WIN32)
+		bool read(const directory &dir, const std::string &name, std::error_code &ec) {
+			return open(dir, name, read_only, ec);
+		}
+
+		bool write(const directory &dir, const std::string &name, std::error_code &ec);
+
+		bool open(const directory &dir, const std::string &name, open_mode perm, std::error_code &ec);
+		bool open(const directory &dir, const std::string &name, std::error_code &ec) {
+			return open(dir, name, read_only, ec);
+		}
+
+		enum attach_flags {
+			borrow = 0, // the caller keeps ownership of the descriptor.
+			adopt = 1, // close() closes the descriptor, even if attach fails.
+			trusted = 2, // the caller vouches for a regular file; skip the fstat check.
+		};
+
+		/* use an already open descriptor for the file (e.g. its data fork) */
+		bool attach(int fd, open_mode perm, unsigned flags, std::error_code &ec);
+	#endif
+
 	#if defined(AFP_WIN32)
 		bool read(const std::wstring &path, std::error_code &ec) {
 			return open(path, read_only, ec);
@@ -93,21 +127,34 @@ namespace afp {
 		}
 #else
 		const uint8_t *data() const {
-			return _finder_info;
+			return _data.finder_info;
 		}
 		uint8_t *data() {
-			return _finder_info;
+			return _data.finder_info;
 		}
 		uint16_t prodos_file_type() const {
-			return _prodos_file_type;
+			return _data.prodos_file_type;
 		}
 		uint32_t prodos_aux_type() const {
-			return _prodos_aux_type;
+			return _data.prodos_aux_type;
+		}
+#endif
+
+		/* the finder info and ProDOS types as a plain value (a copy on Windows). */
+#if defined(AFP_WIN32)
+		finder_info_data value() const;
+#else
+		const finder_info_data &value() const {
+			return _data;
 		}
 #endif
+		void assign(const finder_info_data &data);
 
 		void set_data(const uint8_t *data, unsigned length=32);
 
+		/* replace the finder info and derive the ProDOS file and aux type from it. */
+		void assign(const uint8_t *data, unsigned length=32);
+
 		void set_prodos_file_type(uint16_t);
 		void set_prodos_file_type(uint16_t, uint32_t);
 
@@ -123,16 +170,19 @@ namespace afp {
 
 	private:
 
+		#if !defined(AFP_WIN32)
+		bool open_at(int dirfd, const std::string &path, open_mode perm, std::error_code &ec);
+		bool open_fd(int fd, bool owned, open_mode perm, std::error_code &ec);
+		bool write_at(int dirfd, const std::string &path, std::error_code &ec);
+		#endif
 
 		#if defined(AFP_WIN32)
 		void *_fd = (void *)-1;
 		AFP_Info _afp;
 		#else
 		int _fd = -1;
-
-		uint16_t _prodos_file_type = 0;
-		uint32_t _prodos_aux_type = 0;
-		uint8_t _finder_info[32] = {};
+		bool _owned = true;
+		finder_info_data _data = {};
 		#endif
 	};
 
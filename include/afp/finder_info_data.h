@@ -0,0 +1,131 @@
+#ifndef __afp_finder_info_data_h__
+#define __afp_finder_info_data_h__
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <system_error>
+#include <type_traits>
+
+#include "file_type.h"
+
+/* finder_info.h includes this with AFP_WIN32 already set; leave it to undo its own. */
+#if (defined(_WIN32) || defined(__CYGWIN__) || defined(__MSYS__)) && !defined(AFP_WIN32)
+#define AFP_WIN32
+#define AFP_WIN32_FINDER_INFO_DATA
+#endif
+
+#if !defined(AFP_WIN32)
+#include "directory.h"
+#endif
+
+namespace afp {
+
+	/*
+	 * finder info as a plain value: the 32 byte payload plus the ProDOS file
+	 * and aux type, 40 bytes, the same on every platform.  It's trivially
+	 * copyable and standard layout, so it can live in large vectors, hash
+	 * maps or shared memory and be copied with memcpy.
+	 *
+	 * like any POD it's uninitialized unless value initialized:
+	 * finder_info_data d{}; (or clear()).
+	 *
+	 * the accessors match afp::finder_info, which holds one of these.
+	 */
+	struct finder_info_data {
+		uint8_t finder_info[32];
+		uint32_t prodos_aux_type;
+		uint16_t prodos_file_type;
+		uint16_t reserved;
+
+		const uint8_t *data() const { return finder_info; }
+		uint8_t *data() { return finder_info; }
+
+		uint32_t file_type() const { return read32(finder_info); }
+		uint32_t creator_type() const { return read32(finder_info + 4); }
+
+		void set_file_type(uint32_t x) { write32(finder_info, x); }
+		void set_creator_type(uint32_t x) { write32(finder_info + 4, x); }
+
+		/* also sets the Finder type and creator to match. */
+		void set_prodos_file_type(uint16_t ftype, uint32_t atype) {
+			prodos_file_type = ftype;
+			prodos_aux_type = atype;
+			auto rv = file_type_to_finder_info(ftype, atype);
+			if (!rv.ok) return;
+			write32(finder_info, rv.type);
+			write32(finder_info + 4, rv.creator);
+		}
+
+		void set_prodos_file_type(uint16_t ftype) {
+			set_prodos_file_type(ftype, prodos_aux_type);
+		}
+
+		void set_data(const uint8_t *data, unsigned length = 32) {
+			memcpy(finder_info, data, length < 32 ? length : 32);
+		}
+
+		/* replace the finder info and derive the ProDOS file and aux type from it. */
+		void assign(const uint8_t *data, unsigned length = 32) {
+			memset(finder_info, 0, sizeof(finder_info));
+			set_data(data, length);
+			auto rv = finder_info_to_filetype(file_type(), creator_type());
+			prodos_file_type = rv.ok ? rv.file_type : 0;
+			prodos_aux_type = rv.ok ? rv.aux_type : 0;
+		}
+
+		bool is_text() const {
+			return file_type() == 0x54455854 // 'TEXT'
+				|| prodos_file_type == 0x04 || prodos_file_type == 0xb0;
+		}
+
+		bool is_binary() const {
+			if (is_text()) return false;
+			if (prodos_file_type || prodos_aux_type) return true;
+			return file_type() || creator_type();
+		}
+
+		void clear() {
+			memset(this, 0, sizeof(*this));
+		}
+
+	private:
+		static uint32_t read32(const uint8_t *cp) {
+			return (uint32_t)cp[0] << 24 | cp[1] << 16 | cp[2] << 8 | cp[3];
+		}
+
+		static void write32(uint8_t *cp, uint32_t x) {
+			cp[0] = x >> 24;
+			cp[1] = x >> 16;
+			cp[2] = x >> 8;
+			cp[3] = x;
+		}
+	};
+
+	static_assert(sizeof(finder_info_data) == 40, "finder_info_data size");
+	static_assert(std::is_standard_layout<finder_info_data>::value, "finder_info_data layout");
+	static_assert(std::is_trivial<finder_info_data>::value, "finder_info_data is not trivial");
+
+	/*
+	 * read / write finder info without keeping a handle.  Reading uses a
+	 * single path based lookup where the platform has one (finder_info::read_fast).
+	 */
+	bool read_finder_info(const std::string &path, finder_info_data &data, std::error_code &ec);
+	bool write_finder_info(const std::string &path, const finder_info_data &data, std::error_code &ec);
+
+#if defined(AFP_WIN32)
+	bool read_finder_info(const std::wstring &path, finder_info_data &data, std::error_code &ec);
+	bool write_finder_info(const std::wstring &path, const finder_info_data &data, std::error_code &ec);
+#else
+	bool read_finder_info(const directory &dir, const std::string &name, finder_info_data &data, std::error_code &ec);
+	bool write_finder_info(const directory &dir, const std::string &name, const finder_info_data &data, std::error_code &ec);
+#endif
+
+}
+
+#if defined(AFP_WIN32_FINDER_INFO_DATA)
+#undef AFP_WIN32
+#undef AFP_WIN32_FINDER_INFO_DATA
+#endif
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef __afp_finder_info_table_h__
+#define __afp_finder_info_table_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace afp {
+
+	class finder_info;
+	struct finder_info_data;
+
+	/*
+	 * Finder / ProDOS types of many files, stored as columns (type words,
+	 * creator words, ProDOS file types, aux types), for classifying whole
+	 * listings in one pass.
+	 *
+	 * the batch calls match finder_info::is_text(), is_binary() etc. row for
+	 * row.  Masks are one byte per row (1 or 0) and the return value is the
+	 * number of rows set.  They run SSE2 or AVX2 kernels where the CPU has
+	 * them (picked at first use) and scalar code elsewhere.
+	 */
+	class finder_info_table {
+
+	public:
+		enum kernel {
+			automatic,
+			scalar,
+			sse2,
+			avx2,
+		};
+
+		size_t size() const { return _type.size(); }
+		bool empty() const { return _type.empty(); }
+
+		void clear();
+		void reserve(size_t n);
+
+		/* a row from a finder_info (or its value), with its ProDOS types as they are. */
+		void push_back(const finder_info &fi);
+		void push_back(const finder_info_data &data);
+
+		/* a row from 32 (at least 8) bytes of finder info; the ProDOS types are derived, like finder_info::assign(). */
+		void push_back(const uint8_t *data);
+
+		void push_back(uint32_t type, uint32_t creator, uint16_t file_type = 0, uint32_t aux_type = 0);
+
+		const uint32_t *file_types() const { return _type.data(); }
+		const uint32_t *creator_types() const { return _creator.data(); }
+		const uint16_t *prodos_file_types() const { return _file_type.data(); }
+		const uint32_t *prodos_aux_types() const { return _aux_type.data(); }
+
+		size_t text_mask(uint8_t *out) const;
+		size_t binary_mask(uint8_t *out) const;
+
+		/*
+		 * rows where (type & type_mask) == type and (creator & creator_mask) == creator,
+		 * e.g. match('TEXT', ~0, 0, 0, out) or match('p\0\0\0', 0xff000000, 'pdos', ~0, out).
+		 */
+		size_t match(uint32_t type, uint32_t type_mask, uint32_t creator, uint32_t creator_mask, uint8_t *out) const;
+
+		/* re-derive every row's ProDOS file and aux type from its Finder type and creator. */
+		void decode_prodos();
+
+		/*
+		 * the kernel in use.  set_kernel() is for testing and benchmarks; it
+		 * returns false (and changes nothing) if the CPU can't run the kernel.
+		 */
+		static kernel active_kernel();
+		static bool set_kernel(kernel k);
+
+	private:
+		std::vector<uint32_t> _type;
+		std::vector<uint32_t> _creator;
+		std::vector<uint16_t> _file_type;
+		std::vector<uint32_t> _aux_type;
+	};
+
+}
+
+#endif
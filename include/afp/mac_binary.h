@@ -0,0 +1,104 @@
+#ifndef __afp_mac_binary_h__
+#define __afp_mac_binary_h__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <system_error>
+
+#include "finder_info.h"
+#include "resource_fork.h"
+
+namespace afp {
+
+	/*
+	 * streaming MacBinary codec.
+	 *
+	 * the decoder accepts MacBinary I, II and III; the encoder writes
+	 * MacBinary III.  Forks are streamed a chunk at a time, in whatever size
+	 * chunks the caller uses.
+	 */
+	class mac_binary {
+
+	public:
+		/* CRC-16/XMODEM (polynomial 0x1021, initial value 0), as used by the header. */
+		static uint16_t crc16(const void *data, size_t n, uint16_t crc = 0);
+
+		class encoder {
+		public:
+			encoder() = default;
+			encoder(const encoder &) = delete;
+			encoder& operator=(const encoder &) = delete;
+
+			~encoder() { close(); }
+
+			bool open(const std::string &path, std::error_code &ec);
+			void close();
+
+			/* total length of the stream */
+			uint64_t size() const { return _size; }
+
+			/* the next part of the stream; 0 at the end. */
+			size_t read(void *buffer, size_t n, std::error_code &ec);
+
+		private:
+			uint8_t _header[128] = {};
+			int _fd = -1;
+			resource_fork _resource_fork;
+			uint32_t _data_size = 0;
+			uint32_t _resource_fork_size = 0;
+
+			uint64_t _offset = 0;
+			uint64_t _size = 0;
+		};
+
+		class decoder {
+		public:
+			decoder() = default;
+			decoder(const decoder &) = delete;
+			decoder& operator=(const decoder &) = delete;
+
+			~decoder() { close(); }
+
+			/* path receives the data fork, resource fork and finder info. */
+			bool open(const std::string &path, std::error_code &ec);
+
+			/* without finish(), a buffered resource fork is discarded rather than written. */
+			void close();
+
+			/* consume the next part of the stream.  The comment and any padding are ignored. */
+			size_t write(const void *buffer, size_t n, std::error_code &ec);
+
+			/* check the stream was complete and write the finder info. */
+			bool finish(std::error_code &ec);
+
+			/* valid once the header has been seen */
+			unsigned version() const { return _version; }
+			const std::string &name() const { return _name; }
+			const afp::finder_info &finder_info() const { return _finder_info; }
+
+		private:
+			std::string _path;
+			uint8_t _header[128] = {};
+			uint64_t _offset = 0;
+			unsigned _version = 0;
+			std::string _name;
+
+			uint64_t _data_start = 0;
+			uint64_t _data_end = 0;
+			uint64_t _resource_fork_start = 0;
+			uint64_t _resource_fork_end = 0;
+
+			int _fd = -1;
+			resource_fork _resource_fork;
+			bool _has_resource_fork = false;
+			afp::finder_info _finder_info;
+
+			bool parse(std::error_code &ec);
+		};
+	};
+
+}
+
+#endif
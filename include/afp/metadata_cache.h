@@ -0,0 +1,74 @@
+#ifndef __afp_metadata_cache_h__
+#define __afp_metadata_cache_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "finder_info_data.h"
+
+namespace afp {
+
+	/*
+	 * optional process wide cache of finder info and resource fork sizes,
+	 * keyed by (st_dev, st_ino) and validated by the ctime and size from the
+	 * fstat that opening a file does anyway.  Missing attributes are cached
+	 * too, so a hit doesn't touch the extended attributes at all.
+	 *
+	 * read-only finder_info::open() / read() and resource_fork::size() use it
+	 * when it's enabled.  Only the extended attribute backends do (setting an
+	 * attribute updates the file's ctime there), and the read_fast() path
+	 * lookups don't stat, so they bypass it.
+	 *
+	 * entries are spread over shard_count shards, each with its own lock and
+	 * LRU list; max_entries is split evenly between them.
+	 */
+	class metadata_cache {
+
+	public:
+		enum {
+			default_max_entries = 64 * 1024,
+			shard_count = 16,
+		};
+
+		struct statistics {
+			uint64_t hits = 0;
+			uint64_t misses = 0;
+			uint64_t stale = 0; // misses where the file's ctime or size had changed
+			uint64_t evictions = 0;
+			size_t entries = 0;
+		};
+
+		/* enable (or resize) the cache.  disable() also drops every entry. */
+		static void enable(size_t max_entries = default_max_entries);
+		static void disable();
+		static bool enabled();
+		static size_t max_entries();
+
+		static void clear();
+		static statistics stats();
+
+		/*
+		 * for callers with their own stat (e.g. from a directory scan).
+		 *
+		 * find_*() returns true on a hit; present is false for a cached
+		 * "no attribute".  After a miss, store the result only if settled()
+		 * returned true before the attribute was read: a change in the same
+		 * timestamp tick as the stat could otherwise leave the ctime as is.
+		 */
+		static bool find_finder_info(const struct stat &st, finder_info_data &data, bool &present);
+		static bool find_fork_size(const struct stat &st, uint64_t &size, bool &present);
+
+		static bool settled(const struct stat &st);
+
+		static void store_finder_info(const struct stat &st, const finder_info_data &data);
+		static void store_no_finder_info(const struct stat &st);
+		static void store_fork_size(const struct stat &st, uint64_t size);
+		static void store_no_fork(const struct stat &st);
+
+		static void invalidate(const struct stat &st);
+	};
+
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef __afp_metadata_watcher_h__
+#define __afp_metadata_watcher_h__
+
+#include <functional>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include "scan_tree.h"
+
+namespace afp {
+
+	struct metadata_event {
+		enum kind_type {
+			changed, // entry is the file as scan_file() reports it now
+			removed, // deleted or moved out of the tree; a directory is reported once, for its own path
+			overflow, // the kernel dropped notifications; rescan (entry.path is the root)
+		};
+
+		kind_type kind = changed;
+		scan_entry entry;
+	};
+
+	/*
+	 * watches a tree for finder info / resource fork changes (inotify
+	 * IN_ATTRIB, which setting an extended attribute raises) and for files
+	 * created, deleted or renamed, re-reading only the files that changed.
+	 * Directories created or moved into the tree are watched as they
+	 * appear, and the files already in them are reported.
+	 *
+	 * fd() is non-blocking and becomes readable when notifications are
+	 * pending, so it can go into an event loop's poll / epoll set.  read()
+	 * drains them: every notification for a file since the last read()
+	 * collapses into one event.  A directory that can't be watched is
+	 * reported as a changed entry with its error set, as scan_tree does
+	 * (those found by open() come with the first read()).
+	 *
+	 * Linux only; open() fails with ENOSYS elsewhere.
+	 */
+	class metadata_watcher {
+
+	public:
+		typedef std::function<void(const metadata_event &)> callback;
+
+		metadata_watcher() = default;
+		metadata_watcher(const metadata_watcher &) = delete;
+		metadata_watcher(metadata_watcher &&rhs);
+
+		metadata_watcher& operator=(const metadata_watcher &) = delete;
+		metadata_watcher& operator=(metadata_watcher &&rhs);
+
+		~metadata_watcher() { close(); }
+
+		bool open(const std::string &path, std::error_code &ec);
+		void close();
+
+		bool is_open() const { return _fd >= 0; }
+		int fd() const { return _fd; }
+
+		/* pending events, sorted by path; never blocks. */
+		std::vector<metadata_event> read(std::error_code &ec);
+
+		/* the same, delivered to fn; returns the number of events. */
+		size_t read(const callback &fn, std::error_code &ec);
+
+		/* wait up to timeout_ms (-1 = forever) for fd() to become readable. */
+		bool wait(int timeout_ms, std::error_code &ec);
+
+		size_t watch_count() const { return _watches.size(); }
+
+	private:
+		int _fd = -1;
+		std::string _root;
+		bool _root_file = false;
+		std::unordered_map<int, std::string> _watches; // watch descriptor -> directory
+		std::vector<metadata_event> _pending; // directories open() couldn't watch
+	};
+
+}
+
+#endif
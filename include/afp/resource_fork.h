@@ -3,11 +3,19 @@
 
 #include <string>
 #include <system_error>
+#include <vector>
+#include <cstdint>
+
+#include "byte_view.h"
 
 #if defined(_WIN32) || defined(__CYGWIN__) || defined(__MSYS__)
 #define AFP_WIN32
 #endif
 
+#if !defined(AFP_WIN32)
+#include "directory.h"
+#endif
+
 namespace afp {
 
 	class resource_fork {
@@ -34,6 +42,21 @@ namespace afp {
 
 		static size_t write(const std::string &path, const void *buffer, size_t n, std::error_code &ec);
 
+		/*
+		 * read-only lookups with path based getxattr calls (no open / fstat / close)
+		 * where the fork is an extended attribute.  stat is only called on failure,
+		 * to report directories and special files.
+		 */
+		static size_t size_fast(const std::string &path, std::error_code &ec);
+		static size_t read_fast(const std::string &path, std::vector<uint8_t> &buffer, std::error_code &ec);
+
+#ifndef AFP_WIN32
+		static size_t size(const directory &dir, const std::string &name, std::error_code &ec);
+		static bool remove(const directory &dir, const std::string &name, std::error_code &ec);
+
+		static size_t write(const directory &dir, const std::string &name, const void *buffer, size_t n, std::error_code &ec);
+#endif
+
 #ifdef AFP_WIN32
 		static size_t size(const std::wstring &path, std::error_code &ec);
 		static bool remove(const std::wstring &path, std::error_code &ec);
@@ -49,6 +72,22 @@ namespace afp {
 			return open(s, read_only, ec);
 		}
 
+#ifndef AFP_WIN32
+		bool open(const directory &dir, const std::string &name, open_mode mode, std::error_code &ec);
+		bool open(const directory &dir, const std::string &name, std::error_code &ec) {
+			return open(dir, name, read_only, ec);
+		}
+
+		enum attach_flags {
+			borrow = 0, // the caller keeps ownership of the descriptor.
+			adopt = 1, // close() closes the descriptor, even if attach fails.
+			trusted = 2, // the caller vouches for a regular file; skip the fstat check.
+		};
+
+		/* open the fork of an already open file (e.g. its data fork) */
+		bool attach(int fd, open_mode mode, unsigned flags, std::error_code &ec);
+#endif
+
 #ifdef AFP_WIN32
 		bool open(const std::wstring &s, open_mode mode, std::error_code &ec);
 		bool open(const std::wstring &s, std::error_code &ec) {
@@ -56,7 +95,13 @@ namespace afp {
 		}
 #endif
 
+		/*
+		 * close() commits pending write-back data but can't report a failure;
+		 * close(ec) does, and leaves the handle open (the data still pending)
+		 * if the commit fails, so the caller may retry or close() to discard.
+		 */
 		void close();
+		bool close(std::error_code &ec);
 
 		size_t read(void *buffer, size_t n, std::error_code &);
 		size_t write(const void *buffer, size_t n, std::error_code &);
@@ -64,18 +109,92 @@ namespace afp {
 		bool seek(size_t pos, std::error_code &ec);
 		size_t size(std::error_code &ec);
 
+		/*
+		 * read-only view of the entire fork, without copying.  The view is
+		 * only valid until the next call on the handle: any of them (read,
+		 * size and view included) may reload or remap the fork when the
+		 * file has changed.  Copy what must outlive that.
+		 */
+		byte_view view(std::error_code &ec);
+
+		/* discard any cached copy of the fork; the next access re-reads it. */
+		void invalidate();
+
+		/*
+		 * write-back mode: writes are collected in memory and committed by
+		 * flush(), close(), or once dirty_limit bytes are pending (0 = no limit).
+		 * If that commit fails, write() or truncate() reports the error but the
+		 * data stays buffered (a write's offset moves past it) for a later
+		 * flush().  Without write-back, a failed write() leaves the offset alone.
+		 * only the xattr backend buffers; elsewhere writes go straight to the fork.
+		 */
+		void set_write_back(bool enable, size_t dirty_limit = 0);
+		bool flush(std::error_code &ec);
+
+		/*
+		 * chunked layout: forks written through this handle are stored as
+		 * numbered attributes of chunk_size bytes (0 = 3.5K) plus a small index,
+		 * so a fork isn't limited to one attribute value and a write only
+		 * rewrites the chunks it touches.  Single attribute forks are converted
+		 * on the first write.  Either layout can always be read.
+		 * this lifts the per value limit, not the per file one: ext4 without
+		 * ea_inode keeps all of a file's attributes in one block (~4K), tmpfs
+		 * and xfs allow much more.
+		 * only the xattr backend has a layout; elsewhere this does nothing.
+		 */
+		void set_chunked(bool enable, size_t chunk_size = 0);
+
 
 	private:
 		#ifdef AFP_WIN32
 		void *_fd = (void *)-1;
 		#else
 		int _fd = -1;
+
+		bool open_at(int dirfd, const std::string &path, open_mode mode, std::error_code &ec);
+		bool open_fd(int fd, bool owned, open_mode mode, std::error_code &ec);
+		static bool remove_at(int dirfd, const std::string &path, std::error_code &ec);
+		static size_t write_at(int dirfd, const std::string &path, const void *buffer, size_t n, std::error_code &ec);
 		#endif
 
 		#if defined(__linux__) || defined(__FreeBSD__) || defined(_AIX)
+		bool _owned = true; // false if attached to a borrowed descriptor.
 		size_t _offset = 0;
 		open_mode _mode = read_only;
+
+		/* the fork is loaded once and re-used until the file's ctime changes */
+		uint64_t _ctime = 0;
+		bool _cached = false;
+		bool _absent = false;
+
+		bool _write_back = false;
+		size_t _dirty = 0;
+		size_t _dirty_limit = 0;
+
+		/* chunked layout of the current fork (0 = single attribute), and for new writes */
+		uint32_t _chunk_size = 0;
+		uint64_t _chunk_total = 0;
+		uint32_t _new_chunk_size = 0;
+		std::vector<uint8_t> _chunk;
+
+		bool load(std::error_code &ec);
+		void store();
+
+		static size_t size_cached(int dirfd, const std::string &path, std::error_code &ec);
+
+		bool convert(std::error_code &ec);
+		bool write_index(std::error_code &ec);
+		size_t read_chunked(uint64_t pos, void *buffer, size_t n, std::error_code &ec);
+		size_t write_chunked(const void *buffer, size_t n, std::error_code &ec);
+		bool truncate_chunked(size_t pos, std::error_code &ec);
+		#else
+		void *_map = nullptr;
+		size_t _map_size = 0;
+
+		void unmap();
 		#endif
+
+		std::vector<uint8_t> _buffer;
 	};
 
 }
@@ -0,0 +1,65 @@
+#ifndef __afp_resource_fork_builder_h__
+#define __afp_resource_fork_builder_h__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <system_error>
+
+#if defined(_WIN32) || defined(__CYGWIN__) || defined(__MSYS__)
+#define AFP_WIN32
+#endif
+
+namespace afp {
+
+	/*
+	 * collects resources and lays out a complete Resource Manager fork
+	 * (header, data, map, type/reference/name lists) in one allocation.
+	 *
+	 * resource data isn't copied until build(), straight into the output,
+	 * so it must stay valid (and unchanged) until then.
+	 */
+	class resource_fork_builder {
+
+	public:
+
+		void add(uint32_t type, int16_t id, const void *data, size_t size, uint8_t attributes = 0);
+		void add(uint32_t type, int16_t id, const std::string &name, const void *data, size_t size, uint8_t attributes = 0);
+
+		void set_attributes(uint16_t attributes) { _attributes = attributes; }
+
+		void clear();
+
+		bool empty() const { return _resources.empty(); }
+		size_t size() const { return _resources.size(); }
+
+		std::vector<uint8_t> build(std::error_code &ec) const;
+
+		/* build and store the fork with a single resource_fork::write */
+		size_t write(const std::string &path, std::error_code &ec) const;
+#ifdef AFP_WIN32
+		size_t write(const std::wstring &path, std::error_code &ec) const;
+#endif
+
+	private:
+		struct resource {
+			uint32_t type;
+			int16_t id;
+			uint8_t attributes;
+			uint16_t name; // offset into _names, 0xffff if unnamed.
+			uint32_t offset; // offset into the data area.
+			const uint8_t *data; // the caller's.
+			size_t size;
+		};
+
+		std::vector<resource> _resources;
+		uint64_t _data_size = 0; // data area, with length prefixes.
+		std::vector<uint8_t> _names; // name list (pascal strings).
+		uint16_t _attributes = 0;
+		bool _overflow = false;
+	};
+
+}
+#undef AFP_WIN32
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef __afp_resource_map_h__
+#define __afp_resource_map_h__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <system_error>
+
+#include "byte_view.h"
+
+namespace afp {
+
+	class resource_fork;
+
+	/*
+	 * index over a classic Resource Manager fork.
+	 *
+	 * only the header and the map are parsed; resource data is not touched
+	 * until data() is called.  The map refers to the underlying bytes, so it
+	 * is valid as long as the byte view (or the resource_fork's view) is.
+	 */
+	class resource_map {
+
+	public:
+
+		struct entry {
+			uint32_t type = 0;
+			int16_t id = 0;
+			uint8_t attributes = 0;
+			uint16_t name = 0xffff; // offset into the name list, 0xffff if unnamed.
+			uint32_t offset = 0; // offset of the data length within the fork.
+		};
+
+		resource_map() = default;
+
+		bool read(resource_fork &rf, std::error_code &ec);
+		bool read(byte_view data, std::error_code &ec);
+
+		void clear();
+
+		bool empty() const { return _entries.empty(); }
+		size_t size() const { return _entries.size(); }
+
+		/* sorted by type, then id */
+		const std::vector<entry> &entries() const { return _entries; }
+
+		std::vector<uint32_t> types() const;
+		size_t count(uint32_t type) const;
+
+		const entry *find(uint32_t type, int16_t id) const;
+		const entry *find(uint32_t type, const std::string &name) const;
+
+		std::string name(const entry &e) const;
+		byte_view data(const entry &e, std::error_code &ec) const;
+
+		uint16_t attributes() const { return _attributes; }
+
+	private:
+		byte_view _fork;
+		byte_view _names;
+		uint16_t _attributes = 0;
+
+		std::vector<entry> _entries;
+		std::vector<uint32_t> _by_name; // indices into _entries, sorted by type, then name.
+
+		byte_view name_view(const entry &e) const;
+	};
+
+}
+
+#endif
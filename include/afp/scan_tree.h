@@ -0,0 +1,46 @@
+#ifndef __afp_scan_tree_h__
+#define __afp_scan_tree_h__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <system_error>
+
+namespace afp {
+
+	struct scan_entry {
+		std::string path;
+
+		uint32_t file_type = 0;
+		uint32_t creator_type = 0;
+		uint16_t prodos_file_type = 0;
+		uint32_t prodos_aux_type = 0;
+
+		size_t resource_fork_size = 0;
+
+		/* missing metadata is not an error; anything else (including an unreadable directory) is. */
+		std::error_code error;
+	};
+
+	struct scan_options {
+		unsigned threads = 0; // 0 = one per hardware thread.
+		bool follow_symlinks = false;
+	};
+
+	/*
+	 * walks the tree rooted at path and returns the finder info and resource fork
+	 * size of every regular file, sorted by path.  Directories are enumerated and
+	 * files inspected on a work-stealing pool.
+	 */
+	std::vector<scan_entry> scan_tree(const std::string &path, const scan_options &options, std::error_code &ec);
+
+	inline std::vector<scan_entry> scan_tree(const std::string &path, std::error_code &ec) {
+		return scan_tree(path, scan_options(), ec);
+	}
+
+	/* the entry scan_tree would report for a single file. */
+	scan_entry scan_file(const std::string &path);
+
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef __afp_stats_h__
+#define __afp_stats_h__
+
+#include <stdint.h>
+
+namespace afp {
+
+	/*
+	 * process wide operation counters and latency histograms.
+	 *
+	 * each thread records into its own block, so recording is a clock read and
+	 * a few uncontended stores; collect() sums the blocks (and those of exited
+	 * threads).  Recording is on by default and cheap enough to leave on.
+	 */
+	class stats {
+
+	public:
+		enum operation {
+			open, // opening a file (or named fork) for finder info / resource fork access
+			read_xattr,
+			write_xattr,
+			size_xattr,
+			remove_xattr,
+			operation_count
+		};
+
+		/* bucket i counts latencies in [2^i, 2^(i+1)) ns; the last bucket is open ended. */
+		enum { histogram_buckets = 32 };
+
+		struct operation_stats {
+			uint64_t count = 0;
+			uint64_t errors = 0;
+			uint64_t total_ns = 0;
+			uint64_t histogram[histogram_buckets] = {};
+		};
+
+		struct snapshot {
+			operation_stats operations[operation_count];
+
+			uint64_t erange_retries = 0; // a resource fork grew (or the speculative buffer was short) between size and read
+			uint64_t bytes_read = 0; // extended attribute bytes read
+			uint64_t bytes_written = 0; // extended attribute bytes written
+			uint64_t bytes_copied = 0; // bytes copied from a cached resource fork to the caller
+
+			const operation_stats &operator[](operation op) const { return operations[op]; }
+		};
+
+		static const char *name(operation op);
+
+		static void set_enabled(bool enable);
+		static bool enabled();
+
+		/* totals since start up, or since the last reset() */
+		static snapshot collect();
+		static void reset();
+
+		/* latency at or below which the given fraction (0 - 1) of operations fall, estimated from the histogram */
+		static uint64_t percentile(const operation_stats &s, double fraction);
+	};
+
+}
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef __afp_trace_h__
+#define __afp_trace_h__
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <system_error>
+
+namespace afp {
+
+	/*
+	 * operation trace recorder.
+	 *
+	 * while recording, every public finder_info / resource_fork call (calls
+	 * made from inside another call aren't) is appended to a binary trace
+	 * file: the operation, a hash of the path, the handle, sizes, offsets,
+	 * the result, errno and timing.  Paths themselves are not recorded.
+	 *
+	 * recording is started by start(), or by setting AFP_TRACE=<file> in the
+	 * environment.  afp_replay replays a trace against a scratch directory.
+	 *
+	 * file format: "AFPTRACE", version (32-bit), record size (32-bit), then
+	 * fixed size records; all little endian.
+	 */
+	class trace {
+
+	public:
+		enum operation {
+			none = 0,
+
+			finder_info_open,
+			finder_info_attach,
+			finder_info_close,
+			finder_info_write,
+			finder_info_write_path,
+			finder_info_read_fast,
+
+			resource_fork_open,
+			resource_fork_attach,
+			resource_fork_close,
+			resource_fork_read,
+			resource_fork_write,
+			resource_fork_truncate,
+			resource_fork_seek,
+			resource_fork_size,
+			resource_fork_view,
+			resource_fork_flush,
+			resource_fork_invalidate,
+			resource_fork_set_write_back,
+			resource_fork_set_chunked,
+			resource_fork_remove,
+			resource_fork_write_path,
+			resource_fork_size_path,
+			resource_fork_size_fast,
+			resource_fork_read_fast,
+
+			operation_count
+		};
+
+		enum { version = 1, record_size = 64 };
+
+		struct record {
+			uint64_t start_ns = 0; // since recording started
+			uint32_t duration_ns = 0;
+			uint16_t thread = 0; // small per thread id, from 1
+			uint8_t op = none;
+			uint8_t mode = 0; // open mode, attach flags, or the set_* enable flag
+			int32_t error = 0; // errno, 0 for success
+			uint64_t handle = 0; // identifies the finder_info / resource_fork object
+			uint64_t path_hash = 0; // 0 for calls on an open handle
+			uint64_t offset = 0; // fork offset before the call, where the backend tracks one
+			uint64_t size = 0; // bytes requested, or the truncate / seek position, dirty limit or chunk size
+			uint64_t result = 0; // bytes transferred, fork size, or 1 / 0 for success / failure
+		};
+
+		static bool start(const std::string &path, std::error_code &ec);
+		static bool stop(std::error_code &ec);
+		static bool recording();
+
+		static const char *name(operation op);
+
+		/* 64-bit FNV-1a.  Paths relative to a directory handle are hashed as given. */
+		static uint64_t hash_path(const char *path);
+
+		class reader {
+		public:
+			reader() = default;
+			reader(const reader &) = delete;
+			reader& operator=(const reader &) = delete;
+
+			~reader() { close(); }
+
+			bool open(const std::string &path, std::error_code &ec);
+			void close();
+
+			/* false at the end of the trace (ec clear) or on error */
+			bool next(record &r, std::error_code &ec);
+
+		private:
+			FILE *_fp = nullptr;
+			unsigned _record_size = 0;
+		};
+	};
+
+}
+
+#endif
@@ -19,6 +19,13 @@ ssize_t read_xattr(int fd, const char *xattr, void *buffer, size_t size);
 ssize_t write_xattr(int fd, const char *xattr, const void *buffer, size_t size);
 int remove_xattr(int fd, const char *xattr);
 
+/* attribute names, each terminated by a NUL.  size 0 returns the size needed. */
+ssize_t list_xattr(int fd, char *buffer, size_t size);
+
+/* path based, for lookups that don't need a descriptor */
+ssize_t size_xattr_path(const char *path, const char *xattr);
+ssize_t read_xattr_path(const char *path, const char *xattr, void *buffer, size_t size);
+
 
 #ifdef __cplusplus
 }
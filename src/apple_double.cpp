@@ -0,0 +1,473 @@
+#include "apple_double.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+
+	/*
+	 * AppleSingle/AppleDouble Formats for Foreign Files Developer's Note (1990)
+	 *
+	 * header (26 bytes):
+	 *   +0   magic number (0x00051607 for AppleDouble)
+	 *   +4   version (0x00020000)
+	 *   +8   16 bytes filler
+	 *   +24  number of entries
+	 *
+	 * entry descriptors, 12 bytes each:
+	 *   entry id, offset (from the start of the file), length
+	 */
+
+	enum {
+		apple_double_magic = 0x00051607,
+		version_1 = 0x00010000,
+		version_2 = 0x00020000,
+
+		header_size = 26,
+		descriptor_size = 12,
+
+		copy_size = 64 * 1024,
+	};
+
+	template<class T>
+	T _(T x, std::error_code &ec) {
+		if (x < 0) ec = std::error_code(errno, std::system_category());
+		return x;
+	}
+
+	uint16_t read16(const uint8_t *cp) {
+		return (cp[0] << 8) | cp[1];
+	}
+
+	uint32_t read32(const uint8_t *cp) {
+		return ((uint32_t)cp[0] << 24) | (cp[1] << 16) | (cp[2] << 8) | cp[3];
+	}
+
+	uint8_t *write16(uint8_t *cp, uint16_t x) {
+		cp[0] = x >> 8;
+		cp[1] = x;
+		return cp + 2;
+	}
+
+	uint8_t *write32(uint8_t *cp, uint32_t x) {
+		cp[0] = x >> 24;
+		cp[1] = x >> 16;
+		cp[2] = x >> 8;
+		cp[3] = x;
+		return cp + 4;
+	}
+
+	bool pwrite_all(int fd, const void *buffer, size_t n, off_t offset, std::error_code &ec) {
+		const uint8_t *cp = (const uint8_t *)buffer;
+		while (n) {
+			auto rv = _(::pwrite(fd, cp, n, offset), ec);
+			if (rv < 0) {
+				if (errno == EINTR) { ec.clear(); continue; }
+				return false;
+			}
+			cp += rv;
+			n -= rv;
+			offset += rv;
+		}
+		return true;
+	}
+
+	std::error_code bad_descriptor() {
+		return std::make_error_code(std::errc::bad_file_descriptor);
+	}
+
+}
+
+namespace afp {
+
+	apple_double::apple_double(apple_double &&rhs) {
+		std::swap(_fd, rhs._fd);
+		std::swap(_mode, rhs._mode);
+		std::swap(_file_size, rhs._file_size);
+		std::swap(_map, rhs._map);
+		std::swap(_map_size, rhs._map_size);
+		std::swap(_entries, rhs._entries);
+	}
+
+	apple_double& apple_double::operator=(apple_double &&rhs) {
+		if (this != &rhs) {
+			close();
+			std::swap(_fd, rhs._fd);
+			std::swap(_mode, rhs._mode);
+			std::swap(_file_size, rhs._file_size);
+			std::swap(_map, rhs._map);
+			std::swap(_map_size, rhs._map_size);
+			std::swap(_entries, rhs._entries);
+		}
+		return *this;
+	}
+
+	void apple_double::close() {
+		if (_map) ::munmap(_map, _map_size);
+		_map = nullptr;
+		_map_size = 0;
+
+		if (_fd >= 0) ::close(_fd);
+		_fd = -1;
+		_mode = read_only;
+		_file_size = 0;
+		_entries.clear();
+	}
+
+	std::string apple_double::sidecar_path(const std::string &path) {
+		auto pos = path.rfind('/');
+		if (pos == path.npos) return "._" + path;
+		std::string rv(path, 0, pos + 1);
+		rv += "._";
+		rv.append(path, pos + 1, path.npos);
+		return rv;
+	}
+
+	bool apple_double::open(const std::string &path, open_mode mode, std::error_code &ec) {
+		return open_at(AT_FDCWD, path, mode, ec);
+	}
+
+	bool apple_double::open(const directory &dir, const std::string &name, open_mode mode, std::error_code &ec) {
+		return open_at(dir.fd(), name, mode, ec);
+	}
+
+	bool apple_double::open_at(int dirfd, const std::string &path, open_mode mode, std::error_code &ec) {
+		ec.clear();
+		close();
+
+		// the file itself must exist (and be a regular file), as with the xattr backends.
+		struct stat st;
+		if (_(::fstatat(dirfd, path.c_str(), &st, 0), ec) < 0) return false;
+		if (!S_ISREG(st.st_mode)) {
+			if (S_ISDIR(st.st_mode)) ec = std::make_error_code(std::errc::is_a_directory);
+			else ec = std::make_error_code(std::errc::invalid_seek); // ESPIPE.
+			return false;
+		}
+
+		int umode = mode == read_only ? O_RDONLY : O_RDWR | O_CREAT;
+		_fd = _(::openat(dirfd, sidecar_path(path).c_str(), umode | O_CLOEXEC, 0666), ec);
+		if (_fd < 0) {
+			if (ec.value() == ENOENT)
+				ec = std::make_error_code(std::errc::no_message_available); // ENODATA.
+			return false;
+		}
+		_mode = mode;
+
+		if (!parse(ec)) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	bool apple_double::parse(std::error_code &ec) {
+
+		struct stat st;
+		if (_(::fstat(_fd, &st), ec) < 0) return false;
+		_file_size = st.st_size;
+
+		if (_file_size == 0) {
+			if (_mode == read_only) {
+				ec = std::make_error_code(std::errc::no_message_available);
+				return false;
+			}
+			return create(ec);
+		}
+
+		auto bad = [&ec](){
+			ec = std::make_error_code(std::errc::illegal_byte_sequence);
+			return false;
+		};
+
+		if (_file_size < header_size) return bad();
+
+		void *p = ::mmap(nullptr, _file_size, PROT_READ, MAP_SHARED, _fd, 0);
+		if (p == MAP_FAILED) {
+			ec = std::error_code(errno, std::system_category());
+			return false;
+		}
+		_map = p;
+		_map_size = _file_size;
+
+		const uint8_t *cp = (const uint8_t *)_map;
+		uint32_t magic = read32(cp);
+		uint32_t version = read32(cp + 4);
+		unsigned count = read16(cp + 24);
+
+		if (magic != apple_double_magic) return bad();
+		if (version != version_1 && version != version_2) return bad();
+		if (header_size + count * descriptor_size > _file_size) return bad();
+
+		_entries.reserve(count);
+		for (unsigned i = 0; i < count; ++i) {
+			const uint8_t *dp = cp + header_size + i * descriptor_size;
+			entry e;
+			e.id = read32(dp);
+			e.offset = read32(dp + 4);
+			e.length = read32(dp + 8);
+			if ((uint64_t)e.offset + e.length > _file_size) return bad();
+			_entries.push_back(e);
+		}
+		return true;
+	}
+
+	/* a new sidecar: finder info, then an empty resource fork at the end. */
+	bool apple_double::create(std::error_code &ec) {
+		_entries.clear();
+
+		entry fi;
+		fi.id = finder_info_id;
+		fi.offset = header_size + 2 * descriptor_size;
+		fi.length = 32;
+		_entries.push_back(fi);
+
+		entry rf;
+		rf.id = resource_fork_id;
+		rf.offset = fi.offset + fi.length;
+		rf.length = 0;
+		_entries.push_back(rf);
+
+		if (!write_header(ec)) return false;
+
+		uint8_t zero[32] = {};
+		if (!pwrite_all(_fd, zero, sizeof(zero), fi.offset, ec)) return false;
+		_file_size = rf.offset;
+		return true;
+	}
+
+	const apple_double::entry *apple_double::find(uint32_t id) const {
+		for (const auto &e : _entries)
+			if (e.id == id) return &e;
+		return nullptr;
+	}
+
+	apple_double::entry *apple_double::find(uint32_t id) {
+		for (auto &e : _entries)
+			if (e.id == id) return &e;
+		return nullptr;
+	}
+
+	bool apple_double::write_header(std::error_code &ec) {
+		std::vector<uint8_t> tmp(header_size + _entries.size() * descriptor_size);
+		uint8_t *cp = tmp.data();
+
+		cp = write32(cp, apple_double_magic);
+		cp = write32(cp, version_2);
+		cp += 16;
+		cp = write16(cp, _entries.size());
+		for (const auto &e : _entries) {
+			cp = write32(cp, e.id);
+			cp = write32(cp, e.offset);
+			cp = write32(cp, e.length);
+		}
+
+		// keep the version and filler (Mac OS X stores the originating file system there).
+		if (_map_size >= header_size)
+			std::memcpy(tmp.data() + 4, (const uint8_t *)_map + 4, 20);
+
+		return pwrite_all(_fd, tmp.data(), tmp.size(), 0, ec);
+	}
+
+	/* copy an entry's data to the end of the file, so it can grow in place. */
+	bool apple_double::move_to_end(entry &e, std::error_code &ec) {
+		uint64_t end = _file_size;
+		if (end + e.length > 0xffffffff) {
+			ec = std::make_error_code(std::errc::file_too_large);
+			return false;
+		}
+
+		std::vector<uint8_t> buffer(std::min<size_t>(e.length, copy_size));
+		for (uint32_t done = 0; done < e.length; ) {
+			size_t n = std::min<size_t>(e.length - done, buffer.size());
+			auto rv = _(::pread(_fd, buffer.data(), n, e.offset + done), ec);
+			if (rv < 0) return false;
+			if (rv == 0) {
+				ec = std::make_error_code(std::errc::illegal_byte_sequence); // sidecar was truncated.
+				return false;
+			}
+			if (!pwrite_all(_fd, buffer.data(), rv, end + done, ec)) return false;
+			done += rv;
+		}
+
+		e.offset = end;
+		_file_size = end + e.length;
+		return write_header(ec);
+	}
+
+	/* new entries go at the end; existing data is moved out of the way of the descriptor table. */
+	bool apple_double::add_entry(uint32_t id, uint32_t length, std::error_code &ec) {
+		uint64_t table_end = header_size + (_entries.size() + 1) * descriptor_size;
+		if (_file_size < table_end) _file_size = table_end;
+
+		for (auto &e : _entries) {
+			if (e.offset >= table_end) continue;
+			if (e.length == 0) e.offset = _file_size;
+			else if (!move_to_end(e, ec)) return false;
+		}
+
+		entry e;
+		e.id = id;
+		e.offset = _file_size;
+		e.length = length;
+		_entries.push_back(e);
+
+		if (length) {
+			_file_size += length;
+			if (_(::ftruncate(_fd, _file_size), ec) < 0) return false;
+		}
+		return write_header(ec);
+	}
+
+	bool apple_double::read_finder_info(uint8_t *buffer, std::error_code &ec) const {
+		ec.clear();
+		if (_fd < 0) {
+			ec = bad_descriptor();
+			return false;
+		}
+
+		const entry *e = find(finder_info_id);
+		if (!e || e->length < 32) {
+			std::memset(buffer, 0, 32);
+			ec = std::make_error_code(std::errc::no_message_available);
+			return false;
+		}
+
+		// the map may be stale past the current end of file.
+		if ((uint64_t)e->offset + 32 <= std::min<uint64_t>(_map_size, _file_size)) {
+			std::memcpy(buffer, (const uint8_t *)_map + e->offset, 32);
+			return true;
+		}
+
+		auto rv = _(::pread(_fd, buffer, 32, e->offset), ec);
+		if (rv < 0) return false;
+		if (rv < 32) std::memset(buffer + rv, 0, 32 - rv);
+		return true;
+	}
+
+	bool apple_double::write_finder_info(const uint8_t *buffer, std::error_code &ec) {
+		ec.clear();
+		if (_fd < 0 || _mode == read_only) {
+			ec = bad_descriptor();
+			return false;
+		}
+
+		entry *e = find(finder_info_id);
+		if (!e) {
+			if (!add_entry(finder_info_id, 32, ec)) return false;
+			e = find(finder_info_id);
+		}
+		else if (e->length < 32) {
+			if (!move_to_end(*e, ec)) return false;
+			e->length = 32;
+			_file_size = e->offset + 32;
+			if (_(::ftruncate(_fd, _file_size), ec) < 0) return false;
+			if (!write_header(ec)) return false;
+		}
+
+		return pwrite_all(_fd, buffer, 32, e->offset, ec);
+	}
+
+	size_t apple_double::resource_fork_size() const {
+		const entry *e = find(resource_fork_id);
+		return e ? e->length : 0;
+	}
+
+	size_t apple_double::read_resource_fork(size_t offset, void *buffer, size_t n, std::error_code &ec) const {
+		ec.clear();
+		if (_fd < 0 || _mode == write_only) {
+			ec = bad_descriptor();
+			return 0;
+		}
+
+		const entry *e = find(resource_fork_id);
+		if (!e) {
+			ec = std::make_error_code(std::errc::no_message_available);
+			return 0;
+		}
+
+		if (offset >= e->length) return 0;
+		n = std::min<size_t>(n, e->length - offset);
+
+		auto rv = _(::pread(_fd, buffer, n, e->offset + offset), ec);
+		if (rv < 0) return 0;
+		return rv;
+	}
+
+	size_t apple_double::write_resource_fork(size_t offset, const void *buffer, size_t n, std::error_code &ec) {
+		ec.clear();
+		if (_fd < 0 || _mode == read_only) {
+			ec = bad_descriptor();
+			return 0;
+		}
+
+		entry *e = find(resource_fork_id);
+		if (!e) {
+			if (!add_entry(resource_fork_id, 0, ec)) return 0;
+			e = find(resource_fork_id);
+		}
+
+		uint64_t end = (uint64_t)offset + n;
+		if (end > e->length) {
+			if ((uint64_t)e->offset + end > 0xffffffff) {
+				ec = std::make_error_code(std::errc::file_too_large);
+				return 0;
+			}
+			// only the last entry can grow without overwriting its neighbour.
+			if ((uint64_t)e->offset + e->length != _file_size && !move_to_end(*e, ec)) return 0;
+		}
+
+		if (!pwrite_all(_fd, buffer, n, e->offset + offset, ec)) return 0;
+
+		if (end > e->length) {
+			e->length = end;
+			_file_size = std::max<uint64_t>(_file_size, e->offset + end);
+
+			uint8_t tmp[4];
+			write32(tmp, e->length);
+			size_t index = e - _entries.data();
+			if (!pwrite_all(_fd, tmp, 4, header_size + index * descriptor_size + 8, ec)) return 0;
+		}
+		return n;
+	}
+
+	bool apple_double::truncate_resource_fork(size_t size, std::error_code &ec) {
+		ec.clear();
+		if (_fd < 0 || _mode == read_only) {
+			ec = bad_descriptor();
+			return false;
+		}
+
+		entry *e = find(resource_fork_id);
+		if (!e) {
+			if (!add_entry(resource_fork_id, 0, ec)) return false;
+			e = find(resource_fork_id);
+		}
+
+		if ((uint64_t)e->offset + size > 0xffffffff) {
+			ec = std::make_error_code(std::errc::file_too_large);
+			return false;
+		}
+
+		bool last = (uint64_t)e->offset + e->length == _file_size;
+		if (size > e->length && !last) {
+			if (!move_to_end(*e, ec)) return false;
+			last = true;
+		}
+
+		if (last) {
+			_file_size = e->offset + size;
+			if (_(::ftruncate(_fd, _file_size), ec) < 0) return false;
+		}
+
+		e->length = size;
+		return write_header(ec);
+	}
+
+}
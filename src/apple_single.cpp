@@ -0,0 +1,453 @@
+#include "apple_single.h"
+#include "finder_info.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifndef NAME_MAX
+#define NAME_MAX 255
+#endif
+
+namespace {
+
+	/*
+	 * AppleSingle/AppleDouble Formats for Foreign Files Developer's Note (1990)
+	 *
+	 * header (26 bytes): magic number, version, 16 bytes filler, number of entries.
+	 * entry descriptors (12 bytes): entry id, offset, length.
+	 */
+
+	enum {
+		version_1 = 0x00010000,
+		version_2 = 0x00020000,
+
+		header_size = 26,
+		descriptor_size = 12,
+
+		data_fork_id = 1,
+		resource_fork_id = 2,
+		real_name_id = 3,
+		finder_info_id = 9,
+	};
+
+	template<class T>
+	T _(T x, std::error_code &ec) {
+		if (x < 0) ec = std::error_code(errno, std::system_category());
+		return x;
+	}
+
+	uint16_t read16(const uint8_t *cp) {
+		return (cp[0] << 8) | cp[1];
+	}
+
+	uint32_t read32(const uint8_t *cp) {
+		return ((uint32_t)cp[0] << 24) | (cp[1] << 16) | (cp[2] << 8) | cp[3];
+	}
+
+	uint8_t *write16(uint8_t *cp, uint16_t x) {
+		cp[0] = x >> 8;
+		cp[1] = x;
+		return cp + 2;
+	}
+
+	uint8_t *write32(uint8_t *cp, uint32_t x) {
+		cp[0] = x >> 24;
+		cp[1] = x >> 16;
+		cp[2] = x >> 8;
+		cp[3] = x;
+		return cp + 4;
+	}
+
+	std::string basename(const std::string &path) {
+		auto pos = path.rfind('/');
+		if (pos == path.npos) return path;
+		return path.substr(pos + 1);
+	}
+
+	bool no_data(const std::error_code &ec) {
+		return ec == std::errc::no_message_available;
+	}
+
+	/* the stream is shorter than its entries, or they don't fit together */
+	std::error_code bad_stream() {
+		return std::make_error_code(std::errc::illegal_byte_sequence);
+	}
+
+}
+
+namespace afp {
+
+	/*
+	 * encoder.  Entries are laid out as real name (AppleSingle only), finder
+	 * info, resource fork, data fork (AppleSingle only).  The first two are
+	 * small and built up front; the forks are streamed.
+	 */
+
+	void apple_single::encoder::close() {
+		_resource_fork.close();
+		if (_fd >= 0) ::close(_fd);
+		_fd = -1;
+		_header.clear();
+		_resource_fork_size = 0;
+		_data_size = 0;
+		_offset = 0;
+		_size = 0;
+	}
+
+	bool apple_single::encoder::open(const std::string &path, format f, std::error_code &ec) {
+		ec.clear();
+		close();
+
+		std::string name;
+		if (f == apple_single_format) {
+			_fd = _(::open(path.c_str(), O_RDONLY | O_CLOEXEC), ec);
+			if (_fd < 0) return false;
+
+			struct stat st;
+			if (_(::fstat(_fd, &st), ec) < 0) {
+				close();
+				return false;
+			}
+			if (!S_ISREG(st.st_mode)) {
+				ec = S_ISDIR(st.st_mode) ?
+					std::make_error_code(std::errc::is_a_directory) :
+					std::make_error_code(std::errc::invalid_seek); // ESPIPE.
+				close();
+				return false;
+			}
+			if (st.st_size > 0xffffffff) {
+				ec = std::make_error_code(std::errc::file_too_large);
+				close();
+				return false;
+			}
+			_data_size = st.st_size;
+			name = basename(path);
+		}
+
+		finder_info fi;
+		if (!fi.read(path, ec) && !no_data(ec)) {
+			close();
+			return false;
+		}
+
+		bool has_resource_fork = false;
+		if (_resource_fork.open(path, resource_fork::read_only, ec)) {
+			size_t n = _resource_fork.size(ec);
+			if (!ec && n > 0xffffffff) ec = std::make_error_code(std::errc::file_too_large);
+			if (!ec) {
+				_resource_fork_size = n;
+				has_resource_fork = true;
+			}
+		}
+		if (ec && !no_data(ec)) {
+			close();
+			return false;
+		}
+		ec.clear();
+
+		unsigned count = 1 + (name.empty() ? 0 : 1) + (has_resource_fork ? 1 : 0) + (_fd >= 0 ? 1 : 0);
+		uint64_t offset = header_size + count * descriptor_size;
+		uint64_t total = offset + name.size() + 32 + _resource_fork_size + _data_size;
+		if (total > 0xffffffff) {
+			ec = std::make_error_code(std::errc::file_too_large);
+			close();
+			return false;
+		}
+
+		_header.resize(offset + name.size() + 32);
+		uint8_t *cp = _header.data();
+		cp = write32(cp, f);
+		cp = write32(cp, version_2);
+		cp += 16;
+		cp = write16(cp, count);
+
+		auto descriptor = [&](uint32_t id, uint32_t length){
+			cp = write32(cp, id);
+			cp = write32(cp, offset);
+			cp = write32(cp, length);
+			offset += length;
+		};
+
+		if (!name.empty()) descriptor(real_name_id, name.size());
+		descriptor(finder_info_id, 32);
+		if (has_resource_fork) descriptor(resource_fork_id, _resource_fork_size);
+		if (_fd >= 0) descriptor(data_fork_id, _data_size);
+
+		std::memcpy(cp, name.data(), name.size());
+		cp += name.size();
+		std::memcpy(cp, fi.data(), 32);
+
+		_size = total;
+		return true;
+	}
+
+	size_t apple_single::encoder::read(void *buffer, size_t n, std::error_code &ec) {
+		ec.clear();
+
+		uint8_t *cp = (uint8_t *)buffer;
+		size_t count = 0;
+
+		uint64_t rfork_end = _header.size() + (uint64_t)_resource_fork_size;
+
+		while (count < n && _offset < _size) {
+			size_t k;
+			if (_offset < _header.size()) {
+				k = std::min<uint64_t>(n - count, _header.size() - _offset);
+				std::memcpy(cp, _header.data() + _offset, k);
+			}
+			else if (_offset < rfork_end) {
+				k = std::min<uint64_t>(n - count, rfork_end - _offset);
+				k = _resource_fork.read(cp, k, ec);
+				if (ec) return 0;
+			}
+			else {
+				k = std::min<uint64_t>(n - count, _size - _offset);
+				auto rv = _(::read(_fd, cp, k), ec);
+				if (rv < 0) {
+					if (errno == EINTR) { ec.clear(); continue; }
+					return 0;
+				}
+				k = rv;
+			}
+
+			// a fork shrank after the header was written.
+			if (k == 0) {
+				ec = std::make_error_code(std::errc::io_error);
+				return 0;
+			}
+
+			cp += k;
+			count += k;
+			_offset += k;
+		}
+		return count;
+	}
+
+
+	/*
+	 * decoder.  The header and descriptors are collected first; after that
+	 * each chunk is routed to the entry (sorted by offset) it falls in.
+	 */
+
+	void apple_single::decoder::close() {
+		// an unfinished fork is discarded, not committed.
+		if (_has_resource_fork) _resource_fork.invalidate();
+		_resource_fork.close();
+		if (_fd >= 0) ::close(_fd);
+		_fd = -1;
+
+		_path.clear();
+		_header.clear();
+		_entries.clear();
+		_index = 0;
+		_offset = 0;
+		_parsed = false;
+		_has_resource_fork = false;
+		std::memset(_finder_info, 0, sizeof(_finder_info));
+		_has_finder_info = false;
+		_real_name.clear();
+	}
+
+	bool apple_single::decoder::open(const std::string &path, std::error_code &ec) {
+		ec.clear();
+		close();
+		_path = path;
+		return true;
+	}
+
+	bool apple_single::decoder::parse(std::error_code &ec) {
+		const uint8_t *cp = _header.data();
+
+		uint32_t magic = read32(cp);
+		unsigned count = read16(cp + 24);
+		uint64_t end = header_size + count * descriptor_size;
+
+		_entries.reserve(count);
+		for (unsigned i = 0; i < count; ++i) {
+			const uint8_t *dp = cp + header_size + i * descriptor_size;
+			entry e;
+			e.id = read32(dp);
+			e.offset = read32(dp + 4);
+			e.length = read32(dp + 8);
+			if (e.length == 0) continue;
+			if (e.offset < end) {
+				ec = bad_stream();
+				return false;
+			}
+			_entries.push_back(e);
+		}
+
+		std::sort(_entries.begin(), _entries.end(), [](const entry &a, const entry &b){
+			return a.offset < b.offset;
+		});
+		for (size_t i = 1; i < _entries.size(); ++i) {
+			if ((uint64_t)_entries[i - 1].offset + _entries[i - 1].length > _entries[i].offset) {
+				ec = bad_stream();
+				return false;
+			}
+		}
+
+		if (magic == apple_single_format) {
+			_fd = _(::open(_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666), ec);
+		} else {
+			// the metadata needs a file to belong to.
+			_fd = _(::open(_path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0666), ec);
+			if (_fd >= 0) ::close(_fd);
+			_fd = -1;
+		}
+		if (ec) return false;
+
+		_parsed = true;
+		return true;
+	}
+
+	bool apple_single::decoder::consume(const entry &e, uint32_t pos, const uint8_t *cp, size_t n, std::error_code &ec) {
+		switch (e.id) {
+			case data_fork_id:
+				if (_fd < 0) return true; // AppleDouble.
+				while (n) {
+					auto rv = _(::write(_fd, cp, n), ec);
+					if (rv < 0) {
+						if (errno == EINTR) { ec.clear(); continue; }
+						return false;
+					}
+					cp += rv;
+					n -= rv;
+				}
+				return true;
+
+			case resource_fork_id:
+				if (!_has_resource_fork) {
+					if (!_resource_fork.open(_path, resource_fork::write_only, ec)) return false;
+					// the xattr backend can't write part of an attribute; collect it and write once.
+					_resource_fork.set_write_back(true);
+					if (!_resource_fork.truncate(0, ec) && !no_data(ec)) return false;
+					ec.clear();
+					_has_resource_fork = true;
+				}
+				while (n) {
+					size_t rv = _resource_fork.write(cp, n, ec);
+					if (ec) return false;
+					cp += rv;
+					n -= rv;
+				}
+				return true;
+
+			case finder_info_id:
+				if (pos < 32) {
+					size_t k = std::min<size_t>(n, 32 - pos);
+					std::memcpy(_finder_info + pos, cp, k);
+					_has_finder_info = true;
+				}
+				return true;
+
+			case real_name_id:
+				// a file name; anything past NAME_MAX is dropped.
+				if (_real_name.size() < NAME_MAX)
+					_real_name.append((const char *)cp, std::min<size_t>(n, NAME_MAX - _real_name.size()));
+				return true;
+
+			default:
+				return true;
+		}
+	}
+
+	size_t apple_single::decoder::write(const void *buffer, size_t n, std::error_code &ec) {
+		ec.clear();
+
+		if (_path.empty()) {
+			ec = std::make_error_code(std::errc::bad_file_descriptor);
+			return 0;
+		}
+
+		const uint8_t *cp = (const uint8_t *)buffer;
+		size_t left = n;
+
+		while (left) {
+			if (!_parsed) {
+				size_t need = header_size;
+				if (_header.size() >= header_size)
+					need += read16(_header.data() + 24) * descriptor_size;
+
+				size_t k = std::min(left, need - _header.size());
+				_header.insert(_header.end(), cp, cp + k);
+				cp += k;
+				left -= k;
+				_offset += k;
+
+				if (_header.size() == header_size) {
+					uint32_t magic = read32(_header.data());
+					uint32_t version = read32(_header.data() + 4);
+					if ((magic != apple_single_format && magic != apple_double_format) ||
+						(version != version_1 && version != version_2)) {
+						ec = bad_stream();
+						return 0;
+					}
+				}
+				if (_header.size() >= header_size && _header.size() == header_size + read16(_header.data() + 24) * descriptor_size) {
+					if (!parse(ec)) return 0;
+				}
+				continue;
+			}
+
+			while (_index < _entries.size() && _offset >= (uint64_t)_entries[_index].offset + _entries[_index].length)
+				++_index;
+
+			if (_index == _entries.size()) {
+				_offset += left;
+				break;
+			}
+
+			const entry &e = _entries[_index];
+			if (_offset < e.offset) {
+				size_t k = std::min<uint64_t>(left, e.offset - _offset);
+				cp += k;
+				left -= k;
+				_offset += k;
+				continue;
+			}
+
+			size_t k = std::min<uint64_t>(left, (uint64_t)e.offset + e.length - _offset);
+			if (!consume(e, _offset - e.offset, cp, k, ec)) return 0;
+			cp += k;
+			left -= k;
+			_offset += k;
+		}
+		return n;
+	}
+
+	bool apple_single::decoder::finish(std::error_code &ec) {
+		ec.clear();
+
+		if (!_parsed || (!_entries.empty() && _offset < (uint64_t)_entries.back().offset + _entries.back().length)) {
+			ec = bad_stream();
+			return false;
+		}
+
+		if (_has_resource_fork) {
+			if (!_resource_fork.flush(ec)) return false;
+			_resource_fork.close();
+			_has_resource_fork = false;
+		}
+
+		if (_fd >= 0) {
+			int ok = _(::close(_fd), ec);
+			_fd = -1;
+			if (ok < 0) return false;
+		}
+
+		if (_has_finder_info) {
+			finder_info fi;
+			fi.assign(_finder_info);
+			if (!fi.write(_path, ec)) return false;
+		}
+		return true;
+	}
+
+}
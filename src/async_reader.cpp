@@ -0,0 +1,302 @@
+#include "async_reader.h"
+#include "resource_fork.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+	typedef std::chrono::steady_clock clock_type;
+
+	struct job;
+	typedef std::multimap<clock_type::time_point, std::shared_ptr<job>> timer_map;
+
+	/* the bookkeeping fields belong to the reader's mutex. */
+	struct job {
+		std::atomic<bool> done{false};
+
+		bool queued = false;
+		bool timer_armed = false;
+		timer_map::iterator timer;
+
+		virtual ~job() {}
+
+		virtual void run() = 0;
+		virtual void fail(std::error_code ec) = 0;
+	};
+
+	template<class R>
+	struct basic_job : public job {
+		std::string path;
+		void (*work)(const std::string &, R &) = nullptr;
+		std::function<void(R &&)> fn;
+
+		void run() override {
+			if (done.load()) return;
+			R r;
+			work(path, r);
+			// lost to the timeout.
+			if (done.exchange(true)) return;
+			fn(std::move(r));
+		}
+
+		void fail(std::error_code ec) override {
+			if (done.exchange(true)) return;
+			R r;
+			r.error = ec;
+			fn(std::move(r));
+		}
+	};
+
+	void finder_info_work(const std::string &path, afp::finder_info_result &r) {
+		r.info.read(path, r.error);
+	}
+
+	void size_work(const std::string &path, afp::resource_fork_result &r) {
+		r.size = afp::resource_fork::size(path, r.error);
+	}
+
+	/* one path based lookup where the platform has it; fewer round trips on NFS. */
+	void read_work(const std::string &path, afp::resource_fork_result &r) {
+		r.size = afp::resource_fork::read_fast(path, r.data, r.error);
+		if (r.error) r.data.clear();
+	}
+
+	template<class R>
+	std::function<void(R &&)> fulfill(const std::shared_ptr<std::promise<R>> &p) {
+		return [p](R &&r){ p->set_value(std::move(r)); };
+	}
+
+}
+
+namespace afp {
+
+	class async_reader::state {
+
+	public:
+		explicit state(const async_options &options) : _options(options) {
+			unsigned threads = options.threads;
+			if (!threads) threads = std::thread::hardware_concurrency();
+			if (!threads) threads = 1;
+			if (!_options.max_in_flight) _options.max_in_flight = 1;
+
+			_workers.reserve(threads);
+			for (unsigned i = 0; i < threads; ++i)
+				_workers.emplace_back(&state::run, this);
+			_completer = std::thread(&state::complete, this);
+			if (_options.timeout.count() > 0)
+				_watchdog = std::thread(&state::watch, this);
+		}
+
+		~state() {
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_stopping = true;
+				// the completer delivers these before it exits.
+				for (auto &j : _queue) {
+					j->queued = false;
+					disarm(*j);
+					_completions.emplace_back(std::move(j), std::make_error_code(std::errc::operation_canceled));
+				}
+				_in_flight -= _queue.size();
+				_queue.clear();
+			}
+			_work_cv.notify_all();
+			_timer_cv.notify_all();
+			_completion_cv.notify_all();
+
+			for (auto &t : _workers) t.join();
+			if (_watchdog.joinable()) _watchdog.join();
+			_completer.join();
+		}
+
+		template<class R>
+		bool submit(const std::string &path, void (*work)(const std::string &, R &), std::function<void(R &&)> &&fn, std::error_code &ec) {
+			ec.clear();
+
+			auto j = std::make_shared<basic_job<R>>();
+			j->path = path;
+			j->work = work;
+			j->fn = std::move(fn);
+
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (_stopping) {
+				ec = std::make_error_code(std::errc::operation_canceled);
+				return false;
+			}
+			if (_in_flight >= _options.max_in_flight) {
+				ec = std::make_error_code(std::errc::resource_unavailable_try_again); // EAGAIN.
+				return false;
+			}
+
+			++_in_flight;
+			j->queued = true;
+			_queue.push_back(j);
+			_work_cv.notify_one();
+
+			if (_options.timeout.count() > 0) {
+				j->timer = _timers.emplace(clock_type::now() + _options.timeout, j);
+				j->timer_armed = true;
+				if (j->timer == _timers.begin()) _timer_cv.notify_one();
+			}
+			return true;
+		}
+
+		size_t in_flight() const {
+			std::lock_guard<std::mutex> lock(_mutex);
+			return _in_flight;
+		}
+
+	private:
+		async_options _options;
+
+		mutable std::mutex _mutex;
+		std::condition_variable _work_cv;
+		std::condition_variable _timer_cv;
+		std::condition_variable _completion_cv;
+		std::deque<std::shared_ptr<job>> _queue;
+		std::deque<std::pair<std::shared_ptr<job>, std::error_code>> _completions; // timed out or cancelled
+		timer_map _timers;
+		size_t _in_flight = 0;
+		bool _stopping = false;
+
+		std::vector<std::thread> _workers;
+		std::thread _watchdog;
+		std::thread _completer;
+
+		void disarm(job &j) {
+			if (!j.timer_armed) return;
+			_timers.erase(j.timer);
+			j.timer_armed = false;
+		}
+
+		void run() {
+			std::unique_lock<std::mutex> lock(_mutex);
+			for (;;) {
+				_work_cv.wait(lock, [this]{ return _stopping || !_queue.empty(); });
+				if (_queue.empty()) return;
+
+				std::shared_ptr<job> j = std::move(_queue.front());
+				_queue.pop_front();
+				j->queued = false;
+
+				lock.unlock();
+				j->run();
+				lock.lock();
+
+				disarm(*j);
+				--_in_flight;
+			}
+		}
+
+		/*
+		 * expires requests and hands them to the completer, so a slow
+		 * callback can't hold up the next deadline.  A queued request gives
+		 * up its slot; a running one keeps it.
+		 */
+		void watch() {
+			std::unique_lock<std::mutex> lock(_mutex);
+			while (!_stopping) {
+				if (_timers.empty()) {
+					_timer_cv.wait(lock);
+					continue;
+				}
+				auto first = _timers.begin();
+				// a copy; the entry may be erased while we wait.
+				clock_type::time_point deadline = first->first;
+				if (clock_type::now() < deadline) {
+					_timer_cv.wait_until(lock, deadline);
+					continue;
+				}
+
+				std::shared_ptr<job> j = std::move(first->second);
+				_timers.erase(first);
+				j->timer_armed = false;
+				if (j->queued) {
+					for (auto iter = _queue.begin(); iter != _queue.end(); ++iter) {
+						if (*iter == j) {
+							_queue.erase(iter);
+							break;
+						}
+					}
+					j->queued = false;
+					--_in_flight;
+				}
+
+				_completions.emplace_back(std::move(j), std::make_error_code(std::errc::timed_out));
+				_completion_cv.notify_one();
+			}
+		}
+
+		/*
+		 * delivers timeouts and cancellations.  It never touches the
+		 * filesystem, so a timeout still arrives when every worker is stuck
+		 * in a system call.
+		 */
+		void complete() {
+			std::unique_lock<std::mutex> lock(_mutex);
+			for (;;) {
+				_completion_cv.wait(lock, [this]{ return _stopping || !_completions.empty(); });
+				if (_completions.empty()) return;
+
+				auto c = std::move(_completions.front());
+				_completions.pop_front();
+
+				lock.unlock();
+				c.first->fail(c.second);
+				lock.lock();
+			}
+		}
+	};
+
+
+	async_reader::async_reader(const async_options &options) : _state(new state(options)) {
+	}
+
+	async_reader::~async_reader() {
+	}
+
+	bool async_reader::read_finder_info(const std::string &path, finder_info_callback fn, std::error_code &ec) {
+		return _state->submit(path, finder_info_work, std::move(fn), ec);
+	}
+
+	bool async_reader::resource_fork_size(const std::string &path, resource_fork_callback fn, std::error_code &ec) {
+		return _state->submit(path, size_work, std::move(fn), ec);
+	}
+
+	bool async_reader::read_resource_fork(const std::string &path, resource_fork_callback fn, std::error_code &ec) {
+		return _state->submit(path, read_work, std::move(fn), ec);
+	}
+
+	std::future<finder_info_result> async_reader::read_finder_info(const std::string &path, std::error_code &ec) {
+		auto p = std::make_shared<std::promise<finder_info_result>>();
+		auto rv = p->get_future();
+		if (!read_finder_info(path, fulfill(p), ec)) return std::future<finder_info_result>();
+		return rv;
+	}
+
+	std::future<resource_fork_result> async_reader::resource_fork_size(const std::string &path, std::error_code &ec) {
+		auto p = std::make_shared<std::promise<resource_fork_result>>();
+		auto rv = p->get_future();
+		if (!resource_fork_size(path, fulfill(p), ec)) return std::future<resource_fork_result>();
+		return rv;
+	}
+
+	std::future<resource_fork_result> async_reader::read_resource_fork(const std::string &path, std::error_code &ec) {
+		auto p = std::make_shared<std::promise<resource_fork_result>>();
+		auto rv = p->get_future();
+		if (!read_resource_fork(path, fulfill(p), ec)) return std::future<resource_fork_result>();
+		return rv;
+	}
+
+	size_t async_reader::in_flight() const {
+		return _state->in_flight();
+	}
+
+}
@@ -0,0 +1,478 @@
+#include "batch.h"
+#include "resource_fork.h"
+
+#include <cstring>
+#include <algorithm>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+/* IORING_OP_FGETXATTR is an enum; SQE128 arrived in the same release (5.19). */
+#ifdef IORING_SETUP_SQE128
+#define AFP_IO_URING
+#endif
+#endif
+#endif
+
+#ifdef AFP_IO_URING
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#define XATTR_FINDERINFO_NAME "user.com.apple.FinderInfo"
+#define XATTR_RESOURCEFORK_NAME "user.com.apple.ResourceFork"
+#define XATTR_RESOURCEFORK_INDEX_NAME XATTR_RESOURCEFORK_NAME ".index"
+#endif
+
+namespace {
+
+	void fallback(const std::string &path, afp::finder_info_result &r) {
+		r.info.read(path, r.error);
+	}
+
+	void fallback_size(const std::string &path, afp::resource_fork_result &r) {
+		r.data.clear();
+		r.size = afp::resource_fork::size(path, r.error);
+	}
+
+	void fallback_read(const std::string &path, afp::resource_fork_result &r) {
+		afp::resource_fork rf;
+
+		r.size = 0;
+		r.data.clear();
+		if (!rf.open(path, afp::resource_fork::read_only, r.error)) return;
+
+		afp::byte_view v = rf.view(r.error);
+		if (r.error) return;
+		r.data.assign(v.begin(), v.end());
+		r.size = r.data.size();
+	}
+
+
+#ifdef AFP_IO_URING
+
+	enum {
+		ring_entries = 256,
+		chunk_size = 64, // at most 4 sqes per file per phase.
+	};
+
+	std::error_code make_error(int e) {
+		return std::error_code(e, std::system_category());
+	}
+
+	/* same classification as regular_file() */
+	std::error_code check_regular(const struct statx &st) {
+		if (S_ISREG(st.stx_mode)) return std::error_code();
+		if (S_ISDIR(st.stx_mode)) return std::make_error_code(std::errc::is_a_directory);
+		return std::make_error_code(std::errc::invalid_seek);
+	}
+
+	/* minimal io_uring wrapper; liburing is not required. */
+	class uring {
+
+	public:
+		uring() = default;
+		uring(const uring &) = delete;
+		uring &operator=(const uring &) = delete;
+
+		~uring() {
+			if (_sqes != MAP_FAILED) ::munmap(_sqes, _sqes_size);
+			if (_cq_ptr != MAP_FAILED && _cq_ptr != _sq_ptr) ::munmap(_cq_ptr, _cq_size);
+			if (_sq_ptr != MAP_FAILED) ::munmap(_sq_ptr, _sq_size);
+			if (_fd >= 0) ::close(_fd);
+		}
+
+		bool init(unsigned entries) {
+			struct io_uring_params p;
+			std::memset(&p, 0, sizeof(p));
+
+			_fd = ::syscall(__NR_io_uring_setup, entries, &p);
+			if (_fd < 0) return false;
+
+			_sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+			_cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+			if (p.features & IORING_FEAT_SINGLE_MMAP)
+				_sq_size = _cq_size = std::max(_sq_size, _cq_size);
+
+			_sq_ptr = ::mmap(nullptr, _sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+			if (_sq_ptr == MAP_FAILED) return false;
+
+			if (p.features & IORING_FEAT_SINGLE_MMAP) _cq_ptr = _sq_ptr;
+			else {
+				_cq_ptr = ::mmap(nullptr, _cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+				if (_cq_ptr == MAP_FAILED) return false;
+			}
+
+			_sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+			void *sqes = ::mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+			if (sqes == MAP_FAILED) return false;
+			_sqes = static_cast<struct io_uring_sqe *>(sqes);
+
+			uint8_t *sq = static_cast<uint8_t *>(_sq_ptr);
+			uint8_t *cq = static_cast<uint8_t *>(_cq_ptr);
+
+			_sq_head = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+			_sq_tail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+			_sq_mask = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+			_sq_array = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+			_sq_entries = p.sq_entries;
+
+			_cq_head = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+			_cq_tail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+			_cq_mask = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+			_cqes = reinterpret_cast<struct io_uring_cqe *>(cq + p.cq_off.cqes);
+
+			_tail = *_sq_tail;
+			return true;
+		}
+
+		bool supports(const uint8_t *ops, size_t count) {
+			size_t size = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+			std::vector<uint8_t> buffer(size);
+			auto probe = reinterpret_cast<struct io_uring_probe *>(buffer.data());
+
+			if (::syscall(__NR_io_uring_register, _fd, IORING_REGISTER_PROBE, probe, 256) < 0) return false;
+			for (size_t i = 0; i < count; ++i) {
+				if (ops[i] > probe->last_op) return false;
+				if (!(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) return false;
+			}
+			return true;
+		}
+
+		/* callers never queue more than the ring holds between calls to run(). */
+		struct io_uring_sqe *sqe(uint8_t opcode, int fd, uint64_t user_data) {
+			struct io_uring_sqe *e = &_sqes[_tail & _sq_mask];
+			std::memset(e, 0, sizeof(*e));
+			e->opcode = opcode;
+			e->fd = fd;
+			e->user_data = user_data;
+			_sq_array[_tail & _sq_mask] = _tail & _sq_mask;
+			++_tail;
+			return e;
+		}
+
+		/* submit everything queued and wait for `count` completions. */
+		template<class F>
+		bool run(unsigned count, F f) {
+			__atomic_store_n(_sq_tail, _tail, __ATOMIC_RELEASE);
+
+			for (;;) {
+				unsigned pending = _tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+
+				unsigned head = *_cq_head;
+				unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+				for (; head != tail && count; ++head, --count) {
+					const struct io_uring_cqe &c = _cqes[head & _cq_mask];
+					f(c.user_data, c.res);
+				}
+				__atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+
+				if (!count && !pending) return true;
+
+				int rv = ::syscall(__NR_io_uring_enter, _fd, pending, count ? 1 : 0, IORING_ENTER_GETEVENTS, nullptr, 0);
+				if (rv < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) return false;
+			}
+		}
+
+	private:
+		int _fd = -1;
+		void *_sq_ptr = MAP_FAILED;
+		void *_cq_ptr = MAP_FAILED;
+		size_t _sq_size = 0;
+		size_t _cq_size = 0;
+		struct io_uring_sqe *_sqes = static_cast<struct io_uring_sqe *>(MAP_FAILED);
+		size_t _sqes_size = 0;
+
+		unsigned *_sq_head = nullptr;
+		unsigned *_sq_tail = nullptr;
+		unsigned *_sq_array = nullptr;
+		unsigned _sq_mask = 0;
+		unsigned _sq_entries = 0;
+		unsigned _tail = 0;
+
+		unsigned *_cq_head = nullptr;
+		unsigned *_cq_tail = nullptr;
+		unsigned _cq_mask = 0;
+		struct io_uring_cqe *_cqes = nullptr;
+	};
+
+	bool open_ring(uring &ring) {
+		static const uint8_t ops[] = {
+			IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_FGETXATTR, IORING_OP_CLOSE
+		};
+		if (!ring.init(ring_entries)) return false;
+		return ring.supports(ops, sizeof(ops));
+	}
+
+	/*
+	 * per-chunk state.  Each phase is one submission: open; then statx + fgetxattr
+	 * (+ close) chained with IOSQE_IO_HARDLINK so a failure doesn't cancel the close.
+	 */
+	struct chunk {
+		enum { op_stat, op_xattr, op_close, op_index };
+
+		size_t begin = 0;
+		size_t count = 0;
+		std::vector<int> fds;
+		std::vector<int> errors;
+		std::vector<struct statx> stats;
+		std::vector<int> results;
+		std::vector<int> index_results;
+
+		static uint64_t tag(size_t i, unsigned op) { return (i << 2) | op; }
+
+		bool open(uring &ring, const std::vector<std::string> &paths, size_t b, size_t n) {
+			begin = b;
+			count = n;
+			fds.assign(n, -1);
+			errors.assign(n, 0);
+			stats.clear();
+			stats.resize(n);
+			results.assign(n, 0);
+			index_results.assign(n, -ENODATA);
+
+			for (size_t i = 0; i < n; ++i) {
+				auto e = ring.sqe(IORING_OP_OPENAT, AT_FDCWD, i);
+				e->addr = reinterpret_cast<uintptr_t>(paths[b + i].c_str());
+				e->open_flags = O_RDONLY | O_NONBLOCK | O_CLOEXEC;
+			}
+			return ring.run(n, [this](uint64_t i, int res){
+				if (res < 0) errors[i] = -res;
+				else fds[i] = res;
+			});
+		}
+
+		/*
+		 * statx + fgetxattr, and close if requested.  If index is set, its size
+		 * is probed in the same chain (a chunked resource fork has no single
+		 * attribute).
+		 */
+		bool query(uring &ring, const char *name, std::vector<std::vector<uint8_t>> *buffers, unsigned size, bool close, const char *index = nullptr) {
+			unsigned expect = 0;
+			for (size_t i = 0; i < count; ++i) {
+				if (fds[i] < 0) continue;
+
+				auto e = ring.sqe(IORING_OP_STATX, fds[i], tag(i, op_stat));
+				e->addr = reinterpret_cast<uintptr_t>("");
+				e->len = STATX_TYPE;
+				e->addr2 = reinterpret_cast<uintptr_t>(&stats[i]);
+				e->statx_flags = AT_EMPTY_PATH;
+				e->flags = IOSQE_IO_HARDLINK;
+
+				e = ring.sqe(IORING_OP_FGETXATTR, fds[i], tag(i, op_xattr));
+				e->addr = reinterpret_cast<uintptr_t>(name);
+				if (buffers) {
+					e->addr2 = reinterpret_cast<uintptr_t>((*buffers)[i].data());
+					e->len = size;
+				}
+				expect += 2;
+
+				if (index) {
+					e->flags = IOSQE_IO_HARDLINK;
+					e = ring.sqe(IORING_OP_FGETXATTR, fds[i], tag(i, op_index));
+					e->addr = reinterpret_cast<uintptr_t>(index);
+					++expect;
+				}
+
+				if (close) {
+					e->flags = IOSQE_IO_HARDLINK;
+					ring.sqe(IORING_OP_CLOSE, fds[i], tag(i, op_close));
+					++expect;
+					disown(i);
+				}
+			}
+
+			bool ok = ring.run(expect, [this](uint64_t ud, int res){
+				size_t i = ud >> 2;
+				switch (ud & 3) {
+					case op_stat:
+						if (res < 0 && !errors[i]) errors[i] = -res;
+						break;
+					case op_xattr:
+						results[i] = res;
+						break;
+					case op_index:
+						index_results[i] = res;
+						break;
+				}
+			});
+			return ok;
+		}
+
+		/* errors from open / statx take precedence over the xattr result. */
+		std::error_code error(size_t i) const {
+			if (errors[i]) return make_error(errors[i]);
+			auto ec = check_regular(stats[i]);
+			if (ec) return ec;
+			if (results[i] < 0) return make_error(-results[i]);
+			return std::error_code();
+		}
+
+		/*
+		 * once its CLOSE is queued the descriptor is the ring's: if run() fails
+		 * it may already be closed (and the number reused), so close_all()
+		 * must leave it alone.  A close that never ran leaks instead.
+		 */
+		void disown(size_t i) {
+			fds[i] = -1;
+		}
+
+		void close_all() {
+			for (auto &fd : fds) {
+				if (fd >= 0) ::close(fd);
+				fd = -1;
+			}
+		}
+	};
+
+	bool uring_finder_info(const std::vector<std::string> &paths, std::vector<afp::finder_info_result> &results) {
+		uring ring;
+		if (!open_ring(ring)) return false;
+
+		std::vector<std::vector<uint8_t>> buffers(chunk_size, std::vector<uint8_t>(32));
+
+		for (size_t b = 0; b < paths.size(); b += chunk_size) {
+			size_t n = std::min<size_t>(chunk_size, paths.size() - b);
+
+			chunk c;
+			if (!c.open(ring, paths, b, n) || !c.query(ring, XATTR_FINDERINFO_NAME, &buffers, 32, true)) {
+				c.close_all();
+				for (size_t i = b; i < paths.size(); ++i) fallback(paths[i], results[i]);
+				return true;
+			}
+
+			for (size_t i = 0; i < n; ++i) {
+				auto &r = results[b + i];
+				r.info.clear();
+				r.error = c.error(i);
+				if (!r.error) r.info.assign(buffers[i].data(), c.results[i]);
+			}
+		}
+		return true;
+	}
+
+	bool uring_resource_fork(const std::vector<std::string> &paths, std::vector<afp::resource_fork_result> &results, bool read) {
+		uring ring;
+		if (!open_ring(ring)) return false;
+
+		for (size_t b = 0; b < paths.size(); b += chunk_size) {
+			size_t n = std::min<size_t>(chunk_size, paths.size() - b);
+
+			chunk c;
+			if (!c.open(ring, paths, b, n) || !c.query(ring, XATTR_RESOURCEFORK_NAME, nullptr, 0, !read, XATTR_RESOURCEFORK_INDEX_NAME)) {
+				c.close_all();
+				for (size_t i = b; i < paths.size(); ++i) {
+					if (read) fallback_read(paths[i], results[i]);
+					else fallback_size(paths[i], results[i]);
+				}
+				return true;
+			}
+
+			// chunked forks are rare; they're handled one at a time once the chunk is done.
+			std::vector<size_t> chunked;
+			for (size_t i = 0; i < n; ++i) {
+				auto &r = results[b + i];
+				r.data.clear();
+				r.error = c.error(i);
+				r.size = r.error ? 0 : c.results[i];
+				if (r.error.value() == ENODATA && c.index_results[i] >= 0) chunked.push_back(b + i);
+			}
+			if (!read) {
+				for (size_t i : chunked) fallback_size(paths[i], results[i]);
+				continue;
+			}
+
+			// second pass: read the forks that have data, then close.
+			unsigned expect = 0;
+			for (size_t i = 0; i < n; ++i) {
+				if (c.fds[i] < 0) continue;
+				auto &r = results[b + i];
+				if (!r.error && r.size) {
+					r.data.resize(r.size);
+					auto e = ring.sqe(IORING_OP_FGETXATTR, c.fds[i], chunk::tag(i, chunk::op_xattr));
+					e->addr = reinterpret_cast<uintptr_t>(XATTR_RESOURCEFORK_NAME);
+					e->addr2 = reinterpret_cast<uintptr_t>(r.data.data());
+					e->len = r.size;
+					e->flags = IOSQE_IO_HARDLINK;
+					++expect;
+				}
+				ring.sqe(IORING_OP_CLOSE, c.fds[i], chunk::tag(i, chunk::op_close));
+				++expect;
+				c.disown(i);
+			}
+
+			bool ok = ring.run(expect, [&](uint64_t ud, int res){
+				if ((ud & 3) != chunk::op_xattr) return;
+				size_t i = ud >> 2;
+				auto &r = results[b + i];
+				if (res < 0) {
+					r.error = make_error(-res);
+					r.data.clear();
+					r.size = 0;
+				} else {
+					r.data.resize(res);
+					r.size = res;
+				}
+			});
+			if (!ok) {
+				c.close_all();
+				for (size_t i = b; i < paths.size(); ++i) fallback_read(paths[i], results[i]);
+				return true;
+			}
+
+			// the fork grew between the two passes.
+			for (size_t i = 0; i < n; ++i) {
+				auto &r = results[b + i];
+				if (r.error.value() == ERANGE) fallback_read(paths[b + i], r);
+			}
+			for (size_t i : chunked) fallback_read(paths[i], results[i]);
+		}
+		return true;
+	}
+
+#endif
+
+}
+
+namespace afp {
+
+	void read_finder_info_batch(const std::vector<std::string> &paths, std::vector<finder_info_result> &results) {
+		results.clear();
+		results.resize(paths.size());
+
+		#ifdef AFP_IO_URING
+		if (uring_finder_info(paths, results)) return;
+		#endif
+
+		for (size_t i = 0; i < paths.size(); ++i)
+			fallback(paths[i], results[i]);
+	}
+
+	void resource_fork_size_batch(const std::vector<std::string> &paths, std::vector<resource_fork_result> &results) {
+		results.clear();
+		results.resize(paths.size());
+
+		#ifdef AFP_IO_URING
+		if (uring_resource_fork(paths, results, false)) return;
+		#endif
+
+		for (size_t i = 0; i < paths.size(); ++i)
+			fallback_size(paths[i], results[i]);
+	}
+
+	void read_resource_fork_batch(const std::vector<std::string> &paths, std::vector<resource_fork_result> &results) {
+		results.clear();
+		results.resize(paths.size());
+
+		#ifdef AFP_IO_URING
+		if (uring_resource_fork(paths, results, true)) return;
+		#endif
+
+		for (size_t i = 0; i < paths.size(); ++i)
+			fallback_read(paths[i], results[i]);
+	}
+
+}
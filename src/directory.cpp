@@ -0,0 +1,66 @@
+#include "directory.h"
+
+#include <utility>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifndef O_DIRECTORY
+#define O_DIRECTORY 0
+#endif
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+namespace {
+
+	template<class T>
+	T _(T x, std::error_code &ec) {
+		if (x < 0) ec = std::error_code(errno, std::system_category());
+		return x;
+	}
+
+}
+
+namespace afp {
+
+	directory::directory(directory &&rhs) {
+		std::swap(_fd, rhs._fd);
+	}
+
+	directory& directory::operator=(directory &&rhs) {
+		if (this != &rhs) {
+			close();
+			std::swap(_fd, rhs._fd);
+		}
+		return *this;
+	}
+
+	void directory::close() {
+		if (_fd >= 0) ::close(_fd);
+		_fd = -1;
+	}
+
+	bool directory::open(const std::string &path, std::error_code &ec) {
+		ec.clear();
+		close();
+
+		_fd = _(::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC), ec);
+		return _fd >= 0;
+	}
+
+	bool directory::open(const directory &parent, const std::string &name, std::error_code &ec) {
+		ec.clear();
+
+		// n.b. parent may be *this.
+		int fd = _(::openat(parent._fd, name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC), ec);
+		if (fd < 0) return false;
+
+		close();
+		_fd = fd;
+		return true;
+	}
+
+}
@@ -0,0 +1,228 @@
+#include "file_metadata.h"
+
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "xattr.h"
+#include "stats_hooks.h"
+
+#if defined(__linux__)
+#define XATTR_FINDERINFO_NAME "user.com.apple.FinderInfo"
+#define XATTR_RESOURCEFORK_NAME "user.com.apple.ResourceFork"
+#endif
+
+#ifndef XATTR_FINDERINFO_NAME
+#define XATTR_FINDERINFO_NAME "com.apple.FinderInfo"
+#endif
+
+#ifndef XATTR_RESOURCEFORK_NAME
+#define XATTR_RESOURCEFORK_NAME "com.apple.ResourceFork"
+#endif
+
+/* a chunked fork (resource_fork::set_chunked) has an index instead of the attribute. */
+#define XATTR_RESOURCEFORK_INDEX_NAME XATTR_RESOURCEFORK_NAME ".index"
+
+namespace {
+
+	template<class T>
+	T _(T x, std::error_code &ec) {
+		if (x < 0) ec = std::error_code(errno, std::system_category());
+		return x;
+	}
+
+	bool regular_file(int fd, std::error_code &ec) {
+		struct stat st;
+		if (_(::fstat(fd, &st), ec) < 0) return false;
+		if (S_ISREG(st.st_mode)) return true;
+
+		if (S_ISDIR(st.st_mode)) {
+			ec = std::make_error_code(std::errc::is_a_directory);
+		} else {
+			ec = std::make_error_code(std::errc::invalid_seek); // ESPIPE.
+		}
+		return false;
+	}
+
+#if !defined(__sun__)
+	/* the attribute names, NUL separated.  one call unless there are a lot of them. */
+	bool list_names(int fd, std::vector<char> &rv, std::error_code &ec) {
+		rv.resize(1024);
+		for(;;) {
+			auto n = _(::list_xattr(fd, rv.data(), rv.size()), ec);
+			if (n >= 0) {
+				rv.resize(n);
+				return true;
+			}
+			if (ec.value() != ERANGE) return false;
+
+			ec.clear();
+			n = _(::list_xattr(fd, nullptr, 0), ec);
+			if (n < 0) return false;
+			rv.resize(n + 1);
+		}
+	}
+#endif
+
+}
+
+namespace afp {
+
+	file_metadata::file_metadata(file_metadata &&rhs) {
+		std::swap(_fd, rhs._fd);
+		std::swap(_mode, rhs._mode);
+		std::swap(_absent, rhs._absent);
+		std::swap(_finder_info_attached, rhs._finder_info_attached);
+		std::swap(_resource_fork_attached, rhs._resource_fork_attached);
+		std::swap(_finder_info_error, rhs._finder_info_error);
+		std::swap(_resource_fork_error, rhs._resource_fork_error);
+		std::swap(_finder_info, rhs._finder_info);
+		std::swap(_resource_fork, rhs._resource_fork);
+	}
+
+	file_metadata& file_metadata::operator=(file_metadata &&rhs) {
+		if (this != &rhs) {
+			close();
+			std::swap(_fd, rhs._fd);
+			std::swap(_mode, rhs._mode);
+			std::swap(_absent, rhs._absent);
+			std::swap(_finder_info_attached, rhs._finder_info_attached);
+			std::swap(_resource_fork_attached, rhs._resource_fork_attached);
+			std::swap(_finder_info_error, rhs._finder_info_error);
+			std::swap(_resource_fork_error, rhs._resource_fork_error);
+			std::swap(_finder_info, rhs._finder_info);
+			std::swap(_resource_fork, rhs._resource_fork);
+		}
+		return *this;
+	}
+
+	void file_metadata::close() {
+		// the views borrow the descriptor, so close them first (pending writes are flushed).
+		_resource_fork.close();
+		_finder_info.close();
+		_finder_info.clear();
+
+		if (_fd >= 0) ::close(_fd);
+		_fd = -1;
+		_mode = read_only;
+		_absent = 0;
+		_finder_info_attached = false;
+		_resource_fork_attached = false;
+		_finder_info_error.clear();
+		_resource_fork_error.clear();
+	}
+
+	bool file_metadata::open_at(int dirfd, const std::string &path, open_mode mode, std::error_code &ec) {
+		ec.clear();
+		close();
+
+		uint64_t t = afp_stats_begin();
+		int fd = _(::openat(dirfd, path.c_str(), O_RDONLY | O_NONBLOCK), ec);
+		afp_stats_end(AFP_STATS_OPEN, t, fd);
+		if (fd < 0) return false;
+		if (!regular_file(fd, ec)) {
+			::close(fd);
+			return false;
+		}
+
+		_fd = fd;
+		_mode = mode;
+		return true;
+	}
+
+	bool file_metadata::open(const std::string &path, open_mode mode, std::error_code &ec) {
+		return open_at(AT_FDCWD, path, mode, ec);
+	}
+
+	bool file_metadata::open(const directory &dir, const std::string &name, open_mode mode, std::error_code &ec) {
+		return open_at(dir.fd(), name, mode, ec);
+	}
+
+	afp::finder_info &file_metadata::finder_info(std::error_code &ec) {
+		if (_fd < 0) {
+			ec = std::make_error_code(std::errc::bad_file_descriptor);
+			return _finder_info;
+		}
+
+		// the descriptor is borrowed (and already checked) by both views.
+		if (!_finder_info_attached) {
+			_finder_info_attached = true;
+			if (!has_finder_info()) {
+				// known to be missing; don't ask again.
+				if (_mode == read_only)
+					_finder_info_error = std::make_error_code(std::errc::no_message_available);
+				else
+					_finder_info.attach(_fd, afp::finder_info::write_only, afp::finder_info::trusted, _finder_info_error);
+			}
+			else _finder_info.attach(_fd, (afp::finder_info::open_mode)_mode, afp::finder_info::trusted, _finder_info_error);
+		}
+		ec = _finder_info_error;
+		return _finder_info;
+	}
+
+	afp::resource_fork &file_metadata::resource_fork(std::error_code &ec) {
+		if (_fd < 0) {
+			ec = std::make_error_code(std::errc::bad_file_descriptor);
+			return _resource_fork;
+		}
+
+		if (!_resource_fork_attached) {
+			_resource_fork_attached = true;
+			_resource_fork.attach(_fd, (afp::resource_fork::open_mode)_mode, afp::resource_fork::trusted, _resource_fork_error);
+		}
+		ec = _resource_fork_error;
+		return _resource_fork;
+	}
+
+	bool file_metadata::prefetch(std::error_code &ec) {
+		ec.clear();
+
+		if (_fd < 0) {
+			ec = std::make_error_code(std::errc::bad_file_descriptor);
+			return false;
+		}
+
+	#if !defined(__sun__)
+		if (!_finder_info_attached || !_resource_fork_attached) {
+			std::vector<char> names;
+			if (!list_names(_fd, names, ec)) {
+				// no extended attributes on this filesystem means no metadata either.
+				if (ec.value() != ENOTSUP && ec.value() != EOPNOTSUPP) return false;
+				ec.clear();
+			}
+
+			_absent = absent_finder_info | absent_resource_fork;
+			for (size_t i = 0; i < names.size(); ) {
+				const char *cp = names.data() + i;
+				size_t n = strnlen(cp, names.size() - i);
+				if (!std::strcmp(cp, XATTR_FINDERINFO_NAME)) _absent &= ~absent_finder_info;
+				if (!std::strcmp(cp, XATTR_RESOURCEFORK_NAME) || !std::strcmp(cp, XATTR_RESOURCEFORK_INDEX_NAME)) _absent &= ~absent_resource_fork;
+				i += n + 1;
+			}
+		}
+	#endif
+
+		if (_mode == write_only) return true;
+
+		if (has_finder_info()) {
+			finder_info(ec);
+			if (ec && ec != std::errc::no_message_available) return false;
+			ec.clear();
+		}
+
+		if (has_resource_fork()) {
+			auto &rf = resource_fork(ec);
+			if (!ec) rf.view(ec);
+			if (ec && ec != std::errc::no_message_available) return false;
+			ec.clear();
+		}
+
+		return true;
+	}
+
+}
@@ -1,10 +1,14 @@
 #include "finder_info.h"
+#include "file_type.h"
 
 #include <cstdint>
 #include <cstring>
-#include <cctype>
 #include <string>
 
+#include "stats_hooks.h"
+#include "probes.h"
+#include "trace_hooks.h"
+
 #if defined(__CYGWIN__) || defined(__MSYS__)
 #if !defined(_WIN32)
 #define _WIN32
@@ -21,6 +25,7 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include "xattr.h"
+#include "metadata_cache.h"
 #endif
 
 #if defined(__APPLE__)
@@ -41,6 +46,10 @@
 #define _prodos_file_type _afp.prodos_file_type
 #define _prodos_aux_type _afp.prodos_aux_type
 #define _finder_info _afp.finder_info
+#else
+#define _prodos_file_type _data.prodos_file_type
+#define _prodos_aux_type _data.prodos_aux_type
+#define _finder_info _data.finder_info
 #endif
 
 namespace {
@@ -111,7 +120,10 @@ extern "C" int remap_os_error(unsigned long);
 				break;
 		}
 
-		return _(CreateFile(s, access, FILE_SHARE_READ, nullptr, create, FILE_ATTRIBUTE_NORMAL, nullptr), ec);
+		uint64_t t = afp_stats_begin();
+		HANDLE h = _(CreateFile(s, access, FILE_SHARE_READ, nullptr, create, FILE_ATTRIBUTE_NORMAL, nullptr), ec);
+		afp_stats_end(AFP_STATS_OPEN, t, h == INVALID_HANDLE_VALUE ? -1 : 0);
+		return h;
 	}
 
 	DWORD GetFileAttributesX(const std::string &path) {
@@ -150,11 +162,13 @@ extern "C" int remap_os_error(unsigned long);
 		return x;
 	}
 
-	bool regular_file(int fd, std::error_code &ec) {
+	/* sp (if not null) receives the fstat result */
+	bool regular_file(int fd, std::error_code &ec, struct stat *sp = nullptr) {
 			struct stat st;
 			if (_(::fstat(fd, &st), ec) < 0) {
 				return false;
 			}
+			if (sp) *sp = st;
 			if (S_ISREG(st.st_mode)) return true;
 
 			if (S_ISDIR(st.st_mode)) {
@@ -166,15 +180,32 @@ extern "C" int remap_os_error(unsigned long);
 	}
 
 	/* opens a file read-only and verifies it's a regular file */
-	int openX(const std::string &path, std::error_code &ec) {
-		int fd = _(::open(path.c_str(), O_RDONLY | O_NONBLOCK), ec);
-		if (fd >= 0 && !regular_file(fd, ec)) {
+	int openX(int dirfd, const std::string &path, std::error_code &ec, struct stat *st = nullptr) {
+		uint64_t t = afp_stats_begin();
+		int fd = _(::openat(dirfd, path.c_str(), O_RDONLY | O_NONBLOCK), ec);
+		afp_stats_end(AFP_STATS_OPEN, t, fd);
+		if (fd >= 0 && !regular_file(fd, ec, st)) {
 			::close(fd);
 			fd = -1;
 		}
 		return fd;
 	}
 
+	/*
+	 * a path based lookup failed with ENODATA; stat once so a directory or
+	 * special file is reported the same way openX reports it.
+	 */
+	void classify(const std::string &path, std::error_code &ec) {
+		if (ec.value() != ENODATA) return;
+
+		struct stat st;
+		if (_(::stat(path.c_str(), &st), ec) < 0) return;
+		if (S_ISDIR(st.st_mode))
+			ec = std::make_error_code(std::errc::is_a_directory);
+		else if (!S_ISREG(st.st_mode))
+			ec = std::make_error_code(std::errc::invalid_seek); // ESPIPE.
+	}
+
 #endif
 
 
@@ -216,125 +247,30 @@ extern "C" int remap_os_error(unsigned long);
 
 
 
-	int hex(uint8_t c)
-	{
-		if (c >= '0' && c <= '9') return c - '0';
-		if (c >= 'a' && c <= 'f') return c + 10 - 'a';
-		if (c >= 'A' && c <= 'F') return c + 10 - 'A';
-		return 0;
+	uint32_t read32(const uint8_t *cp) {
+		return (uint32_t)cp[0] << 24 | cp[1] << 16 | cp[2] << 8 | cp[3];
 	}
 
-
-	bool finder_info_to_filetype(const uint8_t *buffer, uint16_t *file_type, uint32_t *aux_type) {
-
-		if (!memcmp("pdos", buffer + 4, 4))
-		{
-			if (buffer[0] == 'p') {
-				*file_type = buffer[1];
-				*aux_type = (buffer[2] << 8) | buffer[3];
-				return true;
-			}
-			if (!memcmp("PSYS", buffer, 4)) {
-				*file_type = 0xff;
-				*aux_type = 0x0000;
-				return true;
-			}
-			if (!memcmp("PS16", buffer, 4)) {
-				*file_type = 0xb3;
-				*aux_type = 0x0000;
-				return true;
-			}
-
-			// old mpw method for encoding.
-			if (!isxdigit(buffer[0]) && isxdigit(buffer[1]) && buffer[2] == ' ' && buffer[3] == ' ')
-			{
-				*file_type = (hex(buffer[0]) << 8) | hex(buffer[1]);
-				*aux_type = 0;
-				return true;
-			}
-		}
-		if (!memcmp("TEXT", buffer, 4)) {
-			*file_type = 0x04;
-			*aux_type = 0x0000;
-			return true;
-		}
-		if (!memcmp("BINA", buffer, 4)) {
-			*file_type = 0x00;
-			*aux_type = 0x0000;
-			return true;
-		}
-		if (!memcmp("dImgdCpy", buffer, 8)) {
-			*file_type = 0xe0;
-			*aux_type = 0x0005;
-			return true;
-		}
-
-		if (!memcmp("MIDI", buffer, 4)) {
-			*file_type = 0xd7;
-			*aux_type = 0x0000;
-			return true;
-		}
-
-		if (!memcmp("AIFF", buffer, 4)) {
-			*file_type = 0xd8;
-			*aux_type = 0x0000;
-			return true;
-		}
-
-		if (!memcmp("AIFC", buffer, 4)) {
-			*file_type = 0xd8;
-			*aux_type = 0x0001;
-			return true;
-		}
-
-		return false;
+	void write32(uint8_t *cp, uint32_t x) {
+		cp[0] = x >> 24;
+		cp[1] = x >> 16;
+		cp[2] = x >> 8;
+		cp[3] = x;
 	}
 
-	bool file_type_to_finder_info(uint8_t *buffer, uint16_t file_type, uint32_t aux_type) {
-		if (file_type > 0xff || aux_type > 0xffff) return false;
-
-		if (!file_type && aux_type == 0x0000) {
-			memcpy(buffer, "BINApdos", 8);
-			return true;
-		}
-
-		if (file_type == 0x04 && aux_type == 0x0000) {
-			memcpy(buffer, "TEXTpdos", 8);
-			return true;
-		}
-
-		if (file_type == 0xff && aux_type == 0x0000) {
-			memcpy(buffer, "PSYSpdos", 8);
-			return true;
-		}
-
-		if (file_type == 0xb3 && aux_type == 0x0000) {
-			memcpy(buffer, "PS16pdos", 8);
-			return true;
-		}
-
-		if (file_type == 0xd7 && aux_type == 0x0000) {
-			memcpy(buffer, "MIDIpdos", 8);
-			return true;
-		}
-		if (file_type == 0xd8 && aux_type == 0x0000) {
-			memcpy(buffer, "AIFFpdos", 8);
-			return true;
-		}
-		if (file_type == 0xd8 && aux_type == 0x0001) {
-			memcpy(buffer, "AIFCpdos", 8);
-			return true;
-		}
-		if (file_type == 0xe0 && aux_type == 0x0005) {
-			memcpy(buffer, "dImgdCpy", 8);
-			return true;
-		}
-
+	bool unpack_file_type(const uint8_t *buffer, uint16_t *file_type, uint32_t *aux_type) {
+		auto rv = afp::finder_info_to_filetype(read32(buffer), read32(buffer + 4));
+		if (!rv.ok) return false;
+		*file_type = rv.file_type;
+		*aux_type = rv.aux_type;
+		return true;
+	}
 
-		memcpy(buffer, "p   pdos", 8);
-		buffer[1] = (file_type) & 0xff;
-		buffer[2] = (aux_type >> 8) & 0xff;
-		buffer[3] = (aux_type) & 0xff;
+	bool pack_file_type(uint8_t *buffer, uint16_t file_type, uint32_t aux_type) {
+		auto rv = afp::file_type_to_finder_info(file_type, aux_type);
+		if (!rv.ok) return false;
+		write32(buffer, rv.type);
+		write32(buffer + 4, rv.creator);
 		return true;
 	}
 
@@ -367,7 +303,7 @@ int afp_to_filetype(struct AFP_Info *info, uint16_t *file_type, uint32_t *aux_ty
 		*aux_type = info->prodos_aux_type;
 		return 0;
 	}
-	int ok = finder_info_to_filetype(info->finder_info, file_type, aux_type);
+	int ok = unpack_file_type(info->finder_info, file_type, aux_type);
 	if (ok == 0) {
 		info->prodos_file_type = *file_type;
 		info->prodos_aux_type = *aux_type;
@@ -385,12 +321,12 @@ void afp_synchronize(struct AFP_Info *info, int trust) {
 	// prodos as source of truth.
 	uint16_t f = 0;
 	uint32_t a = 0;
-	if (finder_info_to_filetype(info->finder_info, &f, &a)) {
+	if (unpack_file_type(info->finder_info, &f, &a)) {
 		if (f == info->prodos_file_type && a == info->prodos_aux_type) return;
 	}
 
 	if (trust == trust_prodos)
-		file_type_to_finder_info(info->finder_info, info->prodos_file_type, info->prodos_aux_type);
+		pack_file_type(info->finder_info, info->prodos_file_type, info->prodos_aux_type);
 	else {
 		info->prodos_file_type = f;
 		info->prodos_aux_type = a;
@@ -433,38 +369,54 @@ void finder_info::clear() {
 	afp_init(&_afp);
 }
 
+finder_info_data finder_info::value() const {
+	finder_info_data rv;
+	std::memcpy(rv.finder_info, _afp.finder_info, sizeof(rv.finder_info));
+	rv.prodos_file_type = _afp.prodos_file_type;
+	rv.prodos_aux_type = _afp.prodos_aux_type;
+	rv.reserved = 0;
+	return rv;
+}
+
+void finder_info::assign(const finder_info_data &data) {
+	std::memcpy(_afp.finder_info, data.finder_info, sizeof(_afp.finder_info));
+	_afp.prodos_file_type = data.prodos_file_type;
+	_afp.prodos_aux_type = data.prodos_aux_type;
+}
+
 #else
 finder_info::finder_info() {
-	memset(_finder_info, 0, sizeof(_finder_info));
 }
 
 finder_info::finder_info(finder_info &&rhs) {
 	std::swap(_fd, rhs._fd);
-	std::memcpy(_finder_info, rhs._finder_info, sizeof(_finder_info));
-	_prodos_file_type = rhs._prodos_file_type;
-	_prodos_aux_type = rhs._prodos_aux_type;
+	std::swap(_owned, rhs._owned);
+	_data = rhs._data;
 }
 
 finder_info &finder_info::operator=(finder_info &&rhs) {
 	if (this != &rhs) {
 		close();
 		std::swap(_fd, rhs._fd);
-		std::memcpy(_finder_info, &rhs._finder_info, sizeof(_finder_info));
-		_prodos_file_type = rhs._prodos_file_type;
-		_prodos_aux_type = rhs._prodos_aux_type;
+		std::swap(_owned, rhs._owned);
+		_data = rhs._data;
 	}
 	return *this;
 }
 
 
 void finder_info::close() {
-	if (_fd >= 0) ::close(_fd);
+	trace_hooks::scope t(_fd >= 0 ? afp::trace::finder_info_close : afp::trace::none, this);
+	if (_fd >= 0 && _owned) ::close(_fd);
 	_fd = -1;
+	_owned = true;
 }
 void finder_info::clear() {
-	std::memset(_finder_info, 0, sizeof(_finder_info));
-	_prodos_file_type = 0;
-	_prodos_aux_type = 0;
+	_data.clear();
+}
+
+void finder_info::assign(const finder_info_data &data) {
+	_data = data;
 }
 
 
@@ -639,13 +591,29 @@ bool finder_info::write(const std::wstring &path, std::error_code &ec) {
 	return true;
 }
 
+bool finder_info::read_fast(const std::string &path, std::error_code &ec) {
+	return open(path, read_only, ec);
+}
+
 
 #elif defined(__sun__)
-bool finder_info::open(const std::string &path, open_mode mode, std::error_code &ec) {
+bool finder_info::open_at(int dirfd, const std::string &path, open_mode mode, std::error_code &ec) {
 	ec.clear();
 	close();
 	clear();
 
+	// attropen is a front end for open / openat.
+	// do it ourselves so we can distinguish file doesn't exist vs attr doesn't exist.
+
+	int fd = openX(dirfd, path, ec);
+	if (ec) return false;
+
+	return open_fd(fd, true, mode, ec);
+}
+
+/* opens the attribute relative to the file's descriptor */
+bool finder_info::open_fd(int fd, bool owned, open_mode mode, std::error_code &ec) {
+
 	int umode = 0;
 	switch(mode) {
 		case read_only: umode = O_RDONLY; break;
@@ -653,14 +621,8 @@ bool finder_info::open(const std::string &path, open_mode mode, std::error_code
 		case write_only: umode = O_WRONLY | O_CREAT | O_TRUNC; break;
 	}
 
-	// attropen is a front end for open / openat.
-	// do it ourselves so we can distinguish file doesn't exist vs attr doesn't exist.
-
-	int fd = openX(path, ec);
-	if (ec) return false;
-
 	_fd = _(::openat(fd, XATTR_FINDERINFO_NAME, umode | O_XATTR, 0666), ec);
-	::close(fd);
+	if (owned) ::close(fd);
 
 	if (ec) {
 		if (ec.value() == ENOENT)
@@ -674,40 +636,77 @@ bool finder_info::open(const std::string &path, open_mode mode, std::error_code
 		if (mode == read_only) close();
 		if (ec && mode == read_only) return false;
 
-		finder_info_to_filetype(_finder_info, &_prodos_file_type, &_prodos_aux_type);
+		unpack_file_type(_finder_info, &_prodos_file_type, &_prodos_aux_type);
 	}
 	return true;
 }
 
 bool finder_info::write(std::error_code &ec) {
+	trace_hooks::scope t(afp::trace::finder_info_write, this, ec);
+	AFP_PROBE1(finder_info__write__entry, _fd);
+	AFP_PROBE_RETURN(AFP_PROBE2(finder_info__write__return, _fd, ec.value()));
 	ec.clear();
 	auto ok = _(::pwrite(_fd, _finder_info, 32, 0), ec);
 	if (ec) return false;
 	return true;
 }
 
-bool finder_info::write(const std::string &path, std::error_code &ec) {
+bool finder_info::write_at(int dirfd, const std::string &path, std::error_code &ec) {
 	ec.clear();
 
-	int e;
-
-	// attropen safe to use here.
-	int fd = _(::attropen(path.c_str(), XATTR_FINDERINFO_NAME, O_WRONLY | O_CREAT | O_TRUNC, 0666), ec);
+	// same as attropen, but relative to dirfd.
+	int base = _(::openat(dirfd, path.c_str(), O_RDONLY), ec);
+	if (ec) return false;
+	int fd = _(::openat(base, XATTR_FINDERINFO_NAME, O_WRONLY | O_CREAT | O_TRUNC | O_XATTR, 0666), ec);
+	::close(base);
 	if (ec) return false;
 	auto ok = _(::pwrite(fd, _finder_info, 32, 0), ec);
 	::close(fd);
 	if (ec) return false;
 	return true;
 }
+
+bool finder_info::read_fast(const std::string &path, std::error_code &ec) {
+	trace_hooks::scope t(afp::trace::finder_info_read_fast, this, ec);
+	t.path(path);
+	return open(path, read_only, ec);
+}
 #else
-bool finder_info::open(const std::string &path, open_mode mode, std::error_code &ec) {
+bool finder_info::open_at(int dirfd, const std::string &path, open_mode mode, std::error_code &ec) {
 	ec.clear();
 	close();
 	clear();
 
-	_fd = openX(path, ec);
+	struct stat st;
+	int fd = openX(dirfd, path, ec, &st);
 	if (ec) return false;
 
+	if (mode != read_only || !metadata_cache::enabled())
+		return open_fd(fd, true, mode, ec);
+
+	bool present;
+	if (metadata_cache::find_finder_info(st, _data, present)) {
+		::close(fd);
+		if (present) return true;
+		ec = std::error_code(ENODATA, std::system_category());
+		return false;
+	}
+
+	bool settled = metadata_cache::settled(st);
+	bool ok = open_fd(fd, true, mode, ec);
+	if (settled) {
+		if (ok) metadata_cache::store_finder_info(st, _data);
+		else if (ec.value() == ENODATA) metadata_cache::store_no_finder_info(st);
+	}
+	return ok;
+}
+
+/* the finder info is read through the file's own descriptor */
+bool finder_info::open_fd(int fd, bool owned, open_mode mode, std::error_code &ec) {
+
+	_fd = fd;
+	_owned = owned;
+
 	if (mode == read_only || mode == read_write) {
 		auto ok = _(::read_xattr(_fd, XATTR_FINDERINFO_NAME, _finder_info, 32), ec);
 		if (mode == read_only) close();
@@ -719,12 +718,32 @@ bool finder_info::open(const std::string &path, open_mode mode, std::error_code
 				return false;
 			}
 		}
-		finder_info_to_filetype(_finder_info, &_prodos_file_type, &_prodos_aux_type);
+		unpack_file_type(_finder_info, &_prodos_file_type, &_prodos_aux_type);
+	}
+	return true;
+}
+
+bool finder_info::read_fast(const std::string &path, std::error_code &ec) {
+	trace_hooks::scope t(afp::trace::finder_info_read_fast, this, ec);
+	t.path(path);
+	ec.clear();
+	close();
+	clear();
+
+	_(::read_xattr_path(path.c_str(), XATTR_FINDERINFO_NAME, _finder_info, 32), ec);
+	if (ec) {
+		remap_enoattr(ec);
+		classify(path, ec);
+		return false;
 	}
+	unpack_file_type(_finder_info, &_prodos_file_type, &_prodos_aux_type);
 	return true;
 }
 
 bool finder_info::write(std::error_code &ec) {
+	trace_hooks::scope t(afp::trace::finder_info_write, this, ec);
+	AFP_PROBE1(finder_info__write__entry, _fd);
+	AFP_PROBE_RETURN(AFP_PROBE2(finder_info__write__return, _fd, ec.value()));
 	ec.clear();
 	// n.b. no way to differentiate closed vs opened read-only.
 	auto ok = _(::write_xattr(_fd, XATTR_FINDERINFO_NAME, _finder_info, 32), ec);
@@ -735,10 +754,10 @@ bool finder_info::write(std::error_code &ec) {
 	return true;
 }
 
-bool finder_info::write(const std::string &path, std::error_code &ec) {
+bool finder_info::write_at(int dirfd, const std::string &path, std::error_code &ec) {
 	ec.clear();
 
-	int fd = _(::open(path.c_str(), O_RDONLY), ec);
+	int fd = _(::openat(dirfd, path.c_str(), O_RDONLY), ec);
 	if (ec) return false;
 
 	auto ok = _(::write_xattr(fd, XATTR_FINDERINFO_NAME, _finder_info, 32), ec);
@@ -753,12 +772,63 @@ bool finder_info::write(const std::string &path, std::error_code &ec) {
 
 #endif
 
+#if !defined(_WIN32)
+bool finder_info::open(const std::string &path, open_mode mode, std::error_code &ec) {
+	trace_hooks::scope t(afp::trace::finder_info_open, this, ec);
+	t.path(path).mode(mode);
+	AFP_PROBE3(finder_info__open__entry, AT_FDCWD, path.c_str(), (int)mode);
+	bool ok = open_at(AT_FDCWD, path, mode, ec);
+	AFP_PROBE3(finder_info__open__return, AT_FDCWD, path.c_str(), ec.value());
+	return ok;
+}
+
+bool finder_info::open(const directory &dir, const std::string &name, open_mode mode, std::error_code &ec) {
+	trace_hooks::scope t(afp::trace::finder_info_open, this, ec);
+	t.path(name).mode(mode);
+	AFP_PROBE3(finder_info__open__entry, dir.fd(), name.c_str(), (int)mode);
+	bool ok = open_at(dir.fd(), name, mode, ec);
+	AFP_PROBE3(finder_info__open__return, dir.fd(), name.c_str(), ec.value());
+	return ok;
+}
+
+bool finder_info::write(const std::string &path, std::error_code &ec) {
+	trace_hooks::scope t(afp::trace::finder_info_write_path, this, ec);
+	t.path(path);
+	AFP_PROBE2(finder_info__write_path__entry, AT_FDCWD, path.c_str());
+	bool ok = write_at(AT_FDCWD, path, ec);
+	AFP_PROBE3(finder_info__write_path__return, AT_FDCWD, path.c_str(), ec.value());
+	return ok;
+}
+
+bool finder_info::write(const directory &dir, const std::string &name, std::error_code &ec) {
+	trace_hooks::scope t(afp::trace::finder_info_write_path, this, ec);
+	t.path(name);
+	AFP_PROBE2(finder_info__write_path__entry, dir.fd(), name.c_str());
+	bool ok = write_at(dir.fd(), name, ec);
+	AFP_PROBE3(finder_info__write_path__return, dir.fd(), name.c_str(), ec.value());
+	return ok;
+}
+
+bool finder_info::attach(int fd, open_mode mode, unsigned flags, std::error_code &ec) {
+	trace_hooks::scope t(afp::trace::finder_info_attach, this, ec);
+	t.mode(mode).size(flags);
+	ec.clear();
+	close();
+	clear();
+
+	if (!(flags & trusted) && !regular_file(fd, ec)) {
+		if (flags & adopt) ::close(fd);
+		return false;
+	}
+	return open_fd(fd, flags & adopt, mode, ec);
+}
+#endif
 
 
 void finder_info::set_prodos_file_type(uint16_t ftype, uint32_t atype) {
 	_prodos_file_type = ftype;
 	_prodos_aux_type = atype;
-	file_type_to_finder_info(_finder_info, ftype, atype);
+	pack_file_type(_finder_info, ftype, atype);
 }
 
 
@@ -767,39 +837,21 @@ void finder_info::set_prodos_file_type(uint16_t ftype) {
 }
 
 bool finder_info::is_text() const {
-	if (memcmp(_finder_info, "TEXT", 4) == 0) return true;
-	if (_prodos_file_type == 0x04) return true;
-	if (_prodos_file_type == 0xb0) return true;
-
-	return false;
+	return value().is_text();
 }
 
 bool finder_info::is_binary() const {
-	if (is_text()) return false;
-	if (_prodos_file_type || _prodos_aux_type) return true;
-
-	if (memcmp(_finder_info, "\x00\x00\x00\x00\x00\x00\x00\x00", 8) == 0) return false;
-	return true;
+	return value().is_binary();
 }
 
 
 
 uint32_t finder_info::file_type() const {
-	uint32_t rv = 0;
-	for (unsigned i = 0; i < 4; ++i) {
-		rv <<= 8;
-		rv |= _finder_info[i];
-	}
-	return rv;
+	return value().file_type();
 }
 
 uint32_t finder_info::creator_type() const {
-	uint32_t rv = 0;
-	for (unsigned i = 4; i < 8; ++i) {
-		rv <<= 8;
-		rv |= _finder_info[i];
-	}
-	return rv;
+	return value().creator_type();
 }
 
 void finder_info::set_file_type(uint32_t x) {
@@ -821,4 +873,55 @@ void finder_info::set_data(const uint8_t *data, unsigned length) {
 	memcpy(_finder_info, data, std::min(32u, length));
 }
 
+void finder_info::assign(const uint8_t *data, unsigned length) {
+	memset(_finder_info, 0, sizeof(_finder_info));
+	memcpy(_finder_info, data, std::min(32u, length));
+	_prodos_file_type = 0;
+	_prodos_aux_type = 0;
+	unpack_file_type(_finder_info, &_prodos_file_type, &_prodos_aux_type);
+}
+
+
+
+bool read_finder_info(const std::string &path, finder_info_data &data, std::error_code &ec) {
+	finder_info fi;
+	if (!fi.read_fast(path, ec)) return false;
+	data = fi.value();
+	return true;
+}
+
+bool write_finder_info(const std::string &path, const finder_info_data &data, std::error_code &ec) {
+	finder_info fi;
+	fi.assign(data);
+	return fi.write(path, ec);
+}
+
+#if defined(_WIN32)
+bool read_finder_info(const std::wstring &path, finder_info_data &data, std::error_code &ec) {
+	finder_info fi;
+	if (!fi.read(path, ec)) return false;
+	data = fi.value();
+	return true;
+}
+
+bool write_finder_info(const std::wstring &path, const finder_info_data &data, std::error_code &ec) {
+	finder_info fi;
+	fi.assign(data);
+	return fi.write(path, ec);
+}
+#else
+bool read_finder_info(const directory &dir, const std::string &name, finder_info_data &data, std::error_code &ec) {
+	finder_info fi;
+	if (!fi.read(dir, name, ec)) return false;
+	data = fi.value();
+	return true;
+}
+
+bool write_finder_info(const directory &dir, const std::string &name, const finder_info_data &data, std::error_code &ec) {
+	finder_info fi;
+	fi.assign(data);
+	return fi.write(dir, name, ec);
+}
+#endif
+
 }
@@ -0,0 +1,523 @@
+#include "finder_info_table.h"
+#include "finder_info.h"
+#include "file_type.h"
+
+#include <atomic>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define AFP_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace {
+
+	using afp::finder_info_table;
+
+	enum : uint32_t {
+		TEXT = 0x54455854,
+	};
+
+	struct columns {
+		const uint32_t *type;
+		const uint32_t *creator;
+		const uint16_t *file_type;
+		const uint32_t *aux_type;
+		size_t size;
+	};
+
+	uint32_t read32(const uint8_t *cp) {
+		return (uint32_t)cp[0] << 24 | cp[1] << 16 | cp[2] << 8 | cp[3];
+	}
+
+	/*
+	 * scalar kernels, which also finish the rows left over by the vector
+	 * ones (rows i .. size).
+	 */
+
+	inline bool is_text(uint32_t type, uint16_t file_type) {
+		return type == TEXT || file_type == 0x04 || file_type == 0xb0;
+	}
+
+	size_t text_rows(const columns &c, size_t i, uint8_t *out) {
+		size_t count = 0;
+		for (; i < c.size; ++i) {
+			out[i] = is_text(c.type[i], c.file_type[i]);
+			count += out[i];
+		}
+		return count;
+	}
+
+	size_t binary_rows(const columns &c, size_t i, uint8_t *out) {
+		size_t count = 0;
+		for (; i < c.size; ++i) {
+			out[i] = !is_text(c.type[i], c.file_type[i])
+				&& (c.type[i] | c.creator[i] | c.file_type[i] | c.aux_type[i]) != 0;
+			count += out[i];
+		}
+		return count;
+	}
+
+	size_t match_rows(const columns &c, size_t i, uint32_t type, uint32_t type_mask,
+		uint32_t creator, uint32_t creator_mask, uint8_t *out) {
+		size_t count = 0;
+		for (; i < c.size; ++i) {
+			out[i] = (c.type[i] & type_mask) == type && (c.creator[i] & creator_mask) == creator;
+			count += out[i];
+		}
+		return count;
+	}
+
+	void decode_row(const uint32_t *type, const uint32_t *creator, uint16_t *file_type, uint32_t *aux_type, size_t i) {
+		auto rv = afp::finder_info_to_filetype(type[i], creator[i]);
+		file_type[i] = rv.ok ? rv.file_type : 0;
+		aux_type[i] = rv.ok ? rv.aux_type : 0;
+	}
+
+	void decode_rows(const uint32_t *type, const uint32_t *creator, uint16_t *file_type, uint32_t *aux_type, size_t i, size_t n) {
+		for (; i < n; ++i) decode_row(type, creator, file_type, aux_type, i);
+	}
+
+	size_t text_scalar(const columns &c, uint8_t *out) {
+		return text_rows(c, 0, out);
+	}
+
+	size_t binary_scalar(const columns &c, uint8_t *out) {
+		return binary_rows(c, 0, out);
+	}
+
+	size_t match_scalar(const columns &c, uint32_t type, uint32_t type_mask, uint32_t creator, uint32_t creator_mask, uint8_t *out) {
+		return match_rows(c, 0, type & type_mask, type_mask, creator & creator_mask, creator_mask, out);
+	}
+
+	void decode_scalar(const uint32_t *type, const uint32_t *creator, uint16_t *file_type, uint32_t *aux_type, size_t n) {
+		decode_rows(type, creator, file_type, aux_type, 0, n);
+	}
+
+
+#if defined(AFP_X86_KERNELS)
+
+	/*
+	 * SSE2 / AVX2 kernels.  They're compiled with target attributes rather
+	 * than -msse2 / -mavx2, so the rest of the library runs on any x86 and
+	 * these are only called once the CPU is known to have them.
+	 *
+	 * masks are built 32 bits per row from the type, creator and aux type
+	 * columns, packed to 16 bits to meet the file type column, and packed
+	 * again to a byte per row.
+	 */
+
+	#define AFP_SSE2 __attribute__((target("sse2")))
+	#define AFP_AVX2 __attribute__((target("avx2")))
+
+	AFP_SSE2 inline __m128i load128(const void *p) {
+		return _mm_loadu_si128((const __m128i *)p);
+	}
+
+	AFP_SSE2 inline __m128i select128(__m128i mask, __m128i a, __m128i b) {
+		return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+	}
+
+	/* stores a 0 / -1 byte mask as 0 / 1 and counts the rows set */
+	AFP_SSE2 inline size_t store_mask(__m128i mask, uint8_t *out) {
+		_mm_storeu_si128((__m128i *)out, _mm_and_si128(mask, _mm_set1_epi8(1)));
+		return __builtin_popcount(_mm_movemask_epi8(mask));
+	}
+
+	/* the masks below are for rows i .. i + 15 */
+
+	AFP_SSE2 inline __m128i text16_sse2(const columns &c, size_t i) {
+		const __m128i text = _mm_set1_epi32(TEXT);
+		const __m128i txt = _mm_set1_epi16(0x04);
+		const __m128i src = _mm_set1_epi16(0xb0);
+
+		__m128i lo = _mm_packs_epi32(
+			_mm_cmpeq_epi32(load128(c.type + i), text),
+			_mm_cmpeq_epi32(load128(c.type + i + 4), text));
+		__m128i hi = _mm_packs_epi32(
+			_mm_cmpeq_epi32(load128(c.type + i + 8), text),
+			_mm_cmpeq_epi32(load128(c.type + i + 12), text));
+
+		__m128i f0 = load128(c.file_type + i);
+		__m128i f1 = load128(c.file_type + i + 8);
+		lo = _mm_or_si128(lo, _mm_or_si128(_mm_cmpeq_epi16(f0, txt), _mm_cmpeq_epi16(f0, src)));
+		hi = _mm_or_si128(hi, _mm_or_si128(_mm_cmpeq_epi16(f1, txt), _mm_cmpeq_epi16(f1, src)));
+		return _mm_packs_epi16(lo, hi);
+	}
+
+	AFP_SSE2 inline __m128i zero32_sse2(const columns &c, size_t i) {
+		__m128i x = _mm_or_si128(load128(c.type + i), _mm_or_si128(load128(c.creator + i), load128(c.aux_type + i)));
+		return _mm_cmpeq_epi32(x, _mm_setzero_si128());
+	}
+
+	/* rows with no type, creator, file type or aux type */
+	AFP_SSE2 inline __m128i zero16_sse2(const columns &c, size_t i) {
+		const __m128i zero = _mm_setzero_si128();
+		__m128i lo = _mm_packs_epi32(zero32_sse2(c, i), zero32_sse2(c, i + 4));
+		__m128i hi = _mm_packs_epi32(zero32_sse2(c, i + 8), zero32_sse2(c, i + 12));
+		lo = _mm_and_si128(lo, _mm_cmpeq_epi16(load128(c.file_type + i), zero));
+		hi = _mm_and_si128(hi, _mm_cmpeq_epi16(load128(c.file_type + i + 8), zero));
+		return _mm_packs_epi16(lo, hi);
+	}
+
+	AFP_SSE2 size_t text_sse2(const columns &c, uint8_t *out) {
+		size_t i = 0, count = 0;
+		for (; i + 16 <= c.size; i += 16)
+			count += store_mask(text16_sse2(c, i), out + i);
+		return count + text_rows(c, i, out);
+	}
+
+	AFP_SSE2 size_t binary_sse2(const columns &c, uint8_t *out) {
+		const __m128i ones = _mm_set1_epi8(-1);
+		size_t i = 0, count = 0;
+		for (; i + 16 <= c.size; i += 16) {
+			__m128i not_binary = _mm_or_si128(text16_sse2(c, i), zero16_sse2(c, i));
+			count += store_mask(_mm_xor_si128(not_binary, ones), out + i);
+		}
+		return count + binary_rows(c, i, out);
+	}
+
+	AFP_SSE2 inline __m128i match4_sse2(const columns &c, size_t i, __m128i t, __m128i tm, __m128i cr, __m128i cm) {
+		return _mm_and_si128(
+			_mm_cmpeq_epi32(_mm_and_si128(load128(c.type + i), tm), t),
+			_mm_cmpeq_epi32(_mm_and_si128(load128(c.creator + i), cm), cr));
+	}
+
+	AFP_SSE2 size_t match_sse2(const columns &c, uint32_t type, uint32_t type_mask, uint32_t creator, uint32_t creator_mask, uint8_t *out) {
+		type &= type_mask;
+		creator &= creator_mask;
+		const __m128i t = _mm_set1_epi32(type), tm = _mm_set1_epi32(type_mask);
+		const __m128i cr = _mm_set1_epi32(creator), cm = _mm_set1_epi32(creator_mask);
+
+		size_t i = 0, count = 0;
+		for (; i + 16 <= c.size; i += 16) {
+			__m128i lo = _mm_packs_epi32(match4_sse2(c, i, t, tm, cr, cm), match4_sse2(c, i + 4, t, tm, cr, cm));
+			__m128i hi = _mm_packs_epi32(match4_sse2(c, i + 8, t, tm, cr, cm), match4_sse2(c, i + 12, t, tm, cr, cm));
+			count += store_mask(_mm_packs_epi16(lo, hi), out + i);
+		}
+		return count + match_rows(c, i, type, type_mask, creator, creator_mask, out);
+	}
+
+	/*
+	 * ProDOS decoding, 4 (8) rows at a time: the fixed mappings are compared
+	 * against every row (their types are distinct, so at most one matches),
+	 * then 'p' $uv $wx $yz / 'pdos' rows are decoded in place.  Rows that
+	 * may be the old MPW encoding (rare) go through the scalar code.
+	 */
+	AFP_SSE2 void decode_sse2(const uint32_t *type, const uint32_t *creator, uint16_t *file_type, uint32_t *aux_type, size_t n) {
+		using namespace afp::file_type_detail;
+
+		struct {
+			__m128i type[mapping_count], creator[mapping_count], creator_mask[mapping_count];
+			__m128i file_type[mapping_count], aux_type[mapping_count];
+		} mv;
+		for (unsigned k = 0; k < mapping_count; ++k) {
+			const mapping &m = mapping_at(k);
+			mv.type[k] = _mm_set1_epi32(m.type);
+			mv.creator[k] = _mm_set1_epi32(m.any_creator ? 0 : m.creator);
+			mv.creator_mask[k] = _mm_set1_epi32(m.any_creator ? 0 : ~0);
+			mv.file_type[k] = _mm_set1_epi32(m.file_type);
+			mv.aux_type[k] = _mm_set1_epi32(m.aux_type);
+		}
+		const __m128i p = _mm_set1_epi32('p');
+		const __m128i pd = _mm_set1_epi32(pdos);
+		const __m128i spaces = _mm_set1_epi32(0x2020);
+		const __m128i low8 = _mm_set1_epi32(0xff);
+		const __m128i low16 = _mm_set1_epi32(0xffff);
+
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			__m128i t = load128(type + i);
+			__m128i c = load128(creator + i);
+
+			__m128i ft = _mm_setzero_si128();
+			__m128i aux = _mm_setzero_si128();
+			for (unsigned k = 0; k < mapping_count; ++k) {
+				__m128i m = _mm_and_si128(_mm_cmpeq_epi32(t, mv.type[k]),
+					_mm_cmpeq_epi32(_mm_and_si128(c, mv.creator_mask[k]), mv.creator[k]));
+				ft = _mm_or_si128(ft, _mm_and_si128(m, mv.file_type[k]));
+				aux = _mm_or_si128(aux, _mm_and_si128(m, mv.aux_type[k]));
+			}
+
+			__m128i is_pdos = _mm_cmpeq_epi32(c, pd);
+			__m128i direct = _mm_and_si128(is_pdos, _mm_cmpeq_epi32(_mm_srli_epi32(t, 24), p));
+			ft = select128(direct, _mm_and_si128(_mm_srli_epi32(t, 16), low8), ft);
+			aux = select128(direct, _mm_and_si128(t, low16), aux);
+
+			_mm_storel_epi64((__m128i *)(file_type + i), _mm_packs_epi32(ft, ft));
+			_mm_storeu_si128((__m128i *)(aux_type + i), aux);
+
+			__m128i mpw = _mm_andnot_si128(direct, _mm_and_si128(is_pdos, _mm_cmpeq_epi32(_mm_and_si128(t, low16), spaces)));
+			int lanes = _mm_movemask_ps(_mm_castsi128_ps(mpw));
+			for (unsigned k = 0; lanes; ++k, lanes >>= 1) {
+				if (lanes & 1) decode_row(type, creator, file_type, aux_type, i + k);
+			}
+		}
+		decode_rows(type, creator, file_type, aux_type, i, n);
+	}
+
+
+	AFP_AVX2 inline __m256i load256(const void *p) {
+		return _mm256_loadu_si256((const __m256i *)p);
+	}
+
+	/* 2 x 8 32-bit masks -> 16 16-bit masks, in row order (packs works within 128-bit lanes) */
+	AFP_AVX2 inline __m256i pack32_avx2(__m256i a, __m256i b) {
+		return _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xd8);
+	}
+
+	/* 16 16-bit masks -> 16 byte masks */
+	AFP_AVX2 inline __m128i pack16_avx2(__m256i a) {
+		return _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packs_epi16(a, a), 0xd8));
+	}
+
+	AFP_AVX2 inline __m128i text16_avx2(const columns &c, size_t i) {
+		const __m256i text = _mm256_set1_epi32(TEXT);
+		const __m256i txt = _mm256_set1_epi16(0x04);
+		const __m256i src = _mm256_set1_epi16(0xb0);
+
+		__m256i m = pack32_avx2(
+			_mm256_cmpeq_epi32(load256(c.type + i), text),
+			_mm256_cmpeq_epi32(load256(c.type + i + 8), text));
+		__m256i f = load256(c.file_type + i);
+		m = _mm256_or_si256(m, _mm256_or_si256(_mm256_cmpeq_epi16(f, txt), _mm256_cmpeq_epi16(f, src)));
+		return pack16_avx2(m);
+	}
+
+	AFP_AVX2 inline __m256i zero32_avx2(const columns &c, size_t i) {
+		__m256i x = _mm256_or_si256(load256(c.type + i), _mm256_or_si256(load256(c.creator + i), load256(c.aux_type + i)));
+		return _mm256_cmpeq_epi32(x, _mm256_setzero_si256());
+	}
+
+	AFP_AVX2 inline __m128i zero16_avx2(const columns &c, size_t i) {
+		__m256i m = pack32_avx2(zero32_avx2(c, i), zero32_avx2(c, i + 8));
+		m = _mm256_and_si256(m, _mm256_cmpeq_epi16(load256(c.file_type + i), _mm256_setzero_si256()));
+		return pack16_avx2(m);
+	}
+
+	AFP_AVX2 size_t text_avx2(const columns &c, uint8_t *out) {
+		size_t i = 0, count = 0;
+		for (; i + 16 <= c.size; i += 16)
+			count += store_mask(text16_avx2(c, i), out + i);
+		return count + text_rows(c, i, out);
+	}
+
+	AFP_AVX2 size_t binary_avx2(const columns &c, uint8_t *out) {
+		const __m128i ones = _mm_set1_epi8(-1);
+		size_t i = 0, count = 0;
+		for (; i + 16 <= c.size; i += 16) {
+			__m128i not_binary = _mm_or_si128(text16_avx2(c, i), zero16_avx2(c, i));
+			count += store_mask(_mm_xor_si128(not_binary, ones), out + i);
+		}
+		return count + binary_rows(c, i, out);
+	}
+
+	AFP_AVX2 inline __m256i match8_avx2(const columns &c, size_t i, __m256i t, __m256i tm, __m256i cr, __m256i cm) {
+		return _mm256_and_si256(
+			_mm256_cmpeq_epi32(_mm256_and_si256(load256(c.type + i), tm), t),
+			_mm256_cmpeq_epi32(_mm256_and_si256(load256(c.creator + i), cm), cr));
+	}
+
+	AFP_AVX2 size_t match_avx2(const columns &c, uint32_t type, uint32_t type_mask, uint32_t creator, uint32_t creator_mask, uint8_t *out) {
+		type &= type_mask;
+		creator &= creator_mask;
+		const __m256i t = _mm256_set1_epi32(type), tm = _mm256_set1_epi32(type_mask);
+		const __m256i cr = _mm256_set1_epi32(creator), cm = _mm256_set1_epi32(creator_mask);
+
+		size_t i = 0, count = 0;
+		for (; i + 16 <= c.size; i += 16)
+			count += store_mask(pack16_avx2(pack32_avx2(
+				match8_avx2(c, i, t, tm, cr, cm), match8_avx2(c, i + 8, t, tm, cr, cm))), out + i);
+		return count + match_rows(c, i, type, type_mask, creator, creator_mask, out);
+	}
+
+	AFP_AVX2 void decode_avx2(const uint32_t *type, const uint32_t *creator, uint16_t *file_type, uint32_t *aux_type, size_t n) {
+		using namespace afp::file_type_detail;
+
+		struct {
+			__m256i type[mapping_count], creator[mapping_count], creator_mask[mapping_count];
+			__m256i file_type[mapping_count], aux_type[mapping_count];
+		} mv;
+		for (unsigned k = 0; k < mapping_count; ++k) {
+			const mapping &m = mapping_at(k);
+			mv.type[k] = _mm256_set1_epi32(m.type);
+			mv.creator[k] = _mm256_set1_epi32(m.any_creator ? 0 : m.creator);
+			mv.creator_mask[k] = _mm256_set1_epi32(m.any_creator ? 0 : ~0);
+			mv.file_type[k] = _mm256_set1_epi32(m.file_type);
+			mv.aux_type[k] = _mm256_set1_epi32(m.aux_type);
+		}
+		const __m256i p = _mm256_set1_epi32('p');
+		const __m256i pd = _mm256_set1_epi32(pdos);
+		const __m256i spaces = _mm256_set1_epi32(0x2020);
+		const __m256i low8 = _mm256_set1_epi32(0xff);
+		const __m256i low16 = _mm256_set1_epi32(0xffff);
+
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			__m256i t = load256(type + i);
+			__m256i c = load256(creator + i);
+
+			__m256i ft = _mm256_setzero_si256();
+			__m256i aux = _mm256_setzero_si256();
+			for (unsigned k = 0; k < mapping_count; ++k) {
+				__m256i m = _mm256_and_si256(_mm256_cmpeq_epi32(t, mv.type[k]),
+					_mm256_cmpeq_epi32(_mm256_and_si256(c, mv.creator_mask[k]), mv.creator[k]));
+				ft = _mm256_or_si256(ft, _mm256_and_si256(m, mv.file_type[k]));
+				aux = _mm256_or_si256(aux, _mm256_and_si256(m, mv.aux_type[k]));
+			}
+
+			__m256i is_pdos = _mm256_cmpeq_epi32(c, pd);
+			__m256i direct = _mm256_and_si256(is_pdos, _mm256_cmpeq_epi32(_mm256_srli_epi32(t, 24), p));
+			ft = _mm256_blendv_epi8(ft, _mm256_and_si256(_mm256_srli_epi32(t, 16), low8), direct);
+			aux = _mm256_blendv_epi8(aux, _mm256_and_si256(t, low16), direct);
+
+			__m256i ft16 = _mm256_permute4x64_epi64(_mm256_packs_epi32(ft, ft), 0xd8);
+			_mm_storeu_si128((__m128i *)(file_type + i), _mm256_castsi256_si128(ft16));
+			_mm256_storeu_si256((__m256i *)(aux_type + i), aux);
+
+			__m256i mpw = _mm256_andnot_si256(direct, _mm256_and_si256(is_pdos, _mm256_cmpeq_epi32(_mm256_and_si256(t, low16), spaces)));
+			int lanes = _mm256_movemask_ps(_mm256_castsi256_ps(mpw));
+			for (unsigned k = 0; lanes; ++k, lanes >>= 1) {
+				if (lanes & 1) decode_row(type, creator, file_type, aux_type, i + k);
+			}
+		}
+		decode_rows(type, creator, file_type, aux_type, i, n);
+	}
+
+	#undef AFP_SSE2
+	#undef AFP_AVX2
+
+#endif
+
+
+	struct kernels {
+		finder_info_table::kernel kind;
+		size_t (*text)(const columns &, uint8_t *);
+		size_t (*binary)(const columns &, uint8_t *);
+		size_t (*match)(const columns &, uint32_t, uint32_t, uint32_t, uint32_t, uint8_t *);
+		void (*decode)(const uint32_t *, const uint32_t *, uint16_t *, uint32_t *, size_t);
+	};
+
+	const kernels scalar_kernels = {
+		finder_info_table::scalar, text_scalar, binary_scalar, match_scalar, decode_scalar
+	};
+
+#if defined(AFP_X86_KERNELS)
+	const kernels sse2_kernels = {
+		finder_info_table::sse2, text_sse2, binary_sse2, match_sse2, decode_sse2
+	};
+
+	const kernels avx2_kernels = {
+		finder_info_table::avx2, text_avx2, binary_avx2, match_avx2, decode_avx2
+	};
+#endif
+
+	/* nullptr if the CPU can't run it */
+	const kernels *find_kernels(finder_info_table::kernel k) {
+	#if defined(AFP_X86_KERNELS)
+		__builtin_cpu_init();
+		bool has_sse2 = __builtin_cpu_supports("sse2");
+		bool has_avx2 = __builtin_cpu_supports("avx2");
+	#else
+		bool has_sse2 = false;
+		bool has_avx2 = false;
+	#endif
+		switch (k) {
+			case finder_info_table::automatic:
+				if (has_avx2) return find_kernels(finder_info_table::avx2);
+				if (has_sse2) return find_kernels(finder_info_table::sse2);
+				return &scalar_kernels;
+			case finder_info_table::scalar:
+				return &scalar_kernels;
+		#if defined(AFP_X86_KERNELS)
+			case finder_info_table::sse2:
+				return has_sse2 ? &sse2_kernels : nullptr;
+			case finder_info_table::avx2:
+				return has_avx2 ? &avx2_kernels : nullptr;
+		#endif
+			default:
+				return nullptr;
+		}
+	}
+
+	std::atomic<const kernels *> current(nullptr);
+
+	const kernels &active() {
+		const kernels *k = current.load(std::memory_order_acquire);
+		if (!k) {
+			k = find_kernels(finder_info_table::automatic);
+			current.store(k, std::memory_order_release);
+		}
+		return *k;
+	}
+
+}
+
+namespace afp {
+
+	void finder_info_table::clear() {
+		_type.clear();
+		_creator.clear();
+		_file_type.clear();
+		_aux_type.clear();
+	}
+
+	void finder_info_table::reserve(size_t n) {
+		_type.reserve(n);
+		_creator.reserve(n);
+		_file_type.reserve(n);
+		_aux_type.reserve(n);
+	}
+
+	void finder_info_table::push_back(uint32_t type, uint32_t creator, uint16_t file_type, uint32_t aux_type) {
+		_type.push_back(type);
+		_creator.push_back(creator);
+		_file_type.push_back(file_type);
+		_aux_type.push_back(aux_type);
+	}
+
+	void finder_info_table::push_back(const finder_info &fi) {
+		push_back(fi.value());
+	}
+
+	void finder_info_table::push_back(const finder_info_data &data) {
+		push_back(data.file_type(), data.creator_type(), data.prodos_file_type, data.prodos_aux_type);
+	}
+
+	void finder_info_table::push_back(const uint8_t *data) {
+		uint32_t type = read32(data);
+		uint32_t creator = read32(data + 4);
+		auto rv = finder_info_to_filetype(type, creator);
+		push_back(type, creator, rv.ok ? rv.file_type : 0, rv.ok ? rv.aux_type : 0);
+	}
+
+	size_t finder_info_table::text_mask(uint8_t *out) const {
+		columns c = { _type.data(), _creator.data(), _file_type.data(), _aux_type.data(), size() };
+		return active().text(c, out);
+	}
+
+	size_t finder_info_table::binary_mask(uint8_t *out) const {
+		columns c = { _type.data(), _creator.data(), _file_type.data(), _aux_type.data(), size() };
+		return active().binary(c, out);
+	}
+
+	size_t finder_info_table::match(uint32_t type, uint32_t type_mask, uint32_t creator, uint32_t creator_mask, uint8_t *out) const {
+		columns c = { _type.data(), _creator.data(), _file_type.data(), _aux_type.data(), size() };
+		return active().match(c, type, type_mask, creator, creator_mask, out);
+	}
+
+	void finder_info_table::decode_prodos() {
+		active().decode(_type.data(), _creator.data(), _file_type.data(), _aux_type.data(), size());
+	}
+
+	finder_info_table::kernel finder_info_table::active_kernel() {
+		return active().kind;
+	}
+
+	bool finder_info_table::set_kernel(kernel k) {
+		const kernels *p = find_kernels(k);
+		if (!p) return false;
+		current.store(p, std::memory_order_release);
+		return true;
+	}
+
+}
@@ -0,0 +1,442 @@
+#include "mac_binary.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace {
+
+	/*
+	 * MacBinary header (128 bytes):
+	 *   +0    version (0)
+	 *   +1    filename length (1-63)
+	 *   +2    filename
+	 *   +65   file type
+	 *   +69   creator
+	 *   +73   finder flags (high byte)
+	 *   +74   0
+	 *   +75   vertical, horizontal position, window / folder id
+	 *   +81   protected flag
+	 *   +82   0
+	 *   +83   data fork length
+	 *   +87   resource fork length
+	 *   +91   creation date
+	 *   +95   modification date
+	 *   +99   get info comment length (II)
+	 *   +101  finder flags (low byte) (II)
+	 *   +102  'mBIN' (III)
+	 *   +106  script (III)
+	 *   +107  extended finder flags (III)
+	 *   +116  total unpacked length (II)
+	 *   +120  secondary header length (II)
+	 *   +122  version used to write (129 = II, 130 = III)
+	 *   +123  minimum version to read (129)
+	 *   +124  CRC of bytes 0-123 (II)
+	 *
+	 * then the secondary header, data fork, resource fork and comment, each
+	 * padded to a multiple of 128 bytes.
+	 */
+
+	enum {
+		header_size = 128,
+		mac_epoch_offset = 2082844800, // 1904-01-01 to 1970-01-01, in seconds.
+	};
+
+	const uint16_t crc_table[256] = {
+		0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+		0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+		0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
+		0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
+		0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
+		0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
+		0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
+		0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
+		0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
+		0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
+		0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
+		0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
+		0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
+		0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
+		0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
+		0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
+		0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
+		0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
+		0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
+		0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
+		0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
+		0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+		0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
+		0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
+		0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
+		0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
+		0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
+		0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
+		0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
+		0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
+		0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
+		0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0,
+	};
+
+	template<class T>
+	T _(T x, std::error_code &ec) {
+		if (x < 0) ec = std::error_code(errno, std::system_category());
+		return x;
+	}
+
+	uint16_t read16(const uint8_t *cp) {
+		return (cp[0] << 8) | cp[1];
+	}
+
+	uint32_t read32(const uint8_t *cp) {
+		return ((uint32_t)cp[0] << 24) | (cp[1] << 16) | (cp[2] << 8) | cp[3];
+	}
+
+	uint8_t *write16(uint8_t *cp, uint16_t x) {
+		cp[0] = x >> 8;
+		cp[1] = x;
+		return cp + 2;
+	}
+
+	uint8_t *write32(uint8_t *cp, uint32_t x) {
+		cp[0] = x >> 24;
+		cp[1] = x >> 16;
+		cp[2] = x >> 8;
+		cp[3] = x;
+		return cp + 4;
+	}
+
+	uint64_t pad(uint64_t x) {
+		return (x + 127) & ~(uint64_t)127;
+	}
+
+	std::string basename(const std::string &path) {
+		auto pos = path.rfind('/');
+		if (pos == path.npos) return path;
+		return path.substr(pos + 1);
+	}
+
+	bool no_data(const std::error_code &ec) {
+		return ec == std::errc::no_message_available;
+	}
+
+	std::error_code bad_stream() {
+		return std::make_error_code(std::errc::illegal_byte_sequence);
+	}
+
+	bool write_all(int fd, const uint8_t *cp, size_t n, std::error_code &ec) {
+		while (n) {
+			auto rv = _(::write(fd, cp, n), ec);
+			if (rv < 0) {
+				if (errno == EINTR) { ec.clear(); continue; }
+				return false;
+			}
+			cp += rv;
+			n -= rv;
+		}
+		return true;
+	}
+
+}
+
+namespace afp {
+
+	uint16_t mac_binary::crc16(const void *data, size_t n, uint16_t crc) {
+		const uint8_t *cp = (const uint8_t *)data;
+		while (n--) crc = (crc << 8) ^ crc_table[(crc >> 8) ^ *cp++];
+		return crc;
+	}
+
+
+	void mac_binary::encoder::close() {
+		_resource_fork.close();
+		if (_fd >= 0) ::close(_fd);
+		_fd = -1;
+		std::memset(_header, 0, sizeof(_header));
+		_data_size = 0;
+		_resource_fork_size = 0;
+		_offset = 0;
+		_size = 0;
+	}
+
+	bool mac_binary::encoder::open(const std::string &path, std::error_code &ec) {
+		ec.clear();
+		close();
+
+		_fd = _(::open(path.c_str(), O_RDONLY | O_CLOEXEC), ec);
+		if (_fd < 0) return false;
+
+		struct stat st;
+		if (_(::fstat(_fd, &st), ec) < 0) {
+			close();
+			return false;
+		}
+		if (!S_ISREG(st.st_mode)) {
+			ec = S_ISDIR(st.st_mode) ?
+				std::make_error_code(std::errc::is_a_directory) :
+				std::make_error_code(std::errc::invalid_seek); // ESPIPE.
+			close();
+			return false;
+		}
+		if (st.st_size > 0xffffffff) {
+			ec = std::make_error_code(std::errc::file_too_large);
+			close();
+			return false;
+		}
+		_data_size = st.st_size;
+
+		afp::finder_info fi;
+		if (!fi.read(path, ec) && !no_data(ec)) {
+			close();
+			return false;
+		}
+
+		if (_resource_fork.open(path, resource_fork::read_only, ec)) {
+			size_t n = _resource_fork.size(ec);
+			if (!ec && n > 0xffffffff) ec = std::make_error_code(std::errc::file_too_large);
+			if (!ec) _resource_fork_size = n;
+		}
+		if (ec && !no_data(ec)) {
+			close();
+			return false;
+		}
+		ec.clear();
+
+		std::string name = basename(path);
+		if (name.size() > 63) name.resize(63);
+
+		const uint8_t *finfo = fi.data();
+		uint32_t date = st.st_mtime + mac_epoch_offset;
+
+		_header[1] = name.size();
+		std::memcpy(_header + 2, name.data(), name.size());
+		std::memcpy(_header + 65, finfo, 8); // type, creator
+		_header[73] = finfo[8];
+		std::memcpy(_header + 75, finfo + 10, 6); // location, folder
+		write32(_header + 83, _data_size);
+		write32(_header + 87, _resource_fork_size);
+		write32(_header + 91, date);
+		write32(_header + 95, date);
+		_header[101] = finfo[9];
+		std::memcpy(_header + 102, "mBIN", 4);
+		_header[106] = finfo[24]; // script
+		_header[107] = finfo[25]; // extended flags
+		_header[122] = 130;
+		_header[123] = 129;
+		write16(_header + 124, crc16(_header, 124));
+
+		_size = header_size + pad(_data_size) + pad(_resource_fork_size);
+		return true;
+	}
+
+	size_t mac_binary::encoder::read(void *buffer, size_t n, std::error_code &ec) {
+		ec.clear();
+
+		uint8_t *cp = (uint8_t *)buffer;
+		size_t count = 0;
+
+		const uint64_t data_end = header_size + (uint64_t)_data_size;
+		const uint64_t rfork_start = header_size + pad(_data_size);
+		const uint64_t rfork_end = rfork_start + _resource_fork_size;
+
+		while (count < n && _offset < _size) {
+			size_t k;
+			if (_offset < header_size) {
+				k = std::min<uint64_t>(n - count, header_size - _offset);
+				std::memcpy(cp, _header + _offset, k);
+			}
+			else if (_offset < data_end) {
+				k = std::min<uint64_t>(n - count, data_end - _offset);
+				auto rv = _(::read(_fd, cp, k), ec);
+				if (rv < 0) {
+					if (errno == EINTR) { ec.clear(); continue; }
+					return 0;
+				}
+				k = rv;
+			}
+			else if (_offset < rfork_start) {
+				k = std::min<uint64_t>(n - count, rfork_start - _offset);
+				std::memset(cp, 0, k);
+			}
+			else if (_offset < rfork_end) {
+				k = std::min<uint64_t>(n - count, rfork_end - _offset);
+				k = _resource_fork.read(cp, k, ec);
+				if (ec) return 0;
+			}
+			else {
+				k = std::min<uint64_t>(n - count, _size - _offset);
+				std::memset(cp, 0, k);
+			}
+
+			// a fork shrank after the header was written.
+			if (k == 0) {
+				ec = std::make_error_code(std::errc::io_error);
+				return 0;
+			}
+
+			cp += k;
+			count += k;
+			_offset += k;
+		}
+		return count;
+	}
+
+
+	void mac_binary::decoder::close() {
+		// an unfinished fork is discarded, not committed.
+		if (_has_resource_fork) _resource_fork.invalidate();
+		_resource_fork.close();
+		if (_fd >= 0) ::close(_fd);
+		_fd = -1;
+
+		_path.clear();
+		std::memset(_header, 0, sizeof(_header));
+		_offset = 0;
+		_version = 0;
+		_name.clear();
+		_data_start = _data_end = 0;
+		_resource_fork_start = _resource_fork_end = 0;
+		_has_resource_fork = false;
+		_finder_info.clear();
+	}
+
+	bool mac_binary::decoder::open(const std::string &path, std::error_code &ec) {
+		ec.clear();
+		close();
+		_path = path;
+		return true;
+	}
+
+	bool mac_binary::decoder::parse(std::error_code &ec) {
+		const uint8_t *h = _header;
+
+		if (h[0] != 0 || h[74] != 0 || h[1] < 1 || h[1] > 63) {
+			ec = bad_stream();
+			return false;
+		}
+
+		if (read16(h + 124) == crc16(h, 124)) {
+			_version = std::memcmp(h + 102, "mBIN", 4) ? 2 : 3;
+		}
+		else if (h[82] == 0) _version = 1;
+		else {
+			ec = bad_stream();
+			return false;
+		}
+
+		_name.assign((const char *)h + 2, h[1]);
+
+		uint32_t data_size = read32(h + 83);
+		uint32_t rfork_size = read32(h + 87);
+		uint16_t secondary = _version >= 2 ? read16(h + 120) : 0;
+
+		_data_start = header_size + pad(secondary);
+		_data_end = _data_start + data_size;
+		_resource_fork_start = _data_start + pad(data_size);
+		_resource_fork_end = _resource_fork_start + rfork_size;
+
+		_finder_info.clear();
+		_finder_info.set_file_type(read32(h + 65));
+		_finder_info.set_creator_type(read32(h + 69));
+		uint8_t *finfo = _finder_info.data();
+		// on desk and inited are meaningless on another machine.
+		finfo[8] = h[73] & ~0x01;
+		finfo[9] = _version >= 2 ? h[101] & ~0x01 : 0;
+		std::memcpy(finfo + 10, h + 75, 6);
+		if (_version >= 3) {
+			finfo[24] = h[106];
+			finfo[25] = h[107];
+		}
+
+		_fd = _(::open(_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666), ec);
+		if (_fd < 0) return false;
+
+		// truncating the data fork leaves a previous resource fork behind.
+		if (rfork_size == 0 && !resource_fork::remove(_path, ec) && !no_data(ec)) return false;
+		ec.clear();
+		return true;
+	}
+
+	size_t mac_binary::decoder::write(const void *buffer, size_t n, std::error_code &ec) {
+		ec.clear();
+
+		if (_path.empty()) {
+			ec = std::make_error_code(std::errc::bad_file_descriptor);
+			return 0;
+		}
+
+		const uint8_t *cp = (const uint8_t *)buffer;
+		size_t left = n;
+
+		while (left) {
+			size_t k;
+			if (_offset < header_size) {
+				k = std::min<uint64_t>(left, header_size - _offset);
+				std::memcpy(_header + _offset, cp, k);
+				if (_offset + k == header_size && !parse(ec)) return 0;
+			}
+			else if (_offset < _data_start) {
+				k = std::min<uint64_t>(left, _data_start - _offset);
+			}
+			else if (_offset < _data_end) {
+				k = std::min<uint64_t>(left, _data_end - _offset);
+				if (!write_all(_fd, cp, k, ec)) return 0;
+			}
+			else if (_offset < _resource_fork_start) {
+				k = std::min<uint64_t>(left, _resource_fork_start - _offset);
+			}
+			else if (_offset < _resource_fork_end) {
+				k = std::min<uint64_t>(left, _resource_fork_end - _offset);
+				if (!_has_resource_fork) {
+					if (!_resource_fork.open(_path, resource_fork::write_only, ec)) return 0;
+					// the xattr backend can't write part of an attribute; collect it and write once.
+					_resource_fork.set_write_back(true);
+					if (!_resource_fork.truncate(0, ec) && !no_data(ec)) return 0;
+					ec.clear();
+					_has_resource_fork = true;
+				}
+				for (size_t done = 0; done < k; ) {
+					size_t rv = _resource_fork.write(cp + done, k - done, ec);
+					if (ec) return 0;
+					done += rv;
+				}
+			}
+			else {
+				// padding and the get info comment.
+				k = left;
+			}
+
+			cp += k;
+			left -= k;
+			_offset += k;
+		}
+		return n;
+	}
+
+	bool mac_binary::decoder::finish(std::error_code &ec) {
+		ec.clear();
+
+		if (_offset < header_size || _offset < _resource_fork_end) {
+			ec = bad_stream();
+			return false;
+		}
+
+		if (_has_resource_fork) {
+			if (!_resource_fork.flush(ec)) return false;
+			_resource_fork.close();
+			_has_resource_fork = false;
+		}
+
+		if (_fd >= 0) {
+			int ok = _(::close(_fd), ec);
+			_fd = -1;
+			if (ok < 0) return false;
+		}
+
+		return _finder_info.write(_path, ec);
+	}
+
+}
@@ -0,0 +1,278 @@
+#include "metadata_cache.h"
+
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+
+	/*
+	 * file timestamps come from a coarse clock (a scheduler tick, 1 - 10ms
+	 * on Linux), so a change within a tick of the last one may not move the
+	 * ctime.  Results read once the ctime is this old are safe to keep.
+	 */
+	enum { settle_ns = 20 * 1000 * 1000 };
+
+	uint64_t ctime_ns(const struct stat &st) {
+	#if defined(__linux__) || defined(__FreeBSD__)
+		return (uint64_t)st.st_ctim.tv_sec * 1000000000 + st.st_ctim.tv_nsec;
+	#elif defined(__APPLE__)
+		return (uint64_t)st.st_ctimespec.tv_sec * 1000000000 + st.st_ctimespec.tv_nsec;
+	#else
+		return (uint64_t)st.st_ctime * 1000000000;
+	#endif
+	}
+
+	struct key {
+		uint64_t dev;
+		uint64_t ino;
+
+		bool operator==(const key &rhs) const { return dev == rhs.dev && ino == rhs.ino; }
+	};
+
+	uint64_t mix(const key &k) {
+		// splitmix64 finalizer
+		uint64_t x = k.ino ^ (k.dev * 0x9e3779b97f4a7c15ull);
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+		return x ^ (x >> 31);
+	}
+
+	struct key_hash {
+		size_t operator()(const key &k) const { return (size_t)mix(k); }
+	};
+
+	enum {
+		have_finder_info = 1,
+		no_finder_info = 2,
+		have_fork = 4,
+		no_fork = 8,
+	};
+
+	struct entry {
+		key k;
+		uint64_t ctime;
+		uint64_t size;
+		uint64_t fork_size;
+		unsigned flags;
+		afp::finder_info_data finder_info;
+	};
+
+	typedef std::list<entry> lru_list;
+
+	/* most recently used first */
+	struct alignas(64) shard {
+		std::mutex mutex;
+		lru_list lru;
+		std::unordered_map<key, lru_list::iterator, key_hash> map;
+
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t stale = 0;
+		uint64_t evictions = 0;
+	};
+
+	shard shards[afp::metadata_cache::shard_count];
+	std::atomic<size_t> limit(0); // 0 = disabled.
+
+	key key_of(const struct stat &st) {
+		return key{ (uint64_t)st.st_dev, (uint64_t)st.st_ino };
+	}
+
+	shard &shard_of(const key &k) {
+		return shards[(mix(k) >> 32) % afp::metadata_cache::shard_count];
+	}
+
+	size_t shard_limit(size_t n) {
+		n /= afp::metadata_cache::shard_count;
+		return n ? n : 1;
+	}
+
+	void drop(shard &s) {
+		s.map.clear();
+		s.lru.clear();
+	}
+
+	/* fn(entry) returns false if the entry doesn't have the value */
+	template<class F>
+	bool find(const struct stat &st, F fn) {
+		if (!limit.load(std::memory_order_relaxed)) return false;
+
+		key k = key_of(st);
+		shard &s = shard_of(k);
+		std::lock_guard<std::mutex> lock(s.mutex);
+
+		auto iter = s.map.find(k);
+		if (iter == s.map.end()) {
+			++s.misses;
+			return false;
+		}
+		auto e = iter->second;
+		if (e->ctime != ctime_ns(st) || e->size != (uint64_t)st.st_size) {
+			s.lru.erase(e);
+			s.map.erase(iter);
+			++s.stale;
+			++s.misses;
+			return false;
+		}
+		if (!fn(*e)) {
+			++s.misses;
+			return false;
+		}
+		s.lru.splice(s.lru.begin(), s.lru, e);
+		++s.hits;
+		return true;
+	}
+
+	template<class F>
+	void store(const struct stat &st, F fn) {
+		size_t n = limit.load(std::memory_order_relaxed);
+		if (!n) return;
+		n = shard_limit(n);
+
+		key k = key_of(st);
+		uint64_t ct = ctime_ns(st);
+		shard &s = shard_of(k);
+		std::lock_guard<std::mutex> lock(s.mutex);
+
+		auto iter = s.map.find(k);
+		if (iter != s.map.end()) {
+			auto e = iter->second;
+			if (e->ctime != ct || e->size != (uint64_t)st.st_size) {
+				e->ctime = ct;
+				e->size = st.st_size;
+				e->flags = 0;
+			}
+			fn(*e);
+			s.lru.splice(s.lru.begin(), s.lru, e);
+			return;
+		}
+
+		// also trims the shard after enable() lowered the limit.
+		while (s.lru.size() >= n) {
+			s.map.erase(s.lru.back().k);
+			s.lru.pop_back();
+			++s.evictions;
+		}
+
+		s.lru.emplace_front();
+		entry &e = s.lru.front();
+		e.k = k;
+		e.ctime = ct;
+		e.size = st.st_size;
+		e.fork_size = 0;
+		e.flags = 0;
+		e.finder_info.clear();
+		fn(e);
+		s.map.emplace(k, s.lru.begin());
+	}
+
+}
+
+namespace afp {
+
+	void metadata_cache::enable(size_t max_entries) {
+		limit.store(max_entries ? max_entries : 1, std::memory_order_relaxed);
+	}
+
+	void metadata_cache::disable() {
+		limit.store(0, std::memory_order_relaxed);
+		clear();
+	}
+
+	bool metadata_cache::enabled() {
+		return limit.load(std::memory_order_relaxed) != 0;
+	}
+
+	size_t metadata_cache::max_entries() {
+		return limit.load(std::memory_order_relaxed);
+	}
+
+	void metadata_cache::clear() {
+		for (auto &s : shards) {
+			std::lock_guard<std::mutex> lock(s.mutex);
+			drop(s);
+		}
+	}
+
+	metadata_cache::statistics metadata_cache::stats() {
+		statistics rv;
+		for (auto &s : shards) {
+			std::lock_guard<std::mutex> lock(s.mutex);
+			rv.hits += s.hits;
+			rv.misses += s.misses;
+			rv.stale += s.stale;
+			rv.evictions += s.evictions;
+			rv.entries += s.lru.size();
+		}
+		return rv;
+	}
+
+	bool metadata_cache::find_finder_info(const struct stat &st, finder_info_data &data, bool &present) {
+		return find(st, [&](const entry &e){
+			if (!(e.flags & (have_finder_info | no_finder_info))) return false;
+			present = e.flags & have_finder_info;
+			if (present) data = e.finder_info;
+			return true;
+		});
+	}
+
+	bool metadata_cache::find_fork_size(const struct stat &st, uint64_t &size, bool &present) {
+		return find(st, [&](const entry &e){
+			if (!(e.flags & (have_fork | no_fork))) return false;
+			present = e.flags & have_fork;
+			size = present ? e.fork_size : 0;
+			return true;
+		});
+	}
+
+	bool metadata_cache::settled(const struct stat &st) {
+		using namespace std::chrono;
+		uint64_t now = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+		uint64_t ct = ctime_ns(st);
+		// a ctime in the future (clock skew, e.g. over NFS) is never settled.
+		return now >= ct && now - ct >= settle_ns;
+	}
+
+	void metadata_cache::store_finder_info(const struct stat &st, const finder_info_data &data) {
+		store(st, [&](entry &e){
+			e.flags = (e.flags & ~no_finder_info) | have_finder_info;
+			e.finder_info = data;
+		});
+	}
+
+	void metadata_cache::store_no_finder_info(const struct stat &st) {
+		store(st, [&](entry &e){
+			e.flags = (e.flags & ~have_finder_info) | no_finder_info;
+			e.finder_info.clear();
+		});
+	}
+
+	void metadata_cache::store_fork_size(const struct stat &st, uint64_t size) {
+		store(st, [&](entry &e){
+			e.flags = (e.flags & ~no_fork) | have_fork;
+			e.fork_size = size;
+		});
+	}
+
+	void metadata_cache::store_no_fork(const struct stat &st) {
+		store(st, [&](entry &e){
+			e.flags = (e.flags & ~have_fork) | no_fork;
+			e.fork_size = 0;
+		});
+	}
+
+	void metadata_cache::invalidate(const struct stat &st) {
+		key k = key_of(st);
+		shard &s = shard_of(k);
+		std::lock_guard<std::mutex> lock(s.mutex);
+
+		auto iter = s.map.find(k);
+		if (iter == s.map.end()) return;
+		s.lru.erase(iter->second);
+		s.map.erase(iter);
+	}
+
+}
@@ -0,0 +1,347 @@
+#include "metadata_watcher.h"
+
+#include <map>
+#include <utility>
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+namespace {
+
+	template<class T>
+	T _(T x, std::error_code &ec) {
+		if (x < 0) ec = std::error_code(errno, std::system_category());
+		return x;
+	}
+
+#if defined(__linux__)
+
+	enum : uint32_t {
+		// setxattr / removexattr raise IN_ATTRIB on the file (and its directory's watch).
+		dir_mask = IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO
+			| IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK,
+		file_mask = IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF,
+	};
+
+	typedef std::unordered_map<int, std::string> watch_map;
+
+	/* one event per path; a later notification replaces an earlier one, except an overflow. */
+	typedef std::map<std::string, afp::metadata_event> event_map;
+
+	void note(event_map &events, const std::string &path, afp::metadata_event::kind_type kind, std::error_code ec = std::error_code()) {
+		afp::metadata_event &e = events[path];
+		// the caller still has to rescan, whatever happened to the path since.
+		if (e.kind == afp::metadata_event::overflow) return;
+		e.kind = kind;
+		e.entry = afp::scan_entry();
+		e.entry.path = path;
+		e.entry.error = ec;
+	}
+
+	std::string join(const std::string &dir, const char *name) {
+		std::string rv(dir);
+		if (rv.empty() || rv.back() != '/') rv.push_back('/');
+		rv.append(name);
+		return rv;
+	}
+
+	bool under(const std::string &path, const std::string &dir) {
+		return path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0 && path[dir.size()] == '/';
+	}
+
+	/*
+	 * watches dir and every directory below it.  With files, the regular
+	 * files found are noted as changed.  Directories that can't be watched
+	 * (or read) are noted with their error.
+	 */
+	void add_tree(int fd, watch_map &watches, const std::string &dir, event_map &events, bool files) {
+		std::vector<std::string> stack(1, dir);
+
+		while (!stack.empty()) {
+			std::string path = std::move(stack.back());
+			stack.pop_back();
+
+			std::error_code ec;
+			int wd = _(::inotify_add_watch(fd, path.c_str(), dir_mask), ec);
+			if (wd < 0) {
+				// it was removed again before we got to it.
+				if (ec.value() != ENOENT) note(events, path, afp::metadata_event::changed, ec);
+				continue;
+			}
+			watches[wd] = path; // a directory reached by a new name replaces the old one.
+
+			DIR *dp = ::opendir(path.c_str());
+			if (!dp) {
+				if (errno != ENOENT) note(events, path, afp::metadata_event::changed, std::error_code(errno, std::system_category()));
+				continue;
+			}
+
+			while (struct dirent *d = ::readdir(dp)) {
+				const char *name = d->d_name;
+				if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) continue;
+
+				unsigned char type = DT_UNKNOWN;
+				#ifdef _DIRENT_HAVE_D_TYPE
+				type = d->d_type;
+				#endif
+
+				std::string child = join(path, name);
+				if (type == DT_UNKNOWN) {
+					struct stat st;
+					if (::lstat(child.c_str(), &st) < 0) continue;
+					if (S_ISDIR(st.st_mode)) type = DT_DIR;
+					else if (S_ISREG(st.st_mode)) type = DT_REG;
+					else continue;
+				}
+
+				if (type == DT_DIR) stack.push_back(std::move(child));
+				else if (type == DT_REG && files) note(events, child, afp::metadata_event::changed);
+			}
+			::closedir(dp);
+		}
+	}
+
+	/* stops watching dir and everything below it, and drops their pending events. */
+	void remove_tree(int fd, watch_map &watches, const std::string &dir, event_map &events) {
+		for (auto iter = watches.begin(); iter != watches.end(); ) {
+			if (iter->second == dir || under(iter->second, dir)) {
+				::inotify_rm_watch(fd, iter->first);
+				iter = watches.erase(iter);
+			}
+			else ++iter;
+		}
+
+		for (auto iter = events.lower_bound(dir + '/'); iter != events.end() && under(iter->first, dir); )
+			iter = events.erase(iter);
+	}
+
+	/* re-reads a changed file; false if it's no longer something to report. */
+	bool refresh(afp::metadata_event &e) {
+		if (e.entry.error) return true; // a directory that couldn't be watched.
+
+		struct stat st;
+		if (::lstat(e.entry.path.c_str(), &st) < 0) {
+			if (errno != ENOENT && errno != ENOTDIR) {
+				e.entry.error = std::error_code(errno, std::system_category());
+				return true;
+			}
+			e.kind = afp::metadata_event::removed;
+			return true;
+		}
+		if (!S_ISREG(st.st_mode)) return false;
+
+		e.entry = afp::scan_file(e.entry.path);
+		if (e.entry.error == std::errc::no_such_file_or_directory) {
+			std::string path = std::move(e.entry.path);
+			e.kind = afp::metadata_event::removed;
+			e.entry = afp::scan_entry();
+			e.entry.path = std::move(path);
+		}
+		return true;
+	}
+
+#endif
+
+}
+
+namespace afp {
+
+	metadata_watcher::metadata_watcher(metadata_watcher &&rhs) {
+		std::swap(_fd, rhs._fd);
+		std::swap(_root, rhs._root);
+		std::swap(_root_file, rhs._root_file);
+		std::swap(_watches, rhs._watches);
+		std::swap(_pending, rhs._pending);
+	}
+
+	metadata_watcher& metadata_watcher::operator=(metadata_watcher &&rhs) {
+		if (this != &rhs) {
+			close();
+			std::swap(_fd, rhs._fd);
+			std::swap(_root, rhs._root);
+			std::swap(_root_file, rhs._root_file);
+			std::swap(_watches, rhs._watches);
+			std::swap(_pending, rhs._pending);
+		}
+		return *this;
+	}
+
+	void metadata_watcher::close() {
+		if (_fd >= 0) ::close(_fd);
+		_fd = -1;
+		_root.clear();
+		_root_file = false;
+		_watches.clear();
+		_pending.clear();
+	}
+
+	std::vector<metadata_event> metadata_watcher::read(std::error_code &ec) {
+		std::vector<metadata_event> rv;
+		read([&rv](const metadata_event &e){ rv.push_back(e); }, ec);
+		return rv;
+	}
+
+#if defined(__linux__)
+
+	bool metadata_watcher::open(const std::string &path, std::error_code &ec) {
+		ec.clear();
+		close();
+
+		struct stat st;
+		if (_(::stat(path.c_str(), &st), ec) < 0) return false;
+		if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)) {
+			ec = std::make_error_code(std::errc::invalid_seek); // ESPIPE, as regular_file().
+			return false;
+		}
+
+		int fd = _(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC), ec);
+		if (fd < 0) return false;
+
+		if (S_ISREG(st.st_mode)) {
+			int wd = _(::inotify_add_watch(fd, path.c_str(), file_mask), ec);
+			if (wd < 0) {
+				::close(fd);
+				return false;
+			}
+			_watches[wd] = path;
+			_root_file = true;
+		}
+		else {
+			event_map errors;
+			add_tree(fd, _watches, path, errors, false);
+
+			// without the root there's nothing to watch.
+			if (_watches.empty()) {
+				::close(fd);
+				_watches.clear();
+				auto iter = errors.find(path);
+				ec = iter != errors.end() ? iter->second.entry.error : std::make_error_code(std::errc::no_such_file_or_directory);
+				return false;
+			}
+			for (auto &kv : errors) _pending.push_back(std::move(kv.second));
+		}
+
+		_fd = fd;
+		_root = path;
+		return true;
+	}
+
+	size_t metadata_watcher::read(const callback &fn, std::error_code &ec) {
+		ec.clear();
+		if (_fd < 0) {
+			ec = std::make_error_code(std::errc::bad_file_descriptor);
+			return 0;
+		}
+
+		event_map events;
+		for (auto &e : _pending) events[e.entry.path] = std::move(e);
+		_pending.clear();
+
+		alignas(struct inotify_event) char buffer[16 * 1024];
+		for (;;) {
+			ssize_t n = ::read(_fd, buffer, sizeof(buffer));
+			if (n < 0) {
+				if (errno == EINTR) continue;
+				if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+				ec = std::error_code(errno, std::system_category());
+				return 0;
+			}
+
+			for (char *cp = buffer; cp < buffer + n; ) {
+				const struct inotify_event &ev = *(const struct inotify_event *)cp;
+				cp += sizeof(struct inotify_event) + ev.len;
+
+				if (ev.mask & IN_Q_OVERFLOW) {
+					note(events, _root, metadata_event::overflow);
+					continue;
+				}
+
+				auto iter = _watches.find(ev.wd);
+				if (iter == _watches.end()) continue;
+				if (ev.mask & IN_IGNORED) {
+					_watches.erase(iter);
+					continue;
+				}
+
+				std::string dir = iter->second;
+				if (_root_file || !ev.len) {
+					// the watched file or directory itself.  Subdirectories are reported by their parent.
+					if (ev.mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+						if (dir == _root) note(events, _root, metadata_event::removed);
+					}
+					else if (_root_file && (ev.mask & IN_ATTRIB)) note(events, _root, metadata_event::changed);
+					continue;
+				}
+
+				std::string path = join(dir, ev.name);
+				if (ev.mask & IN_ISDIR) {
+					if (ev.mask & (IN_DELETE | IN_MOVED_FROM)) {
+						remove_tree(_fd, _watches, path, events);
+						note(events, path, metadata_event::removed);
+					}
+					else if (ev.mask & (IN_CREATE | IN_MOVED_TO)) {
+						events.erase(path);
+						add_tree(_fd, _watches, path, events, true);
+					}
+					continue;
+				}
+
+				if (ev.mask & (IN_DELETE | IN_MOVED_FROM)) note(events, path, metadata_event::removed);
+				else note(events, path, metadata_event::changed);
+			}
+		}
+
+		size_t count = 0;
+		for (auto &kv : events) {
+			metadata_event &e = kv.second;
+			if (e.kind == metadata_event::changed && !refresh(e)) continue;
+			fn(e);
+			++count;
+		}
+		return count;
+	}
+
+	bool metadata_watcher::wait(int timeout_ms, std::error_code &ec) {
+		ec.clear();
+		if (_fd < 0) {
+			ec = std::make_error_code(std::errc::bad_file_descriptor);
+			return false;
+		}
+
+		struct pollfd p = { _fd, POLLIN, 0 };
+		int rv = ::poll(&p, 1, timeout_ms);
+		if (rv < 0) {
+			if (errno != EINTR) ec = std::error_code(errno, std::system_category());
+			return false;
+		}
+		return rv > 0;
+	}
+
+#else
+
+	bool metadata_watcher::open(const std::string &path, std::error_code &ec) {
+		close();
+		ec = std::make_error_code(std::errc::function_not_supported); // ENOSYS.
+		return false;
+	}
+
+	size_t metadata_watcher::read(const callback &fn, std::error_code &ec) {
+		ec = std::make_error_code(std::errc::bad_file_descriptor);
+		return 0;
+	}
+
+	bool metadata_watcher::wait(int timeout_ms, std::error_code &ec) {
+		ec = std::make_error_code(std::errc::bad_file_descriptor);
+		return false;
+	}
+
+#endif
+
+}
@@ -0,0 +1,73 @@
+#ifndef probes_h
+#define probes_h
+
+/*
+ * USDT (sys/sdt.h) probes, provider "afp".  Only compiled in when AFP_USDT
+ * is defined (cmake -DAFP_USDT=ON, or make USDT=1); otherwise every probe
+ * expands to nothing.
+ *
+ * names are <class>__<method>__entry / __return, which perf and bpftrace
+ * show as e.g. usdt:libafp:afp:resource_fork__read__return.  Strings are
+ * passed as const char *, errno as an int (0 for success); read and write
+ * returns also carry the byte count.
+ */
+
+#if defined(AFP_USDT)
+
+#include <sys/sdt.h>
+
+#define AFP_PROBE0(name) DTRACE_PROBE(afp, name)
+#define AFP_PROBE1(name, a) DTRACE_PROBE1(afp, name, a)
+#define AFP_PROBE2(name, a, b) DTRACE_PROBE2(afp, name, a, b)
+#define AFP_PROBE3(name, a, b, c) DTRACE_PROBE3(afp, name, a, b, c)
+#define AFP_PROBE4(name, a, b, c, d) DTRACE_PROBE4(afp, name, a, b, c, d)
+
+#else
+
+#define AFP_PROBE0(name) do {} while (0)
+#define AFP_PROBE1(name, a) do {} while (0)
+#define AFP_PROBE2(name, a, b) do {} while (0)
+#define AFP_PROBE3(name, a, b, c) do {} while (0)
+#define AFP_PROBE4(name, a, b, c, d) do {} while (0)
+
+#endif
+
+
+#if defined(__cplusplus)
+
+/*
+ * AFP_PROBE_RETURN(AFP_PROBE2(x__return, a, b));
+ * fires the probe when the enclosing scope exits, so every return path is
+ * covered.  The arguments are evaluated at that point.
+ */
+#if defined(AFP_USDT)
+
+namespace afp_probes {
+
+	template<class F>
+	class scope_exit {
+	public:
+		explicit scope_exit(F f) : _f(f) {}
+		scope_exit(scope_exit &&rhs) : _f(rhs._f), _active(rhs._active) { rhs._active = false; }
+		scope_exit(const scope_exit &) = delete;
+		~scope_exit() { if (_active) _f(); }
+	private:
+		F _f;
+		bool _active = true;
+	};
+
+	template<class F>
+	scope_exit<F> make_scope_exit(F f) { return scope_exit<F>(f); }
+}
+
+#define AFP_PROBE_RETURN(probe) auto afp_probe_return_ = afp_probes::make_scope_exit([&]{ probe; })
+
+#else
+
+#define AFP_PROBE_RETURN(probe) do {} while (0)
+
+#endif
+
+#endif
+
+#endif
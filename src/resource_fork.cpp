@@ -2,6 +2,12 @@
 
 #include <cstring>
 #include <cstdint>
+#include <algorithm>
+#include <memory>
+
+#include "stats_hooks.h"
+#include "probes.h"
+#include "trace_hooks.h"
 
 #if defined(__CYGWIN__) || defined(__MSYS__)
 #if !defined(_WIN32)
@@ -19,12 +25,15 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include "xattr.h"
+#include "metadata_cache.h"
 #endif
 
 #ifdef __APPLE__
 #include <sys/xattr.h>
 #include <sys/paths.h>
+#include <sys/param.h>
 #ifndef _PATH_RSRCFORKSPEC
 #define _PATH_RSRCFORKSPEC "/..namedfork/rsrc"
 #endif
@@ -39,9 +48,13 @@
 #define XATTR_RESOURCEFORK_NAME "com.apple.ResourceFork"
 #endif
 
+/* chunked layout: XATTR_RESOURCEFORK_NAME.0, .1, ... and an index */
+#define XATTR_RESOURCEFORK_INDEX_NAME XATTR_RESOURCEFORK_NAME ".index"
+
 #if defined(__linux__) || defined(__FreeBSD__) || defined(_AIX)
 #define XATTR_RESOURCE_FORK
 
+#include <cstdio>
 #include <vector>
 
 #endif
@@ -119,7 +132,9 @@ extern "C" int remap_os_error(unsigned long);
 				break;
 		}
 
+		uint64_t t = afp_stats_begin();
 		HANDLE h =  _(CreateFile(s, access, FILE_SHARE_READ, nullptr, create, FILE_ATTRIBUTE_NORMAL, nullptr), ec);
+		afp_stats_end(AFP_STATS_OPEN, t, h == INVALID_HANDLE_VALUE ? -1 : 0);
 
 		return h;
 	}
@@ -169,11 +184,13 @@ extern "C" int remap_os_error(unsigned long);
 		return x;
 	}
 
-	bool regular_file(int fd, std::error_code &ec) {
+	/* sp (if not null) receives the fstat result */
+	bool regular_file(int fd, std::error_code &ec, struct stat *sp = nullptr) {
 			struct stat st;
 			if (_(::fstat(fd, &st), ec) < 0) {
 				return false;
 			}
+			if (sp) *sp = st;
 			if (S_ISREG(st.st_mode)) return true;
 
 			if (S_ISDIR(st.st_mode)) {
@@ -185,15 +202,96 @@ extern "C" int remap_os_error(unsigned long);
 	}
 
 	/* opens a file read-only and verifies it's a regular file */
-	int openX(const std::string &path, std::error_code &ec) {
-		int fd = _(::open(path.c_str(), O_RDONLY | O_NONBLOCK), ec);
-		if (fd >= 0 && !regular_file(fd, ec)) {
+	int openX(int dirfd, const std::string &path, std::error_code &ec, struct stat *st = nullptr) {
+		uint64_t t = afp_stats_begin();
+		int fd = _(::openat(dirfd, path.c_str(), O_RDONLY | O_NONBLOCK), ec);
+		afp_stats_end(AFP_STATS_OPEN, t, fd);
+		if (fd >= 0 && !regular_file(fd, ec, st)) {
 			::close(fd);
 			fd = -1;
 		}
 		return fd;
 	}
 
+	/*
+	 * a path based lookup failed with ENODATA; stat once so a directory or
+	 * special file is reported the same way openX reports it.
+	 */
+	void classify(const std::string &path, std::error_code &ec) {
+		if (ec.value() != ENODATA) return;
+
+		struct stat st;
+		if (_(::stat(path.c_str(), &st), ec) < 0) return;
+		if (S_ISDIR(st.st_mode))
+			ec = std::make_error_code(std::errc::is_a_directory);
+		else if (!S_ISREG(st.st_mode))
+			ec = std::make_error_code(std::errc::invalid_seek); // ESPIPE.
+	}
+
+	/*
+	 * most forks are small, so try a read into a speculative buffer.  A
+	 * longer one is retried at the most a single attribute holds on Linux
+	 * (XATTR_SIZE_MAX), so it still takes two calls; only a fork beyond
+	 * that (or one that grew in between) needs a size probe.  Reads go to
+	 * scratch space and only the bytes read are copied out, so the vector
+	 * is never zero filled.
+	 */
+	enum { speculative_size = 4096, retry_size = 64 * 1024 };
+
+	template<class F1, class F2>
+	bool read_xattr_speculative(std::vector<uint8_t> &rv, F1 size_fn, F2 read_fn, std::error_code &ec) {
+
+		ec.clear();
+		uint8_t tmp[speculative_size];
+		auto tsize = _(read_fn(tmp, sizeof(tmp)), ec);
+		if (!ec) {
+			rv.assign(tmp, tmp + tsize);
+			return true;
+		}
+		if (ec.value() != ERANGE) {
+			rv.clear();
+			return false;
+		}
+		afp_stats_add(AFP_STATS_ERANGE_RETRIES, 1);
+
+		// one per thread, kept for the next long fork.  new[] doesn't zero fill.
+		thread_local std::unique_ptr<uint8_t[]> scratch;
+		if (!scratch) scratch.reset(new uint8_t[retry_size]);
+
+		ec.clear();
+		tsize = _(read_fn(scratch.get(), retry_size), ec);
+		if (!ec) {
+			rv.assign(scratch.get(), scratch.get() + tsize);
+			return true;
+		}
+		if (ec.value() != ERANGE) {
+			rv.clear();
+			return false;
+		}
+		afp_stats_add(AFP_STATS_ERANGE_RETRIES, 1);
+
+		for(;;) {
+			rv.clear();
+			ec.clear();
+			auto size = _(size_fn(), ec);
+			if (ec) return false;
+			if (size == 0) return true;
+			rv.resize(size);
+
+			tsize = _(read_fn(rv.data(), size), ec);
+			if (ec) {
+				if (ec.value() == ERANGE) {
+					afp_stats_add(AFP_STATS_ERANGE_RETRIES, 1);
+					continue;
+				}
+				rv.clear();
+				return false;
+			}
+			rv.resize(tsize);
+			return true;
+		}
+	}
+
 #endif
 
 }
@@ -204,9 +302,24 @@ namespace afp {
 		std::swap(_fd, rhs._fd);
 
 		#if defined(__linux__) || defined(__FreeBSD__) || defined(_AIX)
+		std::swap(_owned, rhs._owned);
 		std::swap(_offset, rhs._offset);
 		std::swap(_mode, rhs._mode);
+		std::swap(_ctime, rhs._ctime);
+		std::swap(_cached, rhs._cached);
+		std::swap(_absent, rhs._absent);
+		std::swap(_write_back, rhs._write_back);
+		std::swap(_dirty, rhs._dirty);
+		std::swap(_dirty_limit, rhs._dirty_limit);
+		std::swap(_chunk_size, rhs._chunk_size);
+		std::swap(_chunk_total, rhs._chunk_total);
+		std::swap(_new_chunk_size, rhs._new_chunk_size);
+		std::swap(_chunk, rhs._chunk);
+		#else
+		std::swap(_map, rhs._map);
+		std::swap(_map_size, rhs._map_size);
 		#endif
+		std::swap(_buffer, rhs._buffer);
 	}
 
 	resource_fork& resource_fork::operator=(resource_fork &&rhs) {
@@ -215,9 +328,24 @@ namespace afp {
 			std::swap(_fd, rhs._fd);
 
 			#if defined(__linux__) || defined(__FreeBSD__) || defined(_AIX)
+			std::swap(_owned, rhs._owned);
 			std::swap(_offset, rhs._offset);
 			std::swap(_mode, rhs._mode);
+			std::swap(_ctime, rhs._ctime);
+			std::swap(_cached, rhs._cached);
+			std::swap(_absent, rhs._absent);
+			std::swap(_write_back, rhs._write_back);
+			std::swap(_dirty, rhs._dirty);
+			std::swap(_dirty_limit, rhs._dirty_limit);
+			std::swap(_chunk_size, rhs._chunk_size);
+			std::swap(_chunk_total, rhs._chunk_total);
+			std::swap(_new_chunk_size, rhs._new_chunk_size);
+			std::swap(_chunk, rhs._chunk);
+			#else
+			std::swap(_map, rhs._map);
+			std::swap(_map_size, rhs._map_size);
 			#endif
+			std::swap(_buffer, rhs._buffer);
 		}
 		return *this;
 	}
@@ -369,10 +497,42 @@ namespace afp {
 
 
 	void resource_fork::close() {
+		unmap();
 		CloseHandle(_fd);
 		_fd = INVALID_HANDLE_VALUE;
 	}
 
+	void resource_fork::unmap() {
+		if (_map) UnmapViewOfFile(_map);
+		_map = nullptr;
+		_map_size = 0;
+	}
+
+	byte_view resource_fork::view(std::error_code &ec) {
+		ec.clear();
+
+		size_t n = size(ec);
+		if (ec) return byte_view();
+		if (_map && _map_size == n) return byte_view(_map, _map_size);
+
+		unmap();
+		// CreateFileMapping fails for an empty file.
+		if (n == 0) return byte_view();
+
+		HANDLE h = CreateFileMapping(_fd, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!h) {
+			ec = std::error_code(remap_os_error(GetLastError()), std::system_category());
+			return byte_view();
+		}
+		_map = MapViewOfFile(h, FILE_MAP_READ, 0, 0, 0);
+		if (!_map) ec = std::error_code(remap_os_error(GetLastError()), std::system_category());
+		CloseHandle(h);
+		if (ec) return byte_view();
+
+		_map_size = n;
+		return byte_view(_map, _map_size);
+	}
+
 	size_t resource_fork::read(void *buffer, size_t n, std::error_code &ec) {
 		ec.clear();
 		DWORD transferred = 0;
@@ -405,6 +565,7 @@ namespace afp {
 
 		ll.QuadPart = pos;
 
+		unmap();
 		ok = _(SetFilePointerEx(_fd, ll, nullptr, FILE_BEGIN), ec);
 		if (ec) return false;
 
@@ -426,20 +587,63 @@ namespace afp {
 		if (ec) return false;
 		return true;
 	}
+
+	void resource_fork::invalidate() {
+		unmap();
+	}
+
+	void resource_fork::set_write_back(bool enable, size_t dirty_limit) {
+	}
+
+	void resource_fork::set_chunked(bool enable, size_t chunk_size) {
+	}
+
+	bool resource_fork::flush(std::error_code &ec) {
+		ec.clear();
+		return true;
+	}
 #else
 	void resource_fork::close() {
-		::close(_fd);
+		trace_hooks::scope t(_fd >= 0 ? afp::trace::resource_fork_close : afp::trace::none, this);
+		int fd = _fd; // the handle is reset before the return probe fires.
+		(void)fd;
+		AFP_PROBE1(resource_fork__close__entry, fd);
+		AFP_PROBE_RETURN(AFP_PROBE1(resource_fork__close__return, fd));
+	#if defined(__linux__) || defined(__FreeBSD__) || defined(_AIX)
+		if (_dirty) {
+			std::error_code ec;
+			flush(ec);
+		}
+		if (!_owned) _fd = -1;
+		_owned = true;
+	#endif
+		if (_fd >= 0) ::close(_fd);
 		_fd = -1;
+		invalidate();
 	}
 #endif
 
+	bool resource_fork::close(std::error_code &ec) {
+		if (!flush(ec)) return false;
+		close();
+		return true;
+	}
+
 
 #ifdef __sun__
 	#define FD_RESOURCE_FORK
-	bool resource_fork::open(const std::string &path, open_mode mode, std::error_code &ec) {
+	bool resource_fork::open_at(int dirfd, const std::string &path, open_mode mode, std::error_code &ec) {
 		ec.clear();
 		close();
 
+		int fd = openX(dirfd, path, ec);
+		if (ec) return false;
+
+		return open_fd(fd, true, mode, ec);
+	}
+
+	bool resource_fork::open_fd(int fd, bool owned, open_mode mode, std::error_code &ec) {
+
 		int umode = 0;
 		switch(mode) {
 			case read_only: umode = O_RDONLY; break;
@@ -447,11 +651,8 @@ namespace afp {
 			case read_write: umode = O_RDWR | O_CREAT; break;
 		}
 
-		int fd = openX(path, ec);
-		if (ec) return false;
-
 		_fd = _(::openat(fd, XATTR_RESOURCEFORK_NAME, umode | O_XATTR, 0666), ec);
-		::close(fd);
+		if (owned) ::close(fd);
 
 		if (ec) {
 			if (ec.value() == ENOENT)
@@ -462,20 +663,20 @@ namespace afp {
 		return true;
 	}
 
-	bool resource_fork::remove(const std::string &path, std::error_code &ec) {
+	bool resource_fork::remove_at(int dirfd, const std::string &path, std::error_code &ec) {
 		ec.clear();
 
 
-		int fd = openX(path, ec);
+		int fd = openX(dirfd, path, ec);
 		if (ec) return false;
 
-		int dirfd = _(::openat(fd, ".", O_RDONLY | O_XATTR), ec);
+		int xfd = _(::openat(fd, ".", O_RDONLY | O_XATTR), ec);
 
 		::close(fd);
 		if (ec) return false;
 
-		int ok = _(::unlinkat(dirfd, XATTR_RESOURCEFORK_NAME, 0), ec);
-		::close(dirfd);
+		int ok = _(::unlinkat(xfd, XATTR_RESOURCEFORK_NAME, 0), ec);
+		::close(xfd);
 
 		if (ec.value() == ENOENT) {
 			ec = std::make_error_code(std::errc::no_message_available); // ENODATA.
@@ -485,11 +686,11 @@ namespace afp {
 	}
 
 
-	size_t resource_fork::write(const std::string &path, const void *buffer, size_t n, std::error_code &ec) {
+	size_t resource_fork::write_at(int dirfd, const std::string &path, const void *buffer, size_t n, std::error_code &ec) {
 
 		ec.clear();
 
-		int fd = openX(path, ec);
+		int fd = openX(dirfd, path, ec);
 		if (ec) return 0;
 
 		int rfd = _(::openat(fd, XATTR_RESOURCEFORK_NAME, O_WRONLY | O_CREAT | O_TRUNC | O_XATTR, 0666), ec);
@@ -515,14 +716,14 @@ namespace afp {
 
 #ifdef __APPLE__
 	#define FD_RESOURCE_FORK
-	bool resource_fork::open(const std::string &path, open_mode mode, std::error_code &ec) {
+	bool resource_fork::open_at(int dirfd, const std::string &path, open_mode mode, std::error_code &ec) {
 		ec.clear();
 		close();
 
 		std::string s(path);
 		s += _PATH_RSRCFORKSPEC;
 
-		int fd = openX(path, ec);
+		int fd = openX(dirfd, path, ec);
 		if (ec) return false;
 
 		int umode = 0;
@@ -532,7 +733,7 @@ namespace afp {
 			case read_write: umode = O_RDWR | O_CREAT; break;
 		}
 
-		_fd = _(::open(s.c_str(), umode, 0666), ec);
+		_fd = _(::openat(dirfd, s.c_str(), umode, 0666), ec);
 		::close(fd);
 		if (ec) {
 			if (ec.value() == ENOENT)
@@ -543,17 +744,45 @@ namespace afp {
 		return true;
 	}
 
-	bool resource_fork::remove(const std::string &path, std::error_code &ec) {
+	/* the named fork can only be reached by path, so recover it from the descriptor. */
+	bool resource_fork::open_fd(int fd, bool owned, open_mode mode, std::error_code &ec) {
+
+		char buffer[PATH_MAX];
+		int ok = _(::fcntl(fd, F_GETPATH, buffer), ec);
+		if (owned) ::close(fd);
+		if (ok < 0) return false;
+
+		std::string s(buffer);
+		s += _PATH_RSRCFORKSPEC;
+
+		int umode = 0;
+		switch(mode) {
+			case read_only: umode = O_RDONLY; break;
+			case write_only: umode = O_WRONLY | O_CREAT; break;
+			case read_write: umode = O_RDWR | O_CREAT; break;
+		}
+
+		_fd = _(::open(s.c_str(), umode, 0666), ec);
+		if (ec) {
+			if (ec.value() == ENOENT)
+				ec = std::make_error_code(std::errc::no_message_available);
+			return false;
+		}
+
+		return true;
+	}
+
+	bool resource_fork::remove_at(int dirfd, const std::string &path, std::error_code &ec) {
 		ec.clear();
 
 		std::string s(path);
 		s += _PATH_RSRCFORKSPEC;
 
-		int fd = openX(path, ec);
+		int fd = openX(dirfd, path, ec);
 		if (ec) return false;
 		::close(fd);
 
-		int ok = _(::unlink(s.c_str()), ec);
+		int ok = _(::unlinkat(dirfd, s.c_str(), 0), ec);
 		if (ec.value() == ENOENT) {
 			ec = std::make_error_code(std::errc::no_message_available);
 			return true;
@@ -561,18 +790,18 @@ namespace afp {
 		return ok == 0;
 	}
 
-	size_t resource_fork::write(const std::string &path, const void *buffer, size_t n, std::error_code &ec) {
+	size_t resource_fork::write_at(int dirfd, const std::string &path, const void *buffer, size_t n, std::error_code &ec) {
 
 		ec.clear();
 
 		std::string s(path);
 		s += _PATH_RSRCFORKSPEC;
 
-		int fd = openX(path, ec);
+		int fd = openX(dirfd, path, ec);
 		if (ec) return false;
 		::close(fd);
 
-		int rfd = _(::open(s.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666), ec);
+		int rfd = _(::openat(dirfd, s.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666), ec);
 		if (rfd < 0) return 0;
 
 		auto rv = _(::write(rfd, buffer, n), ec);
@@ -585,29 +814,51 @@ namespace afp {
 
 #ifdef FD_RESOURCE_FORK
 	size_t resource_fork::read(void *buffer, size_t n, std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_read, this, ec);
+		t.size(n);
+		size_t count = 0;
+		AFP_PROBE2(resource_fork__read__entry, _fd, n);
+		AFP_PROBE_RETURN(AFP_PROBE3(resource_fork__read__return, _fd, count, ec.value()));
 		ec.clear();
 		auto rv = _(::read(_fd, buffer, n), ec);
-		if (ec) return 0;
+		if (ec) return t.result<size_t>(0);
 
-		return rv;
+		count = rv;
+		return t.result(count);
 	}
 
 	size_t resource_fork::write(const void *buffer, size_t n, std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_write, this, ec);
+		t.size(n);
+		size_t count = 0;
+		AFP_PROBE2(resource_fork__write__entry, _fd, n);
+		AFP_PROBE_RETURN(AFP_PROBE3(resource_fork__write__return, _fd, count, ec.value()));
 		ec.clear();
 		auto rv = _(::write(_fd, buffer, n), ec);
-		if (ec) return 0;
+		if (ec) return t.result<size_t>(0);
 
-		return rv;
+		count = rv;
+		return t.result(count);
 	}
 
 	bool resource_fork::truncate(size_t pos, std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_truncate, this, ec);
+		t.size(pos);
+		AFP_PROBE2(resource_fork__truncate__entry, _fd, pos);
+		AFP_PROBE_RETURN(AFP_PROBE2(resource_fork__truncate__return, _fd, ec.value()));
 		ec.clear();
+		// shrinking the file under a mapping would fault.
+		unmap();
 		_(::ftruncate(_fd, pos), ec);
 		if (ec) return false;
 		return true;
 	}
 
 	bool resource_fork::seek(size_t pos, std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_seek, this, ec);
+		t.size(pos);
+		AFP_PROBE2(resource_fork__seek__entry, _fd, pos);
+		AFP_PROBE_RETURN(AFP_PROBE2(resource_fork__seek__return, _fd, ec.value()));
 		ec.clear();
 		_(::lseek(_fd, pos, SEEK_SET), ec);
 		if (ec) return false;
@@ -615,119 +866,634 @@ namespace afp {
 	}
 
 	size_t resource_fork::size(std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_size, this, ec);
+		AFP_PROBE1(resource_fork__size__entry, _fd);
+		AFP_PROBE_RETURN(AFP_PROBE2(resource_fork__size__return, _fd, ec.value()));
 		ec.clear();
 		struct stat st;
 		_(::fstat(_fd, &st), ec);
-		if (ec) return 0;
-		return st.st_size;
+		if (ec) return t.result<size_t>(0);
+		return t.result<size_t>(st.st_size);
+	}
+
+	void resource_fork::unmap() {
+		if (_map) ::munmap(_map, _map_size);
+		_map = nullptr;
+		_map_size = 0;
+		_buffer.clear();
+	}
+
+	byte_view resource_fork::view(std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_view, this, ec);
+		AFP_PROBE1(resource_fork__view__entry, _fd);
+		AFP_PROBE_RETURN(AFP_PROBE2(resource_fork__view__return, _fd, ec.value()));
+		ec.clear();
+
+		size_t n = size(ec);
+		if (ec) return byte_view();
+		if (_map && _map_size == n) return byte_view(_map, _map_size);
+
+		unmap();
+		if (n == 0) return byte_view();
+
+		void *p = ::mmap(nullptr, n, PROT_READ, MAP_SHARED, _fd, 0);
+		if (p != MAP_FAILED) {
+			_map = p;
+			_map_size = n;
+			return byte_view(_map, _map_size);
+		}
+
+		// not every filesystem can map a named fork; fall back to a private copy.
+		_buffer.resize(n);
+		auto rv = _(::pread(_fd, _buffer.data(), n, 0), ec);
+		if (ec) {
+			_buffer.clear();
+			return byte_view();
+		}
+		_buffer.resize(rv);
+		return byte_view(_buffer.data(), _buffer.size());
+	}
+
+	void resource_fork::invalidate() {
+		trace_hooks::scope t(afp::trace::resource_fork_invalidate, this);
+		AFP_PROBE1(resource_fork__invalidate__entry, _fd);
+		AFP_PROBE_RETURN(AFP_PROBE1(resource_fork__invalidate__return, _fd));
+		unmap();
+	}
+
+	void resource_fork::set_write_back(bool enable, size_t dirty_limit) {
+		trace_hooks::scope t(afp::trace::resource_fork_set_write_back, this);
+		t.mode(enable).size(dirty_limit);
+	}
+
+	void resource_fork::set_chunked(bool enable, size_t chunk_size) {
+		trace_hooks::scope t(afp::trace::resource_fork_set_chunked, this);
+		t.mode(enable).size(chunk_size);
+	}
+
+	bool resource_fork::flush(std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_flush, this, ec);
+		AFP_PROBE1(resource_fork__flush__entry, _fd);
+		AFP_PROBE_RETURN(AFP_PROBE2(resource_fork__flush__return, _fd, ec.value()));
+		ec.clear();
+		return true;
 	}
 
 #endif
 
 #ifdef XATTR_RESOURCE_FORK
 	namespace {
-		std::vector<uint8_t> read_rfork(int _fd, std::error_code &ec) {
-			std::vector<uint8_t> rv;
 
-			for(;;) {
-				ssize_t size = 0;
-				ssize_t tsize = 0;
+		uint64_t ctime_ns(const struct stat &st) {
+		#if defined(__linux__) || defined(__FreeBSD__)
+			return (uint64_t)st.st_ctim.tv_sec * 1000000000 + st.st_ctim.tv_nsec;
+		#else
+			return (uint64_t)st.st_ctime * 1000000000;
+		#endif
+		}
+
+		/* n.b. - re-uses the buffer's capacity */
+		bool read_rfork(int _fd, std::vector<uint8_t> &rv, std::error_code &ec) {
+			return read_xattr_speculative(rv,
+				[_fd](){ return ::size_xattr(_fd, XATTR_RESOURCEFORK_NAME); },
+				[_fd](void *buffer, size_t size){ return ::read_xattr(_fd, XATTR_RESOURCEFORK_NAME, buffer, size); },
+				ec);
+		}
 
-				rv.clear();
+		/*
+		 * chunked layout.  The index is 16 bytes:
+		 *   'afpc', chunk size (32-bit), fork size (64-bit), big endian.
+		 * chunk i holds bytes [i * chunk size, (i + 1) * chunk size); a missing
+		 * chunk (or the missing tail of a short one) reads as zeros.
+		 */
+		enum {
+			index_size = 16,
+			default_chunk_size = 3584, // one value (with its header and name) still fits an ext4 block.
+			max_chunk_size = 64 * 1024, // XATTR_SIZE_MAX
+		};
+
+		struct chunk_index {
+			uint32_t chunk_size = 0;
+			uint64_t size = 0;
+		};
+
+		struct chunk_name {
+			char name[sizeof(XATTR_RESOURCEFORK_NAME) + 24];
+			explicit chunk_name(uint64_t i) {
+				snprintf(name, sizeof(name), XATTR_RESOURCEFORK_NAME ".%llu", (unsigned long long)i);
+			}
+			operator const char *() const { return name; }
+		};
+
+		uint64_t chunk_count(const chunk_index &ix) {
+			return (ix.size + ix.chunk_size - 1) / ix.chunk_size;
+		}
+
+		/* rv is the getxattr result */
+		bool parse_index(const uint8_t *cp, ssize_t rv, chunk_index &ix, std::error_code &ec) {
+			if (rv < 0) {
+				remap_enoattr(ec);
+				return false;
+			}
+			if (rv != index_size || std::memcmp(cp, "afpc", 4)) {
+				ec = std::make_error_code(std::errc::illegal_byte_sequence);
+				return false;
+			}
+			ix.chunk_size = ((uint32_t)cp[4] << 24) | (cp[5] << 16) | (cp[6] << 8) | cp[7];
+			ix.size = 0;
+			for (int i = 8; i < 16; ++i) ix.size = (ix.size << 8) | cp[i];
+			if (ix.chunk_size == 0 || ix.chunk_size > max_chunk_size) {
+				ec = std::make_error_code(std::errc::illegal_byte_sequence);
+				return false;
+			}
+			return true;
+		}
+
+		bool read_index(int fd, chunk_index &ix, std::error_code &ec) {
+			uint8_t tmp[index_size];
+			auto rv = _(::read_xattr(fd, XATTR_RESOURCEFORK_INDEX_NAME, tmp, sizeof(tmp)), ec);
+			return parse_index(tmp, rv, ix, ec);
+		}
+
+		bool read_index_path(const char *path, chunk_index &ix, std::error_code &ec) {
+			uint8_t tmp[index_size];
+			auto rv = _(::read_xattr_path(path, XATTR_RESOURCEFORK_INDEX_NAME, tmp, sizeof(tmp)), ec);
+			return parse_index(tmp, rv, ix, ec);
+		}
+
+		bool read_chunked_path(const char *path, const chunk_index &ix, std::vector<uint8_t> &rv, std::error_code &ec) {
+			if (ix.size > SIZE_MAX) {
+				ec = std::make_error_code(std::errc::value_too_large);
+				return false;
+			}
+			rv.assign(ix.size, 0);
+			uint64_t count = chunk_count(ix);
+			for (uint64_t i = 0; i < count; ++i) {
+				uint64_t start = i * ix.chunk_size;
+				size_t n = std::min<uint64_t>(ix.chunk_size, ix.size - start);
+				// a chunk may be shorter than its slot (or missing); the rest stays zero.
+				auto ok = _(::read_xattr_path(path, chunk_name(i), rv.data() + start, n), ec);
+				if (ok < 0) {
+					remap_enoattr(ec);
+					if (ec.value() != ENODATA) return false;
+					ec.clear();
+				}
+			}
+			return true;
+		}
+
+		/* removes the chunks and the index */
+		bool remove_chunked(int fd, const chunk_index &ix, std::error_code &ec) {
+			uint64_t count = chunk_count(ix);
+			for (uint64_t i = 0; i < count; ++i) {
+				if (::remove_xattr(fd, chunk_name(i)) < 0 && errno != ENODATA && errno != ENOATTR) {
+					ec = std::error_code(errno, std::system_category());
+					return false;
+				}
+			}
+			_(::remove_xattr(fd, XATTR_RESOURCEFORK_INDEX_NAME), ec);
+			remap_enoattr(ec);
+			return !ec;
+		}
+	}
+
+	/*
+	 * load the fork into _buffer, unless the cached copy is still current.
+	 * ctime is updated whenever an extended attribute changes.
+	 */
+	bool resource_fork::load(std::error_code &ec) {
+		ec.clear();
+
+		// pending writes are newer than anything on disk.
+		if (_dirty) return true;
+
+		struct stat st;
+		if (_(::fstat(_fd, &st), ec) < 0) return false;
+
+		uint64_t ct = ctime_ns(st);
+		if (_cached && ct == _ctime) {
+			if (_absent) {
+				ec = std::make_error_code(std::errc::no_message_available);
+				return false;
+			}
+			return true;
+		}
+
+		_cached = false;
+		_absent = false;
+		_chunk_size = 0;
+		if (!read_rfork(_fd, _buffer, ec)) {
+			remap_enoattr(ec);
+			if (ec.value() != ENODATA) return false;
+
+			// chunks are read on demand; only the index is loaded.
+			chunk_index ix;
+			_buffer.clear();
+			if (read_index(_fd, ix, ec)) {
+				_chunk_size = ix.chunk_size;
+				_chunk_total = ix.size;
+			}
+			else if (ec.value() == ENODATA) _absent = true;
+			else return false;
+			ec.clear();
+		}
+		_ctime = ct;
+		_cached = true;
+		if (_absent) {
+			ec = std::make_error_code(std::errc::no_message_available);
+			return false;
+		}
+		return true;
+	}
+
+	/* refresh the ctime after we've updated the attribute ourselves */
+	void resource_fork::store() {
+		struct stat st;
+		std::error_code tmp;
+		if (_(::fstat(_fd, &st), tmp) < 0) {
+			invalidate();
+			return;
+		}
+		_ctime = ctime_ns(st);
+		_absent = false;
+		_cached = true;
+	}
+
+	void resource_fork::invalidate() {
+		trace_hooks::scope t(afp::trace::resource_fork_invalidate, this);
+		AFP_PROBE1(resource_fork__invalidate__entry, _fd);
+		AFP_PROBE_RETURN(AFP_PROBE1(resource_fork__invalidate__return, _fd));
+		_dirty = 0;
+		_buffer.clear();
+		_cached = false;
+		_absent = false;
+		_ctime = 0;
+		_chunk_size = 0;
+		_chunk_total = 0;
+	}
+
+	void resource_fork::set_write_back(bool enable, size_t dirty_limit) {
+		trace_hooks::scope t(afp::trace::resource_fork_set_write_back, this);
+		t.mode(enable).size(dirty_limit);
+		_write_back = enable;
+		_dirty_limit = dirty_limit;
+	}
+
+	void resource_fork::set_chunked(bool enable, size_t chunk_size) {
+		trace_hooks::scope t(afp::trace::resource_fork_set_chunked, this);
+		t.mode(enable).size(chunk_size);
+		if (!enable) _new_chunk_size = 0;
+		else if (!chunk_size) _new_chunk_size = default_chunk_size;
+		else _new_chunk_size = std::min<size_t>(chunk_size, max_chunk_size);
+	}
+
+	bool resource_fork::write_index(std::error_code &ec) {
+		uint8_t tmp[index_size];
+		std::memcpy(tmp, "afpc", 4);
+		for (int i = 0; i < 4; ++i) tmp[4 + i] = _chunk_size >> (24 - 8 * i);
+		for (int i = 0; i < 8; ++i) tmp[8 + i] = _chunk_total >> (56 - 8 * i);
+
+		_(::write_xattr(_fd, XATTR_RESOURCEFORK_INDEX_NAME, tmp, sizeof(tmp)), ec);
+		remap_enoattr(ec);
+		return !ec;
+	}
+
+	/*
+	 * switch the (loaded) fork to the chunked layout.  The chunks and index are
+	 * written before the single attribute is removed, and the single
+	 * attribute wins if both exist, so readers never see a partial fork.
+	 */
+	bool resource_fork::convert(std::error_code &ec) {
+		uint32_t cs = _new_chunk_size;
+		for (size_t pos = 0; pos < _buffer.size(); pos += cs) {
+			size_t n = std::min<size_t>(cs, _buffer.size() - pos);
+			if (_(::write_xattr(_fd, chunk_name(pos / cs), _buffer.data() + pos, n), ec) < 0) {
+				remap_enoattr(ec);
+				return false;
+			}
+		}
+
+		_chunk_size = cs;
+		_chunk_total = _buffer.size();
+		if (!write_index(ec)) {
+			_chunk_size = 0;
+			return false;
+		}
+
+		if (!_absent && ::remove_xattr(_fd, XATTR_RESOURCEFORK_NAME) < 0) {
+			_(-1, ec);
+			remap_enoattr(ec);
+			if (ec.value() != ENODATA) return false;
+			ec.clear();
+		}
+
+		_dirty = 0;
+		_buffer.clear();
+		store();
+		return true;
+	}
+
+	size_t resource_fork::read_chunked(uint64_t pos, void *buffer, size_t n, std::error_code &ec) {
+		if (pos >= _chunk_total) return 0;
+		n = std::min<uint64_t>(n, _chunk_total - pos);
+
+		const uint32_t cs = _chunk_size;
+		uint8_t *cp = (uint8_t *)buffer;
+		for (size_t done = 0; done < n; ) {
+			uint64_t i = (pos + done) / cs;
+			size_t within = (pos + done) % cs;
+			size_t k = std::min<size_t>(n - done, cs - within);
+
+			// whole chunks go straight to the caller's buffer.
+			uint8_t *dest = cp + done;
+			if (within || k != cs) {
+				_chunk.resize(cs);
+				dest = _chunk.data();
+			}
+
+			auto rv = _(::read_xattr(_fd, chunk_name(i), dest, cs), ec);
+			if (rv < 0) {
+				remap_enoattr(ec);
+				if (ec.value() != ENODATA) return 0;
 				ec.clear();
-				size = _(::size_xattr(_fd, XATTR_RESOURCEFORK_NAME), ec);
-				if (ec)  return rv;
+				rv = 0;
+			}
+			if ((size_t)rv < cs) std::memset(dest + rv, 0, cs - rv);
+			if (dest != cp + done) std::memcpy(cp + done, dest + within, k);
+			done += k;
+		}
+		return n;
+	}
+
+	size_t resource_fork::write_chunked(const void *buffer, size_t n, std::error_code &ec) {
+		const uint32_t cs = _chunk_size;
+		const uint8_t *cp = (const uint8_t *)buffer;
+		uint64_t end = _offset + n;
+
+		for (size_t done = 0; done < n; ) {
+			uint64_t pos = _offset + done;
+			uint64_t i = pos / cs;
+			size_t within = pos % cs;
+			size_t k = std::min<size_t>(n - done, cs - within);
+
+			uint64_t start = i * cs;
+			size_t length = start < _chunk_total ? std::min<uint64_t>(cs, _chunk_total - start) : 0;
+
+			const uint8_t *src = cp + done;
+			size_t src_size = k;
+			if (within || k < length) {
+				// read-modify-write of a partial chunk.
+				_chunk.resize(cs);
+				auto rv = _(::read_xattr(_fd, chunk_name(i), _chunk.data(), cs), ec);
+				if (rv < 0) {
+					remap_enoattr(ec);
+					if (ec.value() != ENODATA) return 0;
+					ec.clear();
+					rv = 0;
+				}
+				if ((size_t)rv < cs) std::memset(_chunk.data() + rv, 0, cs - rv);
+				std::memcpy(_chunk.data() + within, src, k);
+				src = _chunk.data();
+				src_size = std::max(length, within + k);
+			}
 
-				if (size == 0) return rv;
-				rv.resize(size);
+			if (_(::write_xattr(_fd, chunk_name(i), src, src_size), ec) < 0) {
+				remap_enoattr(ec);
+				return 0;
+			}
+			done += k;
+		}
+
+		if (end > _chunk_total) {
+			_chunk_total = end;
+			if (!write_index(ec)) return 0;
+		}
+		_offset = end;
+		store();
+		return n;
+	}
 
-				tsize = _(::read_xattr(_fd, XATTR_RESOURCEFORK_NAME, rv.data(), size), ec);
-				if (ec) {
-					if (ec.value() == ERANGE) continue;
-					rv.clear();
-					return rv;
+	bool resource_fork::truncate_chunked(size_t pos, std::error_code &ec) {
+		chunk_index ix;
+		ix.chunk_size = _chunk_size;
+		ix.size = _chunk_total;
+
+		if (pos == 0) {
+			bool ok = remove_chunked(_fd, ix, ec);
+			invalidate();
+			return ok;
+		}
+
+		if (pos < _chunk_total) {
+			const uint32_t cs = _chunk_size;
+			uint64_t keep = (pos + cs - 1) / cs;
+			for (uint64_t i = keep; i < chunk_count(ix); ++i) {
+				if (::remove_xattr(_fd, chunk_name(i)) < 0 && errno != ENODATA && errno != ENOATTR) {
+					_(-1, ec);
+					return false;
+				}
+			}
+
+			size_t tail = pos % cs;
+			if (tail) {
+				_chunk.resize(cs);
+				auto rv = _(::read_xattr(_fd, chunk_name(keep - 1), _chunk.data(), cs), ec);
+				if (rv < 0) {
+					remap_enoattr(ec);
+					if (ec.value() != ENODATA) return false;
+					ec.clear();
+				}
+				else if ((size_t)rv > tail && _(::write_xattr(_fd, chunk_name(keep - 1), _chunk.data(), tail), ec) < 0) {
+					remap_enoattr(ec);
+					return false;
 				}
-				rv.resize(tsize);
-				return rv;
 			}
 		}
+
+		_chunk_total = pos;
+		if (!write_index(ec)) return false;
+		_offset = pos;
+		store();
+		return true;
 	}
 
-	bool resource_fork::open(const std::string &path, open_mode mode, std::error_code &ec) {
+	bool resource_fork::flush(std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_flush, this, ec);
+		AFP_PROBE1(resource_fork__flush__entry, _fd);
+		AFP_PROBE_RETURN(AFP_PROBE2(resource_fork__flush__return, _fd, ec.value()));
+		ec.clear();
+		if (!_dirty) return true;
+
+		auto rv = _(::write_xattr(_fd, XATTR_RESOURCEFORK_NAME, _buffer.data(), _buffer.size()), ec);
+		if (ec) {
+			// the pending data is kept so the caller may retry.
+			remap_enoattr(ec);
+			return false;
+		}
+		_dirty = 0;
+		store();
+		return true;
+	}
+
+	bool resource_fork::open_at(int dirfd, const std::string &path, open_mode mode, std::error_code &ec) {
 		close();
 		ec.clear();
 
-		_fd = openX(path, ec);
+		int fd = openX(dirfd, path, ec);
 		if (ec) return false;
 
+		return open_fd(fd, true, mode, ec);
+	}
+
+	/* the attribute is accessed through the file's own descriptor */
+	bool resource_fork::open_fd(int fd, bool owned, open_mode mode, std::error_code &ec) {
+
+		_fd = fd;
+		_owned = owned;
 		_mode = mode;
 		_offset = 0;
 		return true;
 	}
 
 	size_t resource_fork::size(std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_size, this, ec);
+		AFP_PROBE1(resource_fork__size__entry, _fd);
+		AFP_PROBE_RETURN(AFP_PROBE2(resource_fork__size__return, _fd, ec.value()));
 		ec.clear();
+
+		if (_cached) {
+			if (!load(ec)) return t.result<size_t>(0);
+			return t.result<size_t>(_chunk_size ? _chunk_total : _buffer.size());
+		}
+
 		auto rv = _(::size_xattr(_fd, XATTR_RESOURCEFORK_NAME), ec);
 		if (ec) {
 			remap_enoattr(ec);
-			return 0;
+			if (ec.value() != ENODATA) return t.result<size_t>(0);
+
+			chunk_index ix;
+			ec.clear();
+			if (!read_index(_fd, ix, ec)) return t.result<size_t>(0);
+			return t.result<size_t>(ix.size);
+		}
+		return t.result<size_t>(rv);
+	}
+
+	/* size(path) with the metadata cache enabled */
+	size_t resource_fork::size_cached(int dirfd, const std::string &path, std::error_code &ec) {
+		ec.clear();
+
+		struct stat st;
+		int fd = openX(dirfd, path, ec, &st);
+		if (ec) return 0;
+
+		uint64_t size;
+		bool present;
+		if (metadata_cache::find_fork_size(st, size, present)) {
+			::close(fd);
+			if (!present) ec = std::error_code(ENODATA, std::system_category());
+			return size;
+		}
+
+		bool settled = metadata_cache::settled(st);
+		resource_fork rf;
+		rf.open_fd(fd, true, read_only, ec);
+		size_t rv = rf.size(ec);
+		if (settled) {
+			if (!ec) metadata_cache::store_fork_size(st, rv);
+			else if (ec.value() == ENODATA) metadata_cache::store_no_fork(st);
 		}
 		return rv;
 	}
 
 	size_t resource_fork::read(void *buffer, size_t n, std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_read, this, ec);
+		t.size(n).offset(_offset);
+		size_t count = 0;
+		AFP_PROBE2(resource_fork__read__entry, _fd, n);
+		AFP_PROBE_RETURN(AFP_PROBE3(resource_fork__read__return, _fd, count, ec.value()));
 		ec.clear();
 		if (_fd < 0 || _mode == write_only) {
 			ec = std::make_error_code(std::errc::bad_file_descriptor);
-			return 0;
+			return t.result<size_t>(0);
 		}
 
-		if (n == 0) return 0;
+		if (n == 0) return t.result<size_t>(0);
 
-		auto tmp = read_rfork(_fd, ec);
-		if (ec) {
-			remap_enoattr(ec);
-			return 0;
+		if (!load(ec)) return t.result<size_t>(0);
+
+		if (_chunk_size) {
+			count = read_chunked(_offset, buffer, n, ec);
+			_offset += count;
+			return t.result(count);
 		}
 
-		if (_offset >= tmp.size()) return 0;
-		size_t count = std::min(n, tmp.size() - _offset);
+		if (_offset >= _buffer.size()) return t.result<size_t>(0);
+		count = std::min(n, _buffer.size() - _offset);
 
-		std::memcpy(buffer, tmp.data() + _offset, count);
+		std::memcpy(buffer, _buffer.data() + _offset, count);
+		afp_stats_add(AFP_STATS_BYTES_COPIED, count);
 		_offset += count;
-		return count;
+		return t.result(count);
 	}
 
 	size_t resource_fork::write(const void *buffer, size_t n, std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_write, this, ec);
+		t.size(n).offset(_offset);
+		size_t count = 0;
+		AFP_PROBE2(resource_fork__write__entry, _fd, n);
+		AFP_PROBE_RETURN(AFP_PROBE3(resource_fork__write__return, _fd, count, ec.value()));
 		ec.clear();
 		if (_fd < 0 || _mode == read_only) {
 			ec = std::make_error_code(std::errc::bad_file_descriptor);
-			return 0;
+			return t.result<size_t>(0);
 		}
 
-		if (n == 0) return 0;
+		if (n == 0) return t.result<size_t>(0);
 
-		auto tmp = read_rfork(_fd, ec);
-		if (ec) {
-			remap_enoattr(ec);
-			return 0;
+		// writing to a missing fork creates it.
+		if (!load(ec)) {
+			if (ec.value() != ENODATA) return t.result<size_t>(0);
+			ec.clear();
 		}
 
-		if (_offset > tmp.size()) {
-			tmp.resize(_offset);
+		if (!_chunk_size && _new_chunk_size && !convert(ec)) return t.result<size_t>(0);
+		if (_chunk_size) {
+			count = write_chunked(buffer, n, ec);
+			return t.result(count);
 		}
-		tmp.insert(tmp.end(), (const uint8_t *)buffer, (const uint8_t *)buffer + n);
 
-		auto rv = _(::write_xattr(_fd, XATTR_RESOURCEFORK_NAME, tmp.data(), tmp.size()), ec);
-		if (ec) {
-			remap_enoattr(ec);
-			return 0;
+		if (_offset + n > _buffer.size()) {
+			_buffer.resize(_offset + n);
 		}
+		std::memcpy(_buffer.data() + _offset, buffer, n);
+		_dirty += n;
+		count = n;
 
-		return n;
+		if (_write_back && (!_dirty_limit || _dirty < _dirty_limit)) {
+			_offset += n;
+			return t.result(count);
+		}
+
+		if (!flush(ec)) {
+			// write-back keeps the data pending for a later flush; otherwise nothing was written.
+			if (!_write_back) {
+				invalidate();
+				count = 0;
+				return t.result(count);
+			}
+			_offset += n;
+			return t.result(count);
+		}
+		_offset += n;
+		return t.result(count);
 	}
 
 	bool resource_fork::truncate(size_t pos, std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_truncate, this, ec);
+		t.size(pos);
+		AFP_PROBE2(resource_fork__truncate__entry, _fd, pos);
+		AFP_PROBE_RETURN(AFP_PROBE2(resource_fork__truncate__return, _fd, ec.value()));
 
 		ec.clear();
 		if (_fd < 0 || _mode == read_only) {
@@ -735,25 +1501,32 @@ namespace afp {
 			return 0;
 		}
 
+		if (!load(ec)) {
+			if (ec.value() != ENODATA) return false;
+			ec.clear();
+		}
+		if (_chunk_size) return truncate_chunked(pos, ec);
+
 		// simple case..
 		if (pos == 0) {
 			auto rv = _(::remove_xattr(_fd, XATTR_RESOURCEFORK_NAME), ec);
 			if (ec) {
 				remap_enoattr(ec); // consider that ok?
+				// with nothing on disk, only the pending data was left to drop.
+				if (!_write_back || ec.value() == ENODATA) invalidate();
 				return false;
 			}
+			invalidate();
 			return true;
 		}
-		auto tmp = read_rfork(_fd, ec);
-		if (ec) {
-			remap_enoattr(ec);
-			return false;
-		}
-		if (tmp.size() == pos) return true;
-		tmp.resize(pos);
-		auto rv = _(::write_xattr(_fd, XATTR_RESOURCEFORK_NAME, tmp.data(), pos), ec);
-		if (ec) {
-			remap_enoattr(ec);
+		if (!load(ec)) return false;
+
+		if (_buffer.size() == pos && !_dirty) return true;
+		_buffer.resize(pos);
+		if (!_dirty) _dirty = 1;
+		if (!flush(ec)) {
+			// as write(): write-back keeps it pending for a later flush.
+			if (!_write_back) invalidate();
 			return false;
 		}
 
@@ -761,6 +1534,10 @@ namespace afp {
 		return true;
 	}
 	bool resource_fork::seek(size_t pos, std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_seek, this, ec);
+		t.size(pos);
+		AFP_PROBE2(resource_fork__seek__entry, _fd, pos);
+		AFP_PROBE_RETURN(AFP_PROBE2(resource_fork__seek__return, _fd, ec.value()));
 		ec.clear();
 		if (_fd < 0) {
 			ec = std::make_error_code(std::errc::bad_file_descriptor);
@@ -771,51 +1548,257 @@ namespace afp {
 		return true;
 	}
 
+	byte_view resource_fork::view(std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_view, this, ec);
+		AFP_PROBE1(resource_fork__view__entry, _fd);
+		AFP_PROBE_RETURN(AFP_PROBE2(resource_fork__view__return, _fd, ec.value()));
+		ec.clear();
+		if (_fd < 0 || _mode == write_only) {
+			ec = std::make_error_code(std::errc::bad_file_descriptor);
+			return byte_view();
+		}
 
-	bool resource_fork::remove(const std::string &path, std::error_code &ec) {
+		if (!load(ec)) return byte_view();
+
+		if (_chunk_size) {
+			// the view needs the fork in one piece.
+			if (_chunk_total > SIZE_MAX) {
+				ec = std::make_error_code(std::errc::value_too_large);
+				return byte_view();
+			}
+			_buffer.resize(_chunk_total);
+			read_chunked(0, _buffer.data(), _buffer.size(), ec);
+			if (ec) {
+				_buffer.clear();
+				return byte_view();
+			}
+		}
+		return byte_view(_buffer.data(), _buffer.size());
+	}
+
+
+	bool resource_fork::remove_at(int dirfd, const std::string &path, std::error_code &ec) {
 		ec.clear();
 
-		int fd = openX(path, ec);
+		int fd = openX(dirfd, path, ec);
 		if (ec) return false;
 
 		int rv = _(::remove_xattr(fd, XATTR_RESOURCEFORK_NAME), ec);
-		::close(fd);
+		remap_enoattr(ec);
+		if (rv < 0 && ec.value() != ENODATA) {
+			::close(fd);
+			return false;
+		}
 
-		if (rv < 0) {
-			remap_enoattr(ec);
-			if (ec.value() == ENODATA) return true;
+		// and the chunked layout, if there is one.
+		chunk_index ix;
+		std::error_code tmp;
+		if (read_index(fd, ix, tmp)) {
+			if (!remove_chunked(fd, ix, tmp)) {
+				::close(fd);
+				ec = tmp;
+				return false;
+			}
+			ec.clear();
 		}
-		return rv == 0;
+		else if (tmp.value() != ENODATA) ec = tmp;
+		::close(fd);
+
+		// ENODATA (nothing to remove) is reported, but isn't a failure.
+		return !ec || ec.value() == ENODATA;
 
 	}
 
-	size_t resource_fork::write(const std::string &path, const void *buffer, size_t n, std::error_code &ec) {
+	size_t resource_fork::write_at(int dirfd, const std::string &path, const void *buffer, size_t n, std::error_code &ec) {
 		ec.clear();
 
-		int fd = openX(path, ec);
+		int fd = openX(dirfd, path, ec);
 		if (ec) return false;
 
 		auto rv = _(::write_xattr(fd, XATTR_RESOURCEFORK_NAME, buffer, n), ec);
-		::close(fd);
-
 		if (rv < 0) {
+			::close(fd);
 			remap_enoattr(ec);
 			return 0;
 		}
+
+		// a chunked copy would be stale now.
+		chunk_index ix;
+		std::error_code tmp;
+		if (read_index(fd, ix, tmp)) remove_chunked(fd, ix, tmp);
+		::close(fd);
 		return rv;
 	}
 
 
 
 
+#endif
+
+#ifndef _WIN32
+	bool resource_fork::open(const std::string &path, open_mode mode, std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_open, this, ec);
+		t.path(path).mode(mode);
+		AFP_PROBE3(resource_fork__open__entry, AT_FDCWD, path.c_str(), (int)mode);
+		bool ok = open_at(AT_FDCWD, path, mode, ec);
+		AFP_PROBE4(resource_fork__open__return, AT_FDCWD, path.c_str(), _fd, ec.value());
+		return ok;
+	}
+
+	bool resource_fork::open(const directory &dir, const std::string &name, open_mode mode, std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_open, this, ec);
+		t.path(name).mode(mode);
+		AFP_PROBE3(resource_fork__open__entry, dir.fd(), name.c_str(), (int)mode);
+		bool ok = open_at(dir.fd(), name, mode, ec);
+		AFP_PROBE4(resource_fork__open__return, dir.fd(), name.c_str(), _fd, ec.value());
+		return ok;
+	}
+
+	bool resource_fork::attach(int fd, open_mode mode, unsigned flags, std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_attach, this, ec);
+		t.mode(mode).size(flags);
+		AFP_PROBE3(resource_fork__attach__entry, fd, (int)mode, flags);
+		AFP_PROBE_RETURN(AFP_PROBE2(resource_fork__attach__return, fd, ec.value()));
+		ec.clear();
+		close();
+
+		if (!(flags & trusted) && !regular_file(fd, ec)) {
+			if (flags & adopt) ::close(fd);
+			return false;
+		}
+		return open_fd(fd, flags & adopt, mode, ec);
+	}
+
+	bool resource_fork::remove(const std::string &path, std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_remove, nullptr, ec);
+		t.path(path);
+		AFP_PROBE2(resource_fork__remove__entry, AT_FDCWD, path.c_str());
+		bool ok = remove_at(AT_FDCWD, path, ec);
+		AFP_PROBE3(resource_fork__remove__return, AT_FDCWD, path.c_str(), ec.value());
+		return ok;
+	}
+
+	bool resource_fork::remove(const directory &dir, const std::string &name, std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_remove, nullptr, ec);
+		t.path(name);
+		AFP_PROBE2(resource_fork__remove__entry, dir.fd(), name.c_str());
+		bool ok = remove_at(dir.fd(), name, ec);
+		AFP_PROBE3(resource_fork__remove__return, dir.fd(), name.c_str(), ec.value());
+		return ok;
+	}
+
+	size_t resource_fork::write(const std::string &path, const void *buffer, size_t n, std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_write_path, nullptr, ec);
+		t.path(path).size(n);
+		AFP_PROBE3(resource_fork__write_path__entry, AT_FDCWD, path.c_str(), n);
+		size_t rv = write_at(AT_FDCWD, path, buffer, n, ec);
+		AFP_PROBE4(resource_fork__write_path__return, AT_FDCWD, path.c_str(), rv, ec.value());
+		return t.result(rv);
+	}
+
+	size_t resource_fork::write(const directory &dir, const std::string &name, const void *buffer, size_t n, std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_write_path, nullptr, ec);
+		t.path(name).size(n);
+		AFP_PROBE3(resource_fork__write_path__entry, dir.fd(), name.c_str(), n);
+		size_t rv = write_at(dir.fd(), name, buffer, n, ec);
+		AFP_PROBE4(resource_fork__write_path__return, dir.fd(), name.c_str(), rv, ec.value());
+		return t.result(rv);
+	}
+
+	size_t resource_fork::size(const directory &dir, const std::string &name, std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_size_path, nullptr, ec);
+		t.path(name);
+	#ifdef XATTR_RESOURCE_FORK
+		if (metadata_cache::enabled()) return t.result(size_cached(dir.fd(), name, ec));
+	#endif
+		resource_fork rf;
+		rf.open(dir, name, read_only, ec);
+		if (ec) return t.result<size_t>(0);
+		return t.result(rf.size(ec));
+	}
 #endif
 
 	size_t resource_fork::size(const std::string &path, std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_size_path, nullptr, ec);
+		t.path(path);
+	#ifdef XATTR_RESOURCE_FORK
+		if (metadata_cache::enabled()) return t.result(size_cached(AT_FDCWD, path, ec));
+	#endif
 		resource_fork rf;
 		rf.open(path, read_only, ec);
-		if (ec) return 0;
-		return rf.size(ec);
+		if (ec) return t.result<size_t>(0);
+		return t.result(rf.size(ec));
+	}
+
+#if defined(XATTR_RESOURCE_FORK) || defined(__APPLE__)
+	size_t resource_fork::size_fast(const std::string &path, std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_size_fast, nullptr, ec);
+		t.path(path);
+		AFP_PROBE1(resource_fork__size_fast__entry, path.c_str());
+		AFP_PROBE_RETURN(AFP_PROBE2(resource_fork__size_fast__return, path.c_str(), ec.value()));
+		ec.clear();
+		auto rv = _(::size_xattr_path(path.c_str(), XATTR_RESOURCEFORK_NAME), ec);
+		if (ec) {
+			remap_enoattr(ec);
+		#ifdef XATTR_RESOURCE_FORK
+			if (ec.value() == ENODATA) {
+				chunk_index ix;
+				if (read_index_path(path.c_str(), ix, ec)) return t.result<size_t>(ix.size);
+			}
+		#endif
+			classify(path, ec);
+			return t.result<size_t>(0);
+		}
+		return t.result<size_t>(rv);
+	}
+
+	size_t resource_fork::read_fast(const std::string &path, std::vector<uint8_t> &buffer, std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_read_fast, nullptr, ec);
+		t.path(path);
+		AFP_PROBE1(resource_fork__read_fast__entry, path.c_str());
+		AFP_PROBE_RETURN(AFP_PROBE3(resource_fork__read_fast__return, path.c_str(), buffer.size(), ec.value()));
+		const char *cp = path.c_str();
+		bool ok = read_xattr_speculative(buffer,
+			[cp](){ return ::size_xattr_path(cp, XATTR_RESOURCEFORK_NAME); },
+			[cp](void *buffer, size_t size){ return ::read_xattr_path(cp, XATTR_RESOURCEFORK_NAME, buffer, size); },
+			ec);
+		if (!ok) {
+			remap_enoattr(ec);
+		#ifdef XATTR_RESOURCE_FORK
+			if (ec.value() == ENODATA) {
+				chunk_index ix;
+				if (read_index_path(cp, ix, ec) && read_chunked_path(cp, ix, buffer, ec))
+					return t.result(buffer.size());
+			}
+		#endif
+			classify(path, ec);
+			return t.result<size_t>(0);
+		}
+		return t.result(buffer.size());
 	}
+#else
+	size_t resource_fork::size_fast(const std::string &path, std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_size_fast, nullptr, ec);
+		t.path(path);
+		AFP_PROBE1(resource_fork__size_fast__entry, path.c_str());
+		AFP_PROBE_RETURN(AFP_PROBE2(resource_fork__size_fast__return, path.c_str(), ec.value()));
+		return t.result(size(path, ec));
+	}
+
+	size_t resource_fork::read_fast(const std::string &path, std::vector<uint8_t> &buffer, std::error_code &ec) {
+		trace_hooks::scope t(afp::trace::resource_fork_read_fast, nullptr, ec);
+		t.path(path);
+		AFP_PROBE1(resource_fork__read_fast__entry, path.c_str());
+		AFP_PROBE_RETURN(AFP_PROBE3(resource_fork__read_fast__return, path.c_str(), buffer.size(), ec.value()));
+		resource_fork rf;
+		buffer.clear();
+		if (!rf.open(path, read_only, ec)) return t.result<size_t>(0);
+		auto v = rf.view(ec);
+		if (ec) return t.result<size_t>(0);
+		buffer.assign(v.begin(), v.end());
+		return t.result(buffer.size());
+	}
+#endif
 
 #ifdef _WIN32
 	size_t resource_fork::size(const std::wstring &path, std::error_code &ec) {
@@ -0,0 +1,200 @@
+#include "resource_fork_builder.h"
+#include "resource_fork.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+	enum {
+		header_size = 256,
+		map_header_size = 28,
+		type_size = 8,
+		reference_size = 12,
+	};
+
+	uint8_t *write16(uint8_t *cp, uint16_t x) {
+		cp[0] = x >> 8;
+		cp[1] = x;
+		return cp + 2;
+	}
+
+	uint8_t *write24(uint8_t *cp, uint32_t x) {
+		cp[0] = x >> 16;
+		cp[1] = x >> 8;
+		cp[2] = x;
+		return cp + 3;
+	}
+
+	uint8_t *write32(uint8_t *cp, uint32_t x) {
+		cp[0] = x >> 24;
+		cp[1] = x >> 16;
+		cp[2] = x >> 8;
+		cp[3] = x;
+		return cp + 4;
+	}
+
+}
+
+namespace afp {
+
+	void resource_fork_builder::clear() {
+		_resources.clear();
+		_data_size = 0;
+		_names.clear();
+		_attributes = 0;
+		_overflow = false;
+	}
+
+	void resource_fork_builder::add(uint32_t type, int16_t id, const void *data, size_t size, uint8_t attributes) {
+
+		resource r;
+		r.type = type;
+		r.id = id;
+		r.attributes = attributes;
+		r.name = 0xffff;
+		r.offset = _data_size;
+		r.data = (const uint8_t *)data;
+		r.size = size;
+
+		if (size > 0xffffffff || _data_size + 4 + size > 0xffffffff) _overflow = true;
+		_data_size += 4 + size;
+
+		_resources.push_back(r);
+	}
+
+	void resource_fork_builder::add(uint32_t type, int16_t id, const std::string &name, const void *data, size_t size, uint8_t attributes) {
+
+		add(type, id, data, size, attributes);
+
+		if (name.size() > 255 || _names.size() + 1 + name.size() > 0xffff) {
+			_overflow = true;
+			return;
+		}
+
+		_resources.back().name = _names.size();
+		_names.push_back(name.size());
+		_names.insert(_names.end(), name.begin(), name.end());
+	}
+
+	std::vector<uint8_t> resource_fork_builder::build(std::error_code &ec) const {
+
+		std::vector<uint8_t> rv;
+		ec.clear();
+
+		if (_overflow) {
+			ec = std::make_error_code(std::errc::value_too_large);
+			return rv;
+		}
+
+		// type list is sorted by type, reference lists by id.
+		std::vector<const resource *> sorted;
+		sorted.reserve(_resources.size());
+		for (const auto &r : _resources) sorted.push_back(&r);
+		std::stable_sort(sorted.begin(), sorted.end(), [](const resource *a, const resource *b){
+			if (a->type != b->type) return a->type < b->type;
+			return a->id < b->id;
+		});
+
+		size_t type_count = 0;
+		for (size_t i = 0; i < sorted.size(); ++i) {
+			if (i && sorted[i]->type == sorted[i - 1]->type) {
+				if (sorted[i]->id == sorted[i - 1]->id) {
+					ec = std::make_error_code(std::errc::invalid_argument);
+					return rv;
+				}
+				continue;
+			}
+			++type_count;
+		}
+
+		size_t type_list_size = 2 + type_count * type_size + sorted.size() * reference_size;
+		size_t map_size = map_header_size + type_list_size + _names.size();
+		size_t data_size = _data_size;
+
+		// reference offsets are 16-bit (from the type list), data offsets are 24-bit.
+		if (type_list_size > 0xffff || map_header_size + type_list_size > 0xffff) {
+			ec = std::make_error_code(std::errc::value_too_large);
+			return rv;
+		}
+		for (const auto *r : sorted) {
+			if (r->offset > 0xffffff) {
+				ec = std::make_error_code(std::errc::value_too_large);
+				return rv;
+			}
+		}
+		if ((uint64_t)header_size + data_size + map_size > 0xffffffff) {
+			ec = std::make_error_code(std::errc::file_too_large);
+			return rv;
+		}
+
+		rv.resize(header_size + data_size + map_size);
+		uint8_t *base = rv.data();
+
+		uint32_t data_offset = header_size;
+		uint32_t map_offset = header_size + data_size;
+
+		uint8_t *cp = base;
+		cp = write32(cp, data_offset);
+		cp = write32(cp, map_offset);
+		cp = write32(cp, data_size);
+		cp = write32(cp, map_size);
+		// 240 bytes reserved for system / application use are already zero.
+
+		// the data area, in the order added; each resource's only copy.
+		for (const auto &r : _resources) {
+			cp = write32(base + data_offset + r.offset, r.size);
+			if (r.size) std::memcpy(cp, r.data, r.size);
+		}
+
+		uint8_t *map = base + map_offset;
+		std::memcpy(map, base, 16);
+		cp = map + 22;
+		cp = write16(cp, _attributes);
+		cp = write16(cp, map_header_size);
+		cp = write16(cp, map_header_size + type_list_size);
+
+		uint8_t *types = map + map_header_size;
+		uint8_t *tp = types;
+		uint8_t *rp = types + 2 + type_count * type_size;
+
+		tp = write16(tp, type_count - 1);
+		for (size_t i = 0; i < sorted.size(); ) {
+			uint32_t type = sorted[i]->type;
+			size_t j = i;
+			while (j < sorted.size() && sorted[j]->type == type) ++j;
+
+			tp = write32(tp, type);
+			tp = write16(tp, j - i - 1);
+			tp = write16(tp, rp - types);
+
+			for (; i < j; ++i) {
+				const resource *r = sorted[i];
+				rp = write16(rp, r->id);
+				rp = write16(rp, r->name);
+				*rp++ = r->attributes;
+				rp = write24(rp, r->offset);
+				rp = write32(rp, 0);
+			}
+		}
+
+		if (!_names.empty()) std::memcpy(rp, _names.data(), _names.size());
+
+		return rv;
+	}
+
+	size_t resource_fork_builder::write(const std::string &path, std::error_code &ec) const {
+		auto tmp = build(ec);
+		if (ec) return 0;
+		return resource_fork::write(path, tmp.data(), tmp.size(), ec);
+	}
+
+#if defined(_WIN32) || defined(__CYGWIN__) || defined(__MSYS__)
+	size_t resource_fork_builder::write(const std::wstring &path, std::error_code &ec) const {
+		auto tmp = build(ec);
+		if (ec) return 0;
+		return resource_fork::write(path, tmp.data(), tmp.size(), ec);
+	}
+#endif
+
+}
@@ -0,0 +1,227 @@
+#include "resource_map.h"
+#include "resource_fork.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+	/*
+	 * Inside Macintosh: More Macintosh Toolbox, 1-121
+	 *
+	 * resource header (16 bytes, followed by 240 reserved bytes):
+	 *   data offset, map offset, data length, map length
+	 *
+	 * resource map:
+	 *   +0   copy of the header
+	 *   +16  next map handle
+	 *   +20  file reference number
+	 *   +22  attributes
+	 *   +24  offset to the type list (from the map)
+	 *   +26  offset to the name list (from the map)
+	 *
+	 * type list: count - 1, then 8 bytes per type:
+	 *   type, count - 1, offset to the reference list (from the type list)
+	 *
+	 * reference list, 12 bytes per resource:
+	 *   id, name offset (from the name list) or -1, attributes,
+	 *   24-bit data offset (from the data), handle
+	 */
+
+	uint16_t read16(const uint8_t *cp) {
+		return (cp[0] << 8) | cp[1];
+	}
+
+	uint32_t read24(const uint8_t *cp) {
+		return (cp[0] << 16) | (cp[1] << 8) | cp[2];
+	}
+
+	uint32_t read32(const uint8_t *cp) {
+		return ((uint32_t)cp[0] << 24) | (cp[1] << 16) | (cp[2] << 8) | cp[3];
+	}
+
+	typedef afp::resource_map::entry entry;
+
+	bool by_id(const entry &a, const entry &b) {
+		if (a.type != b.type) return a.type < b.type;
+		return a.id < b.id;
+	}
+
+	int compare(afp::byte_view a, afp::byte_view b) {
+		size_t n = std::min(a.size(), b.size());
+		int rv = n ? std::memcmp(a.data(), b.data(), n) : 0;
+		if (rv) return rv;
+		if (a.size() == b.size()) return 0;
+		return a.size() < b.size() ? -1 : 1;
+	}
+
+}
+
+namespace afp {
+
+	void resource_map::clear() {
+		_fork = byte_view();
+		_names = byte_view();
+		_attributes = 0;
+		_entries.clear();
+		_by_name.clear();
+	}
+
+	bool resource_map::read(resource_fork &rf, std::error_code &ec) {
+		clear();
+		byte_view v = rf.view(ec);
+		if (ec) return false;
+		return read(v, ec);
+	}
+
+	bool resource_map::read(byte_view fork, std::error_code &ec) {
+		ec.clear();
+		clear();
+
+		auto bad = [&ec, this](){
+			clear();
+			ec = std::make_error_code(std::errc::illegal_byte_sequence);
+			return false;
+		};
+
+		if (fork.size() < 16) return bad();
+
+		uint32_t data_offset = read32(fork.data() + 0);
+		uint32_t map_offset = read32(fork.data() + 4);
+		uint32_t data_length = read32(fork.data() + 8);
+		uint32_t map_length = read32(fork.data() + 12);
+
+		if ((uint64_t)data_offset + data_length > fork.size()) return bad();
+		if ((uint64_t)map_offset + map_length > fork.size()) return bad();
+		if (map_length < 30) return bad();
+
+		byte_view map = fork.substr(map_offset, map_length);
+
+		uint16_t type_offset = read16(map.data() + 24);
+		uint16_t name_offset = read16(map.data() + 26);
+
+		if (type_offset + 2 > map.size()) return bad();
+		if (name_offset > map.size()) return bad();
+
+		byte_view types = map.substr(type_offset);
+		unsigned type_count = (read16(types.data()) + 1) & 0xffff;
+
+		if (2 + type_count * 8 > types.size()) return bad();
+
+		// count first so the index is allocated once.
+		size_t total = 0;
+		for (unsigned i = 0; i < type_count; ++i) {
+			const uint8_t *tp = types.data() + 2 + i * 8;
+			total += read16(tp + 4) + 1;
+		}
+		_entries.reserve(total);
+
+		for (unsigned i = 0; i < type_count; ++i) {
+			const uint8_t *tp = types.data() + 2 + i * 8;
+			uint32_t type = read32(tp);
+			unsigned count = read16(tp + 4) + 1;
+			uint32_t ref_offset = read16(tp + 6);
+
+			if (ref_offset + count * 12 > types.size()) return bad();
+
+			for (unsigned j = 0; j < count; ++j) {
+				const uint8_t *rp = types.data() + ref_offset + j * 12;
+				entry e;
+				e.type = type;
+				e.id = (int16_t)read16(rp);
+				e.name = read16(rp + 2);
+				e.attributes = rp[4];
+				e.offset = data_offset + read24(rp + 5);
+
+				if (e.offset + 4 > fork.size()) return bad();
+				_entries.push_back(e);
+			}
+		}
+
+		std::sort(_entries.begin(), _entries.end(), by_id);
+
+		_fork = fork;
+		_names = map.substr(name_offset);
+		_attributes = read16(map.data() + 22);
+
+		for (uint32_t i = 0; i < _entries.size(); ++i) {
+			const entry &e = _entries[i];
+			if (e.name == 0xffff) continue;
+			if (e.name >= _names.size() || e.name + 1 + _names[e.name] > _names.size()) return bad();
+			_by_name.push_back(i);
+		}
+
+		std::sort(_by_name.begin(), _by_name.end(), [this](uint32_t a, uint32_t b){
+			const entry &ea = _entries[a];
+			const entry &eb = _entries[b];
+			if (ea.type != eb.type) return ea.type < eb.type;
+			return compare(name_view(ea), name_view(eb)) < 0;
+		});
+
+		return true;
+	}
+
+	std::vector<uint32_t> resource_map::types() const {
+		std::vector<uint32_t> rv;
+		for (const auto &e : _entries) {
+			if (rv.empty() || rv.back() != e.type) rv.push_back(e.type);
+		}
+		return rv;
+	}
+
+	size_t resource_map::count(uint32_t type) const {
+		entry lo, hi;
+		lo.type = hi.type = type;
+		lo.id = INT16_MIN;
+		hi.id = INT16_MAX;
+		auto a = std::lower_bound(_entries.begin(), _entries.end(), lo, by_id);
+		auto b = std::upper_bound(a, _entries.end(), hi, by_id);
+		return b - a;
+	}
+
+	const resource_map::entry *resource_map::find(uint32_t type, int16_t id) const {
+		entry key;
+		key.type = type;
+		key.id = id;
+		auto iter = std::lower_bound(_entries.begin(), _entries.end(), key, by_id);
+		if (iter == _entries.end() || iter->type != type || iter->id != id) return nullptr;
+		return &*iter;
+	}
+
+	const resource_map::entry *resource_map::find(uint32_t type, const std::string &name) const {
+		byte_view key(name.data(), name.size());
+
+		auto iter = std::lower_bound(_by_name.begin(), _by_name.end(), key, [this, type](uint32_t i, byte_view key){
+			const entry &e = _entries[i];
+			if (e.type != type) return e.type < type;
+			return compare(name_view(e), key) < 0;
+		});
+		if (iter == _by_name.end()) return nullptr;
+
+		const entry &e = _entries[*iter];
+		if (e.type != type || compare(name_view(e), key) != 0) return nullptr;
+		return &e;
+	}
+
+	byte_view resource_map::name_view(const entry &e) const {
+		if (e.name == 0xffff) return byte_view();
+		return _names.substr(e.name + 1, _names[e.name]);
+	}
+
+	std::string resource_map::name(const entry &e) const {
+		byte_view v = name_view(e);
+		return std::string(v.begin(), v.end());
+	}
+
+	byte_view resource_map::data(const entry &e, std::error_code &ec) const {
+		ec.clear();
+
+		uint32_t length = read32(_fork.data() + e.offset);
+		if ((uint64_t)e.offset + 4 + length > _fork.size()) {
+			ec = std::make_error_code(std::errc::illegal_byte_sequence);
+			return byte_view();
+		}
+		return _fork.substr(e.offset + 4, length);
+	}
+
+}
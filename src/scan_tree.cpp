@@ -0,0 +1,282 @@
+#include "scan_tree.h"
+#include "finder_info.h"
+#include "resource_fork.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+namespace {
+
+	template<class T>
+	T _(T x, std::error_code &ec) {
+		if (x < 0) ec = std::error_code(errno, std::system_category());
+		return x;
+	}
+
+	bool no_data(const std::error_code &ec) {
+		return ec == std::errc::no_message_available;
+	}
+
+	struct task {
+		std::string path;
+		bool directory = false;
+	};
+
+	/*
+	 * each worker owns a deque.  Workers push and pop at the back of their own
+	 * deque (depth first, so directory handles are released quickly) and steal
+	 * from the front of the others.
+	 */
+	class scanner {
+
+	public:
+		scanner(unsigned threads, const afp::scan_options &options) :
+			_options(options), _queues(threads), _results(threads)
+		{
+			for (auto &q : _queues) q.reset(new queue);
+		}
+
+		void push(unsigned self, task &&t) {
+			++_pending;
+			{
+				std::lock_guard<std::mutex> lock(_queues[self]->mutex);
+				_queues[self]->tasks.push_back(std::move(t));
+				++_queued;
+			}
+			wake(false);
+		}
+
+		/* idle workers sleep until there's something to steal or the scan is done. */
+		void run(unsigned self) {
+			task t;
+			while (_pending.load()) {
+				if (pop(self, t)) {
+					if (t.directory) scan_directory(self, t.path);
+					else scan_file(self, t.path);
+					if (--_pending == 0) wake(true);
+					continue;
+				}
+
+				std::unique_lock<std::mutex> lock(_idle_mutex);
+				++_sleepers;
+				_idle_cv.wait(lock, [this]{ return _queued.load() || !_pending.load(); });
+				--_sleepers;
+			}
+		}
+
+		std::vector<afp::scan_entry> results() {
+			std::vector<afp::scan_entry> rv;
+			size_t n = 0;
+			for (const auto &r : _results) n += r.size();
+			rv.reserve(n);
+			for (auto &r : _results) {
+				std::move(r.begin(), r.end(), std::back_inserter(rv));
+				r.clear();
+			}
+			std::sort(rv.begin(), rv.end(), [](const afp::scan_entry &a, const afp::scan_entry &b){
+				return a.path < b.path;
+			});
+			return rv;
+		}
+
+		/* with follow_symlinks, a directory reachable twice is only scanned once. */
+		bool first_visit(const struct stat &st) {
+			if (!_options.follow_symlinks) return true;
+			std::lock_guard<std::mutex> lock(_visited_mutex);
+			return _visited.insert(std::make_pair(st.st_dev, st.st_ino)).second;
+		}
+
+	private:
+		struct queue {
+			std::mutex mutex;
+			std::deque<task> tasks;
+		};
+
+		afp::scan_options _options;
+		std::vector<std::unique_ptr<queue>> _queues;
+		std::vector<std::vector<afp::scan_entry>> _results;
+		std::atomic<size_t> _pending{0}; // pushed, not yet finished
+		std::atomic<size_t> _queued{0}; // pushed, not yet popped
+
+		std::mutex _idle_mutex;
+		std::condition_variable _idle_cv;
+		std::atomic<unsigned> _sleepers{0};
+
+		std::mutex _visited_mutex;
+		std::set<std::pair<dev_t, ino_t>> _visited;
+
+		/*
+		 * the sleepers count and the queued count are each bumped before the
+		 * other is read, so either the pusher sees the sleeper or the sleeper
+		 * sees the task; the mutex is only taken when someone's asleep.
+		 */
+		void wake(bool all) {
+			if (!_sleepers.load()) return;
+			std::lock_guard<std::mutex> lock(_idle_mutex);
+			if (all) _idle_cv.notify_all();
+			else _idle_cv.notify_one();
+		}
+
+		bool pop(unsigned self, task &t) {
+			{
+				queue &q = *_queues[self];
+				std::lock_guard<std::mutex> lock(q.mutex);
+				if (!q.tasks.empty()) {
+					t = std::move(q.tasks.back());
+					q.tasks.pop_back();
+					--_queued;
+					return true;
+				}
+			}
+			for (size_t i = 1; i < _queues.size(); ++i) {
+				queue &q = *_queues[(self + i) % _queues.size()];
+				std::lock_guard<std::mutex> lock(q.mutex);
+				if (!q.tasks.empty()) {
+					t = std::move(q.tasks.front());
+					q.tasks.pop_front();
+					--_queued;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		void error(unsigned self, const std::string &path, int e) {
+			afp::scan_entry entry;
+			entry.path = path;
+			entry.error = std::error_code(e, std::system_category());
+			_results[self].push_back(std::move(entry));
+		}
+
+		void scan_directory(unsigned self, const std::string &path) {
+
+			DIR *dp = ::opendir(path.c_str());
+			if (!dp) {
+				error(self, path, errno);
+				return;
+			}
+
+			std::string prefix(path);
+			if (prefix.empty() || prefix.back() != '/') prefix.push_back('/');
+
+			for (;;) {
+				// readdir only sets errno on failure.
+				errno = 0;
+				struct dirent *d = ::readdir(dp);
+				if (!d) {
+					// what was read before the failure is still scanned.
+					if (errno) error(self, path, errno);
+					break;
+				}
+
+				const char *name = d->d_name;
+				if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) continue;
+
+				task t;
+				t.path = prefix + name;
+
+				unsigned char type = DT_UNKNOWN;
+				#ifdef _DIRENT_HAVE_D_TYPE
+				type = d->d_type;
+				#endif
+
+				if (type == DT_UNKNOWN || (_options.follow_symlinks && (type == DT_LNK || type == DT_DIR))) {
+					struct stat st;
+					int ok = _options.follow_symlinks ? ::stat(t.path.c_str(), &st) : ::lstat(t.path.c_str(), &st);
+					if (ok < 0) continue;
+					if (S_ISDIR(st.st_mode)) {
+						if (!first_visit(st)) continue;
+						type = DT_DIR;
+					}
+					else if (S_ISREG(st.st_mode)) type = DT_REG;
+					else continue;
+				}
+
+				if (type == DT_DIR) {
+					t.directory = true;
+					push(self, std::move(t));
+				}
+				else if (type == DT_REG) {
+					push(self, std::move(t));
+				}
+			}
+			::closedir(dp);
+		}
+
+		void scan_file(unsigned self, const std::string &path) {
+			_results[self].push_back(afp::scan_file(path));
+		}
+	};
+
+}
+
+namespace afp {
+
+	scan_entry scan_file(const std::string &path) {
+		scan_entry e;
+		std::error_code ec;
+
+		e.path = path;
+
+		finder_info fi;
+		if (fi.read(path, ec) || no_data(ec)) {
+			e.file_type = fi.file_type();
+			e.creator_type = fi.creator_type();
+			e.prodos_file_type = fi.prodos_file_type();
+			e.prodos_aux_type = fi.prodos_aux_type();
+		}
+		else e.error = ec;
+
+		e.resource_fork_size = resource_fork::size(path, ec);
+		if (ec && !no_data(ec) && !e.error) e.error = ec;
+
+		return e;
+	}
+
+	std::vector<scan_entry> scan_tree(const std::string &path, const scan_options &options, std::error_code &ec) {
+		ec.clear();
+
+		struct stat st;
+		if (_(::stat(path.c_str(), &st), ec) < 0) return std::vector<scan_entry>();
+
+		if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)) {
+			ec = std::make_error_code(std::errc::invalid_seek); // ESPIPE, as regular_file().
+			return std::vector<scan_entry>();
+		}
+
+		unsigned threads = options.threads;
+		if (!threads) threads = std::thread::hardware_concurrency();
+		if (!threads) threads = 1;
+
+		scanner s(threads, options);
+
+		task t;
+		t.path = path;
+		t.directory = S_ISDIR(st.st_mode);
+		if (t.directory) s.first_visit(st);
+		s.push(0, std::move(t));
+
+		std::vector<std::thread> workers;
+		workers.reserve(threads - 1);
+		for (unsigned i = 1; i < threads; ++i)
+			workers.emplace_back(&scanner::run, &s, i);
+
+		s.run(0);
+		for (auto &w : workers) w.join();
+
+		return s.results();
+	}
+
+}
@@ -0,0 +1,227 @@
+#include "stats.h"
+#include "stats_hooks.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+	static_assert((int)AFP_STATS_OPEN == (int)afp::stats::open, "stats order");
+	static_assert((int)AFP_STATS_REMOVE_XATTR == (int)afp::stats::remove_xattr, "stats order");
+
+	enum {
+		op_count = afp::stats::operation_count,
+		buckets = afp::stats::histogram_buckets,
+
+		// per operation: count, errors, total ns, histogram.
+		op_stride = 3 + buckets,
+		counter_base = op_count * op_stride,
+		value_count = counter_base + 4,
+	};
+
+	/*
+	 * one block per thread.  Only the owning thread writes, so a relaxed
+	 * load and store (not an atomic add) is enough; readers may see a
+	 * slightly stale value but never a torn one.
+	 */
+	struct block {
+		std::atomic<uint64_t> values[value_count];
+
+		block() {
+			for (auto &v : values) v.store(0, std::memory_order_relaxed);
+		}
+
+		void add(unsigned i, uint64_t n) {
+			values[i].store(values[i].load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+		}
+	};
+
+	/*
+	 * live blocks, plus the totals of exited threads.  reset() doesn't touch
+	 * the blocks (their owners may be writing); it records a baseline that
+	 * collect() subtracts.
+	 */
+	struct registry {
+		std::mutex mutex;
+		std::vector<block *> live;
+		uint64_t retired[value_count] = {};
+		uint64_t baseline[value_count] = {};
+	};
+
+	// never destroyed, so threads exiting during shutdown can still retire.
+	registry &global() {
+		static registry *r = new registry;
+		return *r;
+	}
+
+	std::atomic<bool> enabled_flag(true);
+
+	/*
+	 * the block pointer is a trivial thread_local, so it stays usable after
+	 * the holder is destroyed; recording at that point is just dropped.
+	 */
+	thread_local block *current = nullptr;
+	thread_local bool retired = false;
+
+	struct holder {
+		~holder() {
+			block *b = current;
+			current = nullptr;
+			retired = true;
+			if (!b) return;
+
+			registry &r = global();
+			std::lock_guard<std::mutex> lock(r.mutex);
+			for (unsigned i = 0; i < value_count; ++i)
+				r.retired[i] += b->values[i].load(std::memory_order_relaxed);
+			r.live.erase(std::remove(r.live.begin(), r.live.end(), b), r.live.end());
+			delete b;
+		}
+	};
+
+	thread_local holder tls_holder;
+
+	block *thread_block() {
+		if (current) return current;
+		if (retired) return nullptr;
+
+		(void)&tls_holder; // construct it, so the block is retired at thread exit.
+		block *b = new block;
+		registry &r = global();
+		{
+			std::lock_guard<std::mutex> lock(r.mutex);
+			r.live.push_back(b);
+		}
+		current = b;
+		return b;
+	}
+
+	uint64_t now_ns() {
+		using namespace std::chrono;
+		return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+	}
+
+	unsigned bucket(uint64_t ns) {
+		unsigned b = 0;
+	#if defined(__GNUC__)
+		if (ns) b = 63 - __builtin_clzll(ns);
+	#else
+		while (ns >>= 1) ++b;
+	#endif
+		return std::min<unsigned>(b, buckets - 1);
+	}
+
+	void totals(registry &r, uint64_t *out) {
+		for (unsigned i = 0; i < value_count; ++i) out[i] = r.retired[i];
+		for (block *b : r.live) {
+			for (unsigned i = 0; i < value_count; ++i)
+				out[i] += b->values[i].load(std::memory_order_relaxed);
+		}
+	}
+
+}
+
+extern "C" {
+
+	uint64_t afp_stats_begin(void) {
+		if (!enabled_flag.load(std::memory_order_relaxed)) return 0;
+		return now_ns();
+	}
+
+	void afp_stats_end(int op, uint64_t start, long long rv) {
+		if (!start) return;
+		int saved = errno; // callers report errno after we return.
+		block *b = thread_block();
+		errno = saved;
+		if (!b) return;
+
+		uint64_t ns = now_ns() - start;
+		unsigned base = op * op_stride;
+		b->add(base + 0, 1);
+		if (rv < 0) b->add(base + 1, 1);
+		b->add(base + 2, ns);
+		b->add(base + 3 + bucket(ns), 1);
+	}
+
+	void afp_stats_add(int counter, uint64_t n) {
+		if (!enabled_flag.load(std::memory_order_relaxed)) return;
+		int saved = errno;
+		block *b = thread_block();
+		errno = saved;
+		if (b) b->add(counter_base + counter, n);
+	}
+
+}
+
+namespace afp {
+
+	const char *stats::name(operation op) {
+		switch (op) {
+			case open: return "open";
+			case read_xattr: return "read_xattr";
+			case write_xattr: return "write_xattr";
+			case size_xattr: return "size_xattr";
+			case remove_xattr: return "remove_xattr";
+			default: return "";
+		}
+	}
+
+	void stats::set_enabled(bool enable) {
+		enabled_flag.store(enable, std::memory_order_relaxed);
+	}
+
+	bool stats::enabled() {
+		return enabled_flag.load(std::memory_order_relaxed);
+	}
+
+	stats::snapshot stats::collect() {
+		uint64_t v[value_count];
+		registry &r = global();
+		{
+			std::lock_guard<std::mutex> lock(r.mutex);
+			totals(r, v);
+			for (unsigned i = 0; i < value_count; ++i) v[i] -= r.baseline[i];
+		}
+
+		snapshot s;
+		for (unsigned op = 0; op < op_count; ++op) {
+			const uint64_t *cp = v + op * op_stride;
+			operation_stats &o = s.operations[op];
+			o.count = cp[0];
+			o.errors = cp[1];
+			o.total_ns = cp[2];
+			std::copy(cp + 3, cp + 3 + buckets, o.histogram);
+		}
+		s.erange_retries = v[counter_base + AFP_STATS_ERANGE_RETRIES];
+		s.bytes_read = v[counter_base + AFP_STATS_BYTES_READ];
+		s.bytes_written = v[counter_base + AFP_STATS_BYTES_WRITTEN];
+		s.bytes_copied = v[counter_base + AFP_STATS_BYTES_COPIED];
+		return s;
+	}
+
+	void stats::reset() {
+		registry &r = global();
+		std::lock_guard<std::mutex> lock(r.mutex);
+		totals(r, r.baseline);
+	}
+
+	uint64_t stats::percentile(const operation_stats &s, double fraction) {
+		uint64_t total = 0;
+		for (auto n : s.histogram) total += n;
+		if (!total) return 0;
+
+		uint64_t target = std::max<uint64_t>(1, (uint64_t)(fraction * total + 0.5));
+		uint64_t seen = 0;
+		for (unsigned i = 0; i < buckets; ++i) {
+			seen += s.histogram[i];
+			// report the bucket's upper bound.
+			if (seen >= target) return ((uint64_t)2 << i) - 1;
+		}
+		return ~(uint64_t)0;
+	}
+
+}
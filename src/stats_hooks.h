@@ -0,0 +1,45 @@
+#ifndef stats_hooks_h
+#define stats_hooks_h
+
+/*
+ * recording side of afp::stats, callable from C (xattr.c) and C++.
+ *
+ *   uint64_t t = afp_stats_begin();
+ *   rv = ...;
+ *   afp_stats_end(AFP_STATS_READ_XATTR, t, rv);
+ *
+ * begin returns 0 while recording is disabled and end ignores it.
+ * rv < 0 is counted as an error.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* same order as afp::stats::operation */
+enum {
+	AFP_STATS_OPEN,
+	AFP_STATS_READ_XATTR,
+	AFP_STATS_WRITE_XATTR,
+	AFP_STATS_SIZE_XATTR,
+	AFP_STATS_REMOVE_XATTR,
+};
+
+enum {
+	AFP_STATS_ERANGE_RETRIES,
+	AFP_STATS_BYTES_READ,
+	AFP_STATS_BYTES_WRITTEN,
+	AFP_STATS_BYTES_COPIED,
+};
+
+uint64_t afp_stats_begin(void);
+void afp_stats_end(int op, uint64_t start, long long rv);
+void afp_stats_add(int counter, uint64_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
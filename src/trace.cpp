@@ -0,0 +1,279 @@
+#include "trace.h"
+#include "trace_hooks.h"
+
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+namespace {
+
+	const char magic[8] = { 'A', 'F', 'P', 'T', 'R', 'A', 'C', 'E' };
+	enum { header_size = 16 };
+
+	std::error_code errno_code() {
+		return std::error_code(errno, std::system_category());
+	}
+
+	struct writer {
+		std::mutex mutex;
+		FILE *fp = nullptr;
+		uint64_t base_ns = 0;
+	};
+
+	// never destroyed, so calls made during shutdown can still record (or be dropped).
+	writer &global() {
+		static writer *w = new writer;
+		return *w;
+	}
+
+	std::atomic<unsigned> thread_ids(0);
+	thread_local unsigned thread_id = 0;
+
+	void put16(uint8_t *cp, uint16_t x) { cp[0] = x; cp[1] = x >> 8; }
+	void put32(uint8_t *cp, uint32_t x) { for (int i = 0; i < 4; ++i) cp[i] = x >> (8 * i); }
+	void put64(uint8_t *cp, uint64_t x) { for (int i = 0; i < 8; ++i) cp[i] = x >> (8 * i); }
+
+	uint16_t get16(const uint8_t *cp) { return cp[0] | (cp[1] << 8); }
+	uint32_t get32(const uint8_t *cp) {
+		uint32_t x = 0;
+		for (int i = 3; i >= 0; --i) x = (x << 8) | cp[i];
+		return x;
+	}
+	uint64_t get64(const uint8_t *cp) {
+		uint64_t x = 0;
+		for (int i = 7; i >= 0; --i) x = (x << 8) | cp[i];
+		return x;
+	}
+
+	/*
+	 * record layout:
+	 *   0 start ns (64), 8 duration ns (32), 12 thread (16), 14 op (8), 15 mode (8),
+	 *   16 errno (32), 20 reserved (32), 24 handle (64), 32 path hash (64),
+	 *   40 offset (64), 48 size (64), 56 result (64)
+	 */
+	void encode(const afp::trace::record &r, uint8_t *cp) {
+		std::memset(cp, 0, afp::trace::record_size);
+		put64(cp + 0, r.start_ns);
+		put32(cp + 8, r.duration_ns);
+		put16(cp + 12, r.thread);
+		cp[14] = r.op;
+		cp[15] = r.mode;
+		put32(cp + 16, (uint32_t)r.error);
+		put64(cp + 24, r.handle);
+		put64(cp + 32, r.path_hash);
+		put64(cp + 40, r.offset);
+		put64(cp + 48, r.size);
+		put64(cp + 56, r.result);
+	}
+
+	void decode(const uint8_t *cp, afp::trace::record &r) {
+		r.start_ns = get64(cp + 0);
+		r.duration_ns = get32(cp + 8);
+		r.thread = get16(cp + 12);
+		r.op = cp[14];
+		r.mode = cp[15];
+		r.error = (int32_t)get32(cp + 16);
+		r.handle = get64(cp + 24);
+		r.path_hash = get64(cp + 32);
+		r.offset = get64(cp + 40);
+		r.size = get64(cp + 48);
+		r.result = get64(cp + 56);
+	}
+
+	void stop_at_exit() {
+		std::error_code ec;
+		afp::trace::stop(ec);
+	}
+
+	/* AFP_TRACE=<file> records from start up. */
+	struct environment {
+		environment() {
+			const char *cp = std::getenv("AFP_TRACE");
+			if (!cp || !*cp) return;
+			std::error_code ec;
+			afp::trace::start(cp, ec);
+		}
+	} environment_init;
+
+}
+
+namespace trace_hooks {
+
+	std::atomic<bool> recording(false);
+	thread_local unsigned depth = 0;
+
+	uint64_t now_ns() {
+		using namespace std::chrono;
+		return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+	}
+
+	void record(afp::trace::record &r) {
+		int saved = errno;
+		uint64_t end = now_ns();
+		uint64_t d = end - r.start_ns;
+		r.duration_ns = d > UINT32_MAX ? UINT32_MAX : d;
+		if (!thread_id) thread_id = ++thread_ids;
+		r.thread = thread_id;
+
+		uint8_t buffer[afp::trace::record_size];
+		writer &w = global();
+		{
+			std::lock_guard<std::mutex> lock(w.mutex);
+			if (w.fp) {
+				r.start_ns = r.start_ns > w.base_ns ? r.start_ns - w.base_ns : 0;
+				encode(r, buffer);
+				fwrite(buffer, sizeof(buffer), 1, w.fp);
+			}
+		}
+		errno = saved;
+	}
+
+}
+
+namespace afp {
+
+	bool trace::start(const std::string &path, std::error_code &ec) {
+		ec.clear();
+		writer &w = global();
+		std::lock_guard<std::mutex> lock(w.mutex);
+		if (w.fp) {
+			ec = std::make_error_code(std::errc::device_or_resource_busy);
+			return false;
+		}
+
+		FILE *fp = fopen(path.c_str(), "wb");
+		if (!fp) {
+			ec = errno_code();
+			return false;
+		}
+
+		uint8_t header[header_size];
+		std::memcpy(header, magic, 8);
+		put32(header + 8, version);
+		put32(header + 12, record_size);
+		if (fwrite(header, sizeof(header), 1, fp) != 1) {
+			ec = errno_code();
+			fclose(fp);
+			return false;
+		}
+
+		static std::once_flag once;
+		std::call_once(once, []{ std::atexit(stop_at_exit); });
+
+		w.fp = fp;
+		w.base_ns = trace_hooks::now_ns();
+		trace_hooks::recording.store(true);
+		return true;
+	}
+
+	bool trace::stop(std::error_code &ec) {
+		ec.clear();
+		writer &w = global();
+		std::lock_guard<std::mutex> lock(w.mutex);
+		trace_hooks::recording.store(false);
+		if (!w.fp) return true;
+
+		if (fclose(w.fp) != 0) ec = errno_code();
+		w.fp = nullptr;
+		return !ec;
+	}
+
+	bool trace::recording() {
+		return trace_hooks::recording.load(std::memory_order_relaxed);
+	}
+
+	const char *trace::name(operation op) {
+		static const char *names[] = {
+			"none",
+			"finder_info.open",
+			"finder_info.attach",
+			"finder_info.close",
+			"finder_info.write",
+			"finder_info.write_path",
+			"finder_info.read_fast",
+			"resource_fork.open",
+			"resource_fork.attach",
+			"resource_fork.close",
+			"resource_fork.read",
+			"resource_fork.write",
+			"resource_fork.truncate",
+			"resource_fork.seek",
+			"resource_fork.size",
+			"resource_fork.view",
+			"resource_fork.flush",
+			"resource_fork.invalidate",
+			"resource_fork.set_write_back",
+			"resource_fork.set_chunked",
+			"resource_fork.remove",
+			"resource_fork.write_path",
+			"resource_fork.size_path",
+			"resource_fork.size_fast",
+			"resource_fork.read_fast",
+		};
+		static_assert(sizeof(names) / sizeof(names[0]) == operation_count, "trace names");
+		if (op < 0 || op >= operation_count) return "";
+		return names[op];
+	}
+
+	uint64_t trace::hash_path(const char *path) {
+		uint64_t h = 0xcbf29ce484222325;
+		for (const unsigned char *cp = (const unsigned char *)path; *cp; ++cp) {
+			h ^= *cp;
+			h *= 0x100000001b3;
+		}
+		return h;
+	}
+
+
+	bool trace::reader::open(const std::string &path, std::error_code &ec) {
+		ec.clear();
+		close();
+
+		_fp = fopen(path.c_str(), "rb");
+		if (!_fp) {
+			ec = errno_code();
+			return false;
+		}
+
+		uint8_t header[header_size];
+		if (fread(header, sizeof(header), 1, _fp) != 1 || std::memcmp(header, magic, 8)
+			|| get32(header + 8) != version || get32(header + 12) < record_size) {
+			ec = std::make_error_code(std::errc::illegal_byte_sequence);
+			close();
+			return false;
+		}
+		_record_size = get32(header + 12);
+		return true;
+	}
+
+	void trace::reader::close() {
+		if (_fp) fclose(_fp);
+		_fp = nullptr;
+		_record_size = 0;
+	}
+
+	bool trace::reader::next(record &r, std::error_code &ec) {
+		ec.clear();
+		if (!_fp) {
+			ec = std::make_error_code(std::errc::bad_file_descriptor);
+			return false;
+		}
+
+		// later versions may append fields; only the known prefix is decoded.
+		uint8_t buffer[256];
+		if (_record_size > sizeof(buffer)) {
+			ec = std::make_error_code(std::errc::illegal_byte_sequence);
+			return false;
+		}
+		if (fread(buffer, _record_size, 1, _fp) != 1) {
+			// a partial record at the end is a trace cut short; stop there.
+			if (ferror(_fp)) ec = errno_code();
+			return false;
+		}
+		decode(buffer, r);
+		return true;
+	}
+
+}
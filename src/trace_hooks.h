@@ -0,0 +1,89 @@
+#ifndef trace_hooks_h
+#define trace_hooks_h
+
+/*
+ * recording side of afp::trace.
+ *
+ *   trace_hooks::scope t(afp::trace::resource_fork_read, this, ec);
+ *   t.size(n).offset(_offset);
+ *   ...
+ *   return t.result(count);
+ *
+ * the record is written when the scope exits, with errno taken from ec.
+ * Only the outermost call on a thread is recorded, so a public call made
+ * by another (e.g. size(path) opening a resource_fork) isn't repeated.
+ * An op of none records nothing but still hides the calls made inside it
+ * (e.g. close() on a handle that isn't open).  When not recording, a scope
+ * is one relaxed load.
+ */
+
+#include <atomic>
+#include <string>
+#include <system_error>
+
+#include "trace.h"
+
+namespace trace_hooks {
+
+	extern std::atomic<bool> recording;
+	extern thread_local unsigned depth;
+
+	uint64_t now_ns();
+	void record(afp::trace::record &r);
+
+	class scope {
+	public:
+		scope(afp::trace::operation op, const void *handle, const std::error_code &ec) : _ec(ec) {
+			if (!recording.load(std::memory_order_relaxed)) return;
+			_nested = true;
+			if (depth++ || !op) return;
+			_r.op = op;
+			_r.handle = (uintptr_t)handle;
+			_r.start_ns = now_ns();
+		}
+
+		/* for calls without an error_code */
+		scope(afp::trace::operation op, const void *handle) : scope(op, handle, no_error()) {}
+
+		scope(const scope &) = delete;
+		scope& operator=(const scope &) = delete;
+
+		~scope() {
+			if (!_nested) return;
+			--depth;
+			if (!_r.op) return;
+			_r.error = _ec.value();
+			if (!_has_result) _r.result = !_ec;
+			record(_r);
+		}
+
+		scope &path(const std::string &p) {
+			if (_r.op) _r.path_hash = afp::trace::hash_path(p.c_str());
+			return *this;
+		}
+		scope &mode(unsigned m) { _r.mode = m; return *this; }
+		scope &size(uint64_t n) { _r.size = n; return *this; }
+		scope &offset(uint64_t n) { _r.offset = n; return *this; }
+
+		template<class T>
+		T result(T x) {
+			_r.result = (uint64_t)x;
+			_has_result = true;
+			return x;
+		}
+
+	private:
+		static const std::error_code &no_error() {
+			static const std::error_code ec;
+			return ec;
+		}
+
+		const std::error_code &_ec;
+		afp::trace::record _r;
+		bool _nested = false;
+		bool _has_result = false; // otherwise 1 / 0 for success / failure
+	};
+
+}
+
+#endif
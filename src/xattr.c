@@ -1,5 +1,7 @@
 
 #include "xattr.h"
+#include "stats_hooks.h"
+#include "probes.h"
 
 #if defined(__APPLE__)
 #include <sys/xattr.h>
@@ -12,6 +14,7 @@
 #if defined(__FreeBSD__)
 #include <sys/types.h>
 #include <sys/extattr.h>
+#include <string.h>
 #endif
 
 #if defined(_AIX)
@@ -23,60 +26,107 @@
  * extended attributes functions.
  */
 #if defined(__APPLE__)
-ssize_t size_xattr(int fd, const char *xattr) {
+static ssize_t os_size_xattr(int fd, const char *xattr) {
 	return fgetxattr(fd, xattr, NULL, 0, 0, 0);
 }
 
-ssize_t read_xattr(int fd, const char *xattr, void *buffer, size_t size) {
+static ssize_t os_read_xattr(int fd, const char *xattr, void *buffer, size_t size) {
 	return fgetxattr(fd, xattr, buffer, size, 0, 0);
 }
 
-ssize_t write_xattr(int fd, const char *xattr, const void *buffer, size_t size) {
+static ssize_t os_write_xattr(int fd, const char *xattr, const void *buffer, size_t size) {
 	if (fsetxattr(fd, xattr, buffer, size, 0, 0) < 0) return -1;
 	return size;
 }
 
-int remove_xattr(int fd, const char *xattr) {
+static int os_remove_xattr(int fd, const char *xattr) {
 	return fremovexattr(fd, xattr, 0);
 }
 
+ssize_t list_xattr(int fd, char *buffer, size_t size) {
+	return flistxattr(fd, buffer, size, 0);
+}
+
+static ssize_t os_size_xattr_path(const char *path, const char *xattr) {
+	return getxattr(path, xattr, NULL, 0, 0, 0);
+}
+
+static ssize_t os_read_xattr_path(const char *path, const char *xattr, void *buffer, size_t size) {
+	return getxattr(path, xattr, buffer, size, 0, 0);
+}
+
 #elif defined(__linux__) 
-ssize_t size_xattr(int fd, const char *xattr) {
+static ssize_t os_size_xattr(int fd, const char *xattr) {
 	return fgetxattr(fd, xattr, NULL, 0);
 }
 
-ssize_t read_xattr(int fd, const char *xattr, void *buffer, size_t size) {
+static ssize_t os_read_xattr(int fd, const char *xattr, void *buffer, size_t size) {
 	return fgetxattr(fd, xattr, buffer, size);
 }
 
-ssize_t write_xattr(int fd, const char *xattr, const void *buffer, size_t size) {
+static ssize_t os_write_xattr(int fd, const char *xattr, const void *buffer, size_t size) {
 	if (fsetxattr(fd, xattr, buffer, size, 0) < 0) return -1;
 	return size;
 }
 
-int remove_xattr(int fd, const char *xattr) {
+static int os_remove_xattr(int fd, const char *xattr) {
 	return fremovexattr(fd, xattr);
 }
 
+ssize_t list_xattr(int fd, char *buffer, size_t size) {
+	return flistxattr(fd, buffer, size);
+}
+
+static ssize_t os_size_xattr_path(const char *path, const char *xattr) {
+	return getxattr(path, xattr, NULL, 0);
+}
+
+static ssize_t os_read_xattr_path(const char *path, const char *xattr, void *buffer, size_t size) {
+	return getxattr(path, xattr, buffer, size);
+}
+
 #elif defined(__FreeBSD__)
-ssize_t size_xattr(int fd, const char *xattr) {
+static ssize_t os_size_xattr(int fd, const char *xattr) {
 	return extattr_get_fd(fd, EXTATTR_NAMESPACE_USER, xattr, NULL, 0);
 }
 
-ssize_t read_xattr(int fd, const char *xattr, void *buffer, size_t size) {
+static ssize_t os_read_xattr(int fd, const char *xattr, void *buffer, size_t size) {
 	return extattr_get_fd(fd, EXTATTR_NAMESPACE_USER, xattr, buffer, size);
 }
 
-ssize_t write_xattr(int fd, const char *xattr, const void *buffer, size_t size) {
+static ssize_t os_write_xattr(int fd, const char *xattr, const void *buffer, size_t size) {
 	return extattr_set_fd(fd, EXTATTR_NAMESPACE_USER, xattr, buffer, size);
 }
 
-int remove_xattr(int fd, const char *xattr) {
+static int os_remove_xattr(int fd, const char *xattr) {
 	return extattr_delete_fd(fd, EXTATTR_NAMESPACE_USER, xattr);
 }
 
+ssize_t list_xattr(int fd, char *buffer, size_t size) {
+	/* names are length-prefixed; shift each one left to NUL-terminate it. */
+	ssize_t rv = extattr_list_fd(fd, EXTATTR_NAMESPACE_USER, size ? buffer : NULL, size);
+	if (rv <= 0 || size == 0) return rv;
+
+	for (ssize_t i = 0; i < rv; ) {
+		unsigned n = (unsigned char)buffer[i];
+		if (i + 1 + n > rv) break;
+		memmove(buffer + i, buffer + i + 1, n);
+		buffer[i + n] = 0;
+		i += n + 1;
+	}
+	return rv;
+}
+
+static ssize_t os_size_xattr_path(const char *path, const char *xattr) {
+	return extattr_get_file(path, EXTATTR_NAMESPACE_USER, xattr, NULL, 0);
+}
+
+static ssize_t os_read_xattr_path(const char *path, const char *xattr, void *buffer, size_t size) {
+	return extattr_get_file(path, EXTATTR_NAMESPACE_USER, xattr, buffer, size);
+}
+
 #elif defined(_AIX)
-ssize_t size_xattr(int fd, const char *xattr) {
+static ssize_t os_size_xattr(int fd, const char *xattr) {
 	/*
 	struct stat64x st;
 	if (fstatea(fd, xattr, &st) < 0) return -1;
@@ -85,17 +135,108 @@ ssize_t size_xattr(int fd, const char *xattr) {
 	return fgetea(fd, xattr, NULL, 0);
 }
 
-ssize_t read_xattr(int fd, const char *xattr, void *buffer, size_t size) {
+static ssize_t os_read_xattr(int fd, const char *xattr, void *buffer, size_t size) {
 	return fgetea(fd, xattr, buffer, size);
 }
 
-ssize_t write_xattr(int fd, const char *xattr, const void *buffer, size_t size) {
+static ssize_t os_write_xattr(int fd, const char *xattr, const void *buffer, size_t size) {
 	if (fsetea(fd, xattr, buffer, size, 0) < 0) return -1;
 	return size;
 }
 
-int remove_xattr(int fd, const char *xattr) {
+static int os_remove_xattr(int fd, const char *xattr) {
 	return fremoveea(fd, xattr);
 }
 
+ssize_t list_xattr(int fd, char *buffer, size_t size) {
+	return flistea(fd, buffer, size);
+}
+
+static ssize_t os_size_xattr_path(const char *path, const char *xattr) {
+	return getea(path, xattr, NULL, 0);
+}
+
+static ssize_t os_read_xattr_path(const char *path, const char *xattr, void *buffer, size_t size) {
+	return getea(path, xattr, buffer, size);
+}
+
+#endif
+
+
+/*
+ * timed front ends (see afp::stats), with entry / return probes.
+ */
+#if defined(__APPLE__) || defined(__linux__) || defined(__FreeBSD__) || defined(_AIX)
+
+#define ERRNO(rv) ((rv) < 0 ? errno : 0)
+
+ssize_t size_xattr(int fd, const char *xattr) {
+	uint64_t t = afp_stats_begin();
+	ssize_t rv;
+
+	AFP_PROBE2(xattr__size__entry, fd, xattr);
+	rv = os_size_xattr(fd, xattr);
+	AFP_PROBE4(xattr__size__return, fd, xattr, rv, ERRNO(rv));
+	afp_stats_end(AFP_STATS_SIZE_XATTR, t, rv);
+	return rv;
+}
+
+ssize_t read_xattr(int fd, const char *xattr, void *buffer, size_t size) {
+	uint64_t t = afp_stats_begin();
+	ssize_t rv;
+
+	AFP_PROBE3(xattr__read__entry, fd, xattr, size);
+	rv = os_read_xattr(fd, xattr, buffer, size);
+	AFP_PROBE4(xattr__read__return, fd, xattr, rv, ERRNO(rv));
+	afp_stats_end(AFP_STATS_READ_XATTR, t, rv);
+	if (rv > 0) afp_stats_add(AFP_STATS_BYTES_READ, rv);
+	return rv;
+}
+
+ssize_t write_xattr(int fd, const char *xattr, const void *buffer, size_t size) {
+	uint64_t t = afp_stats_begin();
+	ssize_t rv;
+
+	AFP_PROBE3(xattr__write__entry, fd, xattr, size);
+	rv = os_write_xattr(fd, xattr, buffer, size);
+	AFP_PROBE4(xattr__write__return, fd, xattr, rv, ERRNO(rv));
+	afp_stats_end(AFP_STATS_WRITE_XATTR, t, rv);
+	if (rv > 0) afp_stats_add(AFP_STATS_BYTES_WRITTEN, rv);
+	return rv;
+}
+
+int remove_xattr(int fd, const char *xattr) {
+	uint64_t t = afp_stats_begin();
+	int rv;
+
+	AFP_PROBE2(xattr__remove__entry, fd, xattr);
+	rv = os_remove_xattr(fd, xattr);
+	AFP_PROBE3(xattr__remove__return, fd, xattr, ERRNO(rv));
+	afp_stats_end(AFP_STATS_REMOVE_XATTR, t, rv);
+	return rv;
+}
+
+ssize_t size_xattr_path(const char *path, const char *xattr) {
+	uint64_t t = afp_stats_begin();
+	ssize_t rv;
+
+	AFP_PROBE2(xattr__size_path__entry, path, xattr);
+	rv = os_size_xattr_path(path, xattr);
+	AFP_PROBE4(xattr__size_path__return, path, xattr, rv, ERRNO(rv));
+	afp_stats_end(AFP_STATS_SIZE_XATTR, t, rv);
+	return rv;
+}
+
+ssize_t read_xattr_path(const char *path, const char *xattr, void *buffer, size_t size) {
+	uint64_t t = afp_stats_begin();
+	ssize_t rv;
+
+	AFP_PROBE3(xattr__read_path__entry, path, xattr, size);
+	rv = os_read_xattr_path(path, xattr, buffer, size);
+	AFP_PROBE4(xattr__read_path__return, path, xattr, rv, ERRNO(rv));
+	afp_stats_end(AFP_STATS_READ_XATTR, t, rv);
+	if (rv > 0) afp_stats_add(AFP_STATS_BYTES_READ, rv);
+	return rv;
+}
+
 #endif